@@ -15,10 +15,15 @@ class Bartender final
 public:
     Bartender();
 
-    bool init(int basePort);
+    bool init(int basePort, LagerTransport transport = LagerTransport::TCP);
     void start();
     void stop();
 
+    /**
+     * @brief Gets the zmq context, which in-process Taps and Mugs must share to use LagerTransport::INPROC
+     */
+    std::shared_ptr<zmq::context_t> getContext() const {return context;}
+
 protected:
     std::shared_ptr<ClusteredHashmapServer> registrar;
     std::shared_ptr<Forwarder> forwarder;
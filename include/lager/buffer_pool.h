@@ -0,0 +1,66 @@
+#ifndef BUFFER_POOL
+#define BUFFER_POOL
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+
+/**
+ * @brief Fixed set of preallocated, equally sized message buffers shared between one owner and zmq
+ *
+ * The owner takes buffers with acquire() and hands them to zmq::message_t along with release() as the free
+ * function and the pool as the hint, so zmq sends them without a copy and gives them back from its io thread once
+ * they're written out.  The free list is a lock-free stack, so neither side blocks or allocates after construction.
+ *
+ * Buffers can outlive the owner (zmq may still hold some after the owning socket closes), so a pool is only
+ * ever created with new and ended with retire(); it deletes itself once the last outstanding buffer comes back.
+ */
+class BufferPool final
+{
+public:
+    /**
+     * @brief Deleter for holding a pool in a unique_ptr, retires it instead of deleting it
+     */
+    struct Retirer
+    {
+        void operator()(BufferPool* pool) const
+        {
+            pool->retire();
+        }
+    };
+
+    BufferPool(size_t bufferSize_in, size_t count_in);
+
+    uint8_t* acquire();
+    void retire();
+    bool owns(const void* data) const;
+
+    static void release(void* data, void* hint);
+
+    size_t getBufferSize() const {return bufferSize;}
+    size_t getCount() const {return count;}
+    size_t getOutstanding() const;
+
+private:
+    ~BufferPool() {}
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    void push(uint32_t index);
+
+    std::unique_ptr<uint8_t[]> storage;
+    std::unique_ptr<std::atomic<uint32_t>[]> next; // free list links, next[i] follows buffer i
+
+    size_t bufferSize;
+    size_t count;
+
+    // the top of the free list in the low 32 bits and a change counter in the high 32 bits, so a buffer that is
+    // taken and given back between another thread's load and compare_exchange can't be mistaken for no change
+    std::atomic<uint64_t> head;
+
+    // outstanding buffers plus one for the owner, whoever drops it to zero deletes the pool
+    std::atomic<size_t> refs;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#ifndef BYTE_SWAP
+#define BYTE_SWAP
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+
+#ifdef _MSC_VER
+#include <stdlib.h>
+#endif
+
+/**
+ * @brief Bulk byte order conversion of arrays of 2, 4 and 8 byte values
+ *
+ * Short arrays are swapped inline one value at a time.  Anything filling at least one 16 byte vector goes to
+ * swapArray(), which uses the AVX2, SSSE3 or scalar kernel RowConverter picked at runtime for this CPU.  Source and
+ * destination may be unaligned but must not partially overlap.
+ */
+namespace byte_swap
+{
+    /**
+    * @brief Compile time check for a little endian host
+    */
+    inline bool isLittleEndian()
+    {
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return false;
+#else
+        return true;
+#endif
+    }
+
+    inline uint16_t swap(uint16_t value)
+    {
+#ifdef _MSC_VER
+        return _byteswap_ushort(value);
+#else
+        return __builtin_bswap16(value);
+#endif
+    }
+
+    inline uint32_t swap(uint32_t value)
+    {
+#ifdef _MSC_VER
+        return _byteswap_ulong(value);
+#else
+        return __builtin_bswap32(value);
+#endif
+    }
+
+    inline uint64_t swap(uint64_t value)
+    {
+#ifdef _MSC_VER
+        return _byteswap_uint64(value);
+#else
+        return __builtin_bswap64(value);
+#endif
+    }
+
+    /**
+    * @brief Scalar byte swap of count values of type T
+    */
+    template<class T>
+    inline void swapScalar(const uint8_t* src, uint8_t* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            T tmp;
+            memcpy(&tmp, src + i * sizeof(T), sizeof(T));
+            tmp = swap(tmp);
+            memcpy(dst + i * sizeof(T), &tmp, sizeof(T));
+        }
+    }
+
+    // defined next to RowConverter's kernels in row_converter.cpp, so anything swapping arrays links dataformat
+    void swapArray(const void* src, void* dst, size_t size, size_t count);
+
+    /**
+    * @brief Byte swaps count values of T (uint16_t, uint32_t or uint64_t), handing arrays of a vector or more to
+    * the runtime dispatched kernel
+    */
+    template<class T>
+    inline void swapValues(const void* src, void* dst, size_t count)
+    {
+        if (count * sizeof(T) >= 16)
+        {
+            swapArray(src, dst, sizeof(T), count);
+        }
+        else
+        {
+            swapScalar<T>(static_cast<const uint8_t*>(src), static_cast<uint8_t*>(dst), count);
+        }
+    }
+
+    /**
+    * @brief Converts count host order values of the given size into network order
+    * @param src points to the host order values
+    * @param dst points to room for count network order values
+    * @param size is the size in bytes of one value (1, 2, 4 or 8)
+    * @param count is the number of values
+    */
+    inline void toNetwork(const void* src, void* dst, size_t size, size_t count)
+    {
+        if (size == 1 || !isLittleEndian())
+        {
+            if (src != dst)
+            {
+                memcpy(dst, src, size * count);
+            }
+
+            return;
+        }
+
+        switch (size)
+        {
+            case 2:
+                swapValues<uint16_t>(src, dst, count);
+                break;
+
+            case 4:
+                swapValues<uint32_t>(src, dst, count);
+                break;
+
+            case 8:
+                swapValues<uint64_t>(src, dst, count);
+                break;
+
+            default:
+                if (src != dst)
+                {
+                    memcpy(dst, src, size * count);
+                }
+
+                break;
+        }
+    }
+
+    /**
+    * @brief Converts count network order values of the given size into host order
+    */
+    inline void toHost(const void* src, void* dst, size_t size, size_t count)
+    {
+        toNetwork(src, dst, size, count);
+    }
+}
+
+#endif
@@ -26,12 +26,17 @@
 class ClusteredHashmapClient final
 {
 public:
-    ClusteredHashmapClient(const std::string& serverHost_in, int basePort, int timeoutMillis_in);
+    ClusteredHashmapClient(const std::string& serverHost_in, int basePort, int timeoutMillis_in,
+                           LagerTransport transport_in = LagerTransport::TCP);
 
     void init(std::shared_ptr<zmq::context_t> context_in, const std::string& uuid);
     void addOrUpdateKeyValue(const std::string& key, const std::string& value);
+    void addOrUpdateKeyValue(const std::string& key, const std::string& value, const std::string& keyUuid);
     void removeKey(const std::string& key);
+    void untrackKey(const std::string& key);
     void setCallback(const std::function<void()>& func);
+    unsigned int addCallback(const std::function<void()>& func);
+    void removeCallback(unsigned int id);
     void start();
     void stop();
     bool isTimedOut() {return timedOut;};
@@ -44,12 +49,15 @@ private:
     void publisherThread();
     void initialize(std::shared_ptr<zmq::context_t> context_in);
     std::map<std::string, std::string> getUnsyncedHashmap();
+    void notifyUpdated();
 
     std::shared_ptr<zmq::context_t> context;
     std::shared_ptr<zmq::socket_t> snapshot;
     std::shared_ptr<zmq::socket_t> subscriber;
     std::shared_ptr<zmq::socket_t> publisher;
-    std::function<void()> hashMapUpdated;
+    std::map<unsigned int, std::function<void()>> callbacks; // <callback id, callback>
+    std::mutex callbackMutex;
+    unsigned int nextCallbackId;
 
     std::thread snapshotThreadHandle;
     std::thread subscriberThreadHandle;
@@ -60,6 +68,7 @@ private:
     std::map<std::string, std::string> hashMap; // <topic name, xml format>
     std::map<std::string, std::string> uuidMap; // <uuid, topic name>
     std::map<std::string, std::string> selfMap; // <topic name, xml format>
+    std::map<std::string, std::string> selfUuids; // <topic name, uuid>, several when shared through a LagerRuntime
 
     std::string uuid;
     std::string serverHost;
@@ -69,6 +78,8 @@ private:
     int publisherPort;
     int timeoutMillis;
 
+    LagerTransport transport;
+
     double sequence;
 
     bool initialized;
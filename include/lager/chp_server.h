@@ -21,7 +21,7 @@
 class ClusteredHashmapServer final
 {
 public:
-    explicit ClusteredHashmapServer(int basePort);
+    explicit ClusteredHashmapServer(int basePort, LagerTransport transport_in = LagerTransport::TCP);
 
     void init(std::shared_ptr<zmq::context_t> context_in);
     void addOrUpdateKeyValue(const std::string& key, const std::string& value);
@@ -62,6 +62,8 @@ private:
     int publisherPort;
     int collectorPort;
 
+    LagerTransport transport;
+
     double sequence;
 
     bool publisherRunning;
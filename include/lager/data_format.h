@@ -14,11 +14,12 @@ struct DataItem
 {
     std::string name; // description of data column
     std::string type; // type as a string correspoding to accepted lager formats
-    size_t size; // size in bytes of the data type
+    size_t size; // size in bytes of the whole column, all elements for an array
     off_t offset; // offset in bytes from zero of the column
+    size_t count; // number of elements of type in the column, 1 for scalars
 
-    DataItem(const std::string& n, const std::string& t, unsigned int s, unsigned int o):
-        name(n), type(t), size(s), offset(o) {}
+    DataItem(const std::string& n, const std::string& t, unsigned int s, unsigned int o, unsigned int c = 1):
+        name(n), type(t), size(s), offset(o), count(c) {}
 };
 
 /**
@@ -35,6 +36,8 @@ public:
     std::string getVersion() {return version;}
     std::string getKey() {return key;}
     size_t getItemsSize() {return itemsSize;}
+    bool isLittleEndian() {return littleEndian;}
+    void setLittleEndian(bool littleEndian_in) {littleEndian = littleEndian_in;}
 
     void addItem(const DataItem& item);
 
@@ -55,6 +58,7 @@ private:
     std::string version;
     std::string key;
     size_t itemsSize;
+    bool littleEndian; // row values are little endian instead of network order
 };
 
 #endif
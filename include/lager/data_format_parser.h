@@ -54,6 +54,8 @@ public:
     std::shared_ptr<DataFormat> parseFromString(const std::string& xmlStr_in);
     bool createFromDataRefItems(const std::vector<AbstractDataRefItem*>& items,
                                 const std::string& version, const std::string& key);
+    bool createFromDataItems(const std::vector<DataItem>& items,
+                             const std::string& version, const std::string& key, bool littleEndian = false);
     bool createFromUuidMap(const std::map<std::string, std::string>& uuidMap,
                            const std::map<std::string, std::string>& metaMap);
     bool isValid(const std::string& xml, unsigned int itemCount);
@@ -75,6 +77,8 @@ private:
     XMLCh* attType;
     XMLCh* attSize;
     XMLCh* attOffset;
+    XMLCh* attCount;
+    XMLCh* attByteOrder;
     XMLCh* attUuid;
     XMLCh* attKey;
     XMLCh* attValue;
@@ -0,0 +1,29 @@
+#ifndef DATA_FORMAT_WRITER
+#define DATA_FORMAT_WRITER
+
+#include <string>
+#include <vector>
+
+#include "data_format.h"
+#include "data_ref_item.h"
+
+/**
+ * @brief Streams the xml of a data format straight into a string, without building a DOM
+ *
+ * Produces the same format documents as the DOM based DataFormatParser, valid against data_format.xsd, but
+ * needs neither Xerces nor the schema file, and costs one pass over the items.  Attribute values are escaped, so
+ * any column name or key that is valid xml text can be used.
+ */
+class DataFormatWriter
+{
+public:
+    static std::string fromDataItems(const std::vector<DataItem>& items, const std::string& version,
+                                     const std::string& key, bool littleEndian = false);
+    static std::string fromDataRefItems(const std::vector<AbstractDataRefItem*>& items, const std::string& version,
+                                        const std::string& key, bool littleEndian = false);
+
+    static void appendAttribute(std::string& xml, const char* name, const std::string& value);
+    static void appendAttribute(std::string& xml, const char* name, size_t value);
+};
+
+#endif
@@ -1,11 +1,14 @@
 #ifndef DATA_REF_ITEM
 #define DATA_REF_ITEM
 
+#include <array>
+#include <cstring>
 #include <string>
 #include <stdint.h>
 #include <typeinfo>
 #include <stdexcept>
 
+#include "lager/byte_swap.h"
 #include "lager/lager_utils.h"
 
 /**
@@ -13,22 +16,47 @@
  */
 struct AbstractDataRefItem
 {
-    AbstractDataRefItem(const std::string& name_in, const std::string& type_in, size_t size_in):
-        name(name_in), type(type_in), size(size_in), offset(0) {}
+    AbstractDataRefItem(const std::string& name_in, const std::string& type_in, size_t size_in, size_t count_in = 1):
+        name(name_in), type(type_in), size(size_in), offset(0), count(count_in) {}
+
+    virtual ~AbstractDataRefItem() {}
 
     virtual void getNetworkDataRef(void* data) = 0;
 
+    /**
+     * @brief Copies the column as is, in host order.  The default converts back from getNetworkDataRef(),
+     * the items below override it with a plain copy.
+     * @param data points to room for getSize() bytes
+     */
+    virtual void getHostDataRef(void* data)
+    {
+        getNetworkDataRef(data);
+        byte_swap::toHost(data, data, count > 0 ? size / count : size, count);
+    }
+
+    /**
+     * @brief Gets the user memory the column is copied from, if getHostDataRef() is a plain copy of getSize()
+     * bytes from it.  Lets a Tap merge neighbouring columns into a single copy.
+     * @returns the address of the user data, or nullptr if the column has to be captured through getHostDataRef()
+     */
+    virtual const void* getDataRef() const
+    {
+        return nullptr;
+    }
+
     const std::string getName() {return name;}
     const std::string getType() {return type;}
     size_t getSize() {return size;}
     off_t getOffset() {return offset;}
+    size_t getCount() {return count;}
     void setOffset(off_t offset_in) {offset = offset_in;}
 
 protected:
     std::string name; /*!< a descriptive name for this column of data */
     std::string type; /*!< a lager data type */
-    size_t size; /*!< the size of the data type */
+    size_t size; /*!< the size of the whole column, all elements for an array */
     off_t offset; /*!< the offset of this column of data from zero */
+    size_t count; /*!< the number of elements of type in the column, 1 for scalars */
 };
 
 /**
@@ -53,6 +81,16 @@ public:
         throw std::runtime_error("unsupported data type");
     }
 
+    void getHostDataRef(void* data)
+    {
+        memcpy(data, dataRef, sizeof(T));
+    }
+
+    const void* getDataRef() const
+    {
+        return dataRef;
+    }
+
 private:
     T* dataRef;
 };
@@ -147,4 +185,82 @@ template<> inline void DataRefItem<double>::getNetworkDataRef(void* data)
     *(uint64_t*)data = lager_utils::htonll(*reinterpret_cast<uint64_t*>(dataRef));
 }
 
+/**
+ * @brief Lager type name of each supported element type, used by the array and typed items
+ */
+template<class T>
+struct DataRefItemTraits
+{
+    static_assert(sizeof(T) == 0, "unsupported data type");
+};
+
+template<> struct DataRefItemTraits<uint8_t> {static const char* name() {return "uint8_t";}};
+template<> struct DataRefItemTraits<int8_t> {static const char* name() {return "int8_t";}};
+template<> struct DataRefItemTraits<uint16_t> {static const char* name() {return "uint16_t";}};
+template<> struct DataRefItemTraits<int16_t> {static const char* name() {return "int16_t";}};
+template<> struct DataRefItemTraits<uint32_t> {static const char* name() {return "uint32_t";}};
+template<> struct DataRefItemTraits<int32_t> {static const char* name() {return "int32_t";}};
+template<> struct DataRefItemTraits<uint64_t> {static const char* name() {return "uint64_t";}};
+template<> struct DataRefItemTraits<int64_t> {static const char* name() {return "int64_t";}};
+template<> struct DataRefItemTraits<float> {static const char* name() {return "float32";}};
+template<> struct DataRefItemTraits<double> {static const char* name() {return "float64";}};
+
+/**
+ * @brief A fixed length array of a supported type registered as a single column
+ *
+ * The column is count elements wide and is converted to network order with one bulk byte swap
+ * rather than an item per element.  Works on any contiguous storage (C array, std::vector data(), ...)
+ * as long as the pointer and length stay valid while the tap is running.
+ */
+template<class T>
+class ArrayDataRefItem : public AbstractDataRefItem
+{
+public:
+    /**
+     * @brief Constructor
+     * @param name_in is the column name
+     * @param dataRef_in points to the first of count elements
+     * @param count_in is the number of elements
+     * @throws runtime_error on a zero count
+     */
+    ArrayDataRefItem(const std::string& name_in, T* dataRef_in, size_t count_in):
+        AbstractDataRefItem(name_in, DataRefItemTraits<T>::name(), sizeof(T) * count_in, count_in),
+        dataRef(dataRef_in)
+    {
+        if (count_in == 0)
+        {
+            throw std::runtime_error("array items require at least one element");
+        }
+    }
+
+    void getNetworkDataRef(void* data)
+    {
+        byte_swap::toNetwork(dataRef, data, sizeof(T), count);
+    }
+
+    void getHostDataRef(void* data)
+    {
+        memcpy(data, dataRef, size);
+    }
+
+    const void* getDataRef() const
+    {
+        return dataRef;
+    }
+
+private:
+    T* dataRef;
+};
+
+/**
+ * @brief DataRefItem for a std::array, same as an ArrayDataRefItem over its elements
+ */
+template<class T, size_t N>
+class DataRefItem<std::array<T, N>> : public ArrayDataRefItem<T>
+{
+public:
+    DataRefItem(const std::string& name_in, std::array<T, N>* dataRef_in):
+        ArrayDataRefItem<T>(name_in, dataRef_in->data(), N) {}
+};
+
 #endif
@@ -17,7 +17,7 @@
 class Forwarder final
 {
 public:
-    explicit Forwarder(int basePort);
+    explicit Forwarder(int basePort, LagerTransport transport_in = LagerTransport::TCP);
 
     void init(std::shared_ptr<zmq::context_t> context_in);
     void start();
@@ -37,6 +37,8 @@ private:
     int frontendPort;
     int backendPort;
 
+    LagerTransport transport;
+
     bool running;
 };
 
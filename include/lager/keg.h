@@ -24,6 +24,7 @@ public:
     void start();
     void stop();
     void write(const std::vector<uint8_t>& data, size_t size);
+    void write(const uint8_t* data, size_t size);
     void addFormat(const std::string& uuid, const std::string& formatStr);
     void setMetaData(const std::string& key, const std::string& value);
     const std::string getLogFile() { return logFileName; }
@@ -0,0 +1,93 @@
+#ifndef LAGER_CLOCK
+#define LAGER_CLOCK
+
+#include <chrono>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__linux__) && defined(__GNUC__) && defined(__x86_64__)
+#define LAGER_CLOCK_TSC
+#include <x86intrin.h>
+#endif
+
+/**
+* @brief Where a LagerClock gets its time from
+*/
+enum class LagerClockSource
+{
+    REALTIME, // wall clock, same as lager_utils::getCurrentTime()
+    MONOTONIC_RAW, // time since boot, never stepped or slewed, not comparable across machines
+    REALTIME_COARSE, // wall clock at scheduler tick resolution (a few ms), but read without a system call
+    TSC // wall clock extrapolated from the CPU's timestamp counter, the cheapest read, x86-64 with invariant TSC only
+};
+
+/**
+* @brief Nanosecond clock with a selectable source, for timestamping rows
+*
+* On Linux the clock_gettime() sources are normally read through the vDSO without a system call, and TSC is a
+* single instruction.  REALTIME is
+* the default and matches the timestamps Taps have always used.  The TSC source is calibrated against
+* CLOCK_MONOTONIC_RAW once per process and anchored to the wall clock at that moment, so it doesn't follow later
+* NTP adjustments.  Other platforms use std::chrono::system_clock for every source but TSC.
+*/
+class LagerClock final
+{
+public:
+    explicit LagerClock(LagerClockSource source_in = LagerClockSource::REALTIME);
+
+    static bool isSupported(LagerClockSource source);
+
+    LagerClockSource getSource() const {return source;}
+
+    /**
+    * @brief Reads the clock
+    * @returns the current time in nanoseconds
+    */
+    uint64_t now() const
+    {
+        switch (source)
+        {
+#ifdef LAGER_CLOCK_TSC
+            case LagerClockSource::TSC:
+                return tscBaseNanos + static_cast<uint64_t>((static_cast<unsigned __int128>(__rdtsc() - tscBase) *
+                                                             tscMult) >> TSC_SHIFT);
+#endif
+
+#ifdef __linux__
+            case LagerClockSource::MONOTONIC_RAW:
+                return read(CLOCK_MONOTONIC_RAW);
+
+            case LagerClockSource::REALTIME_COARSE:
+                return read(CLOCK_REALTIME_COARSE);
+
+            default:
+                return read(CLOCK_REALTIME);
+#else
+            default:
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           std::chrono::system_clock::now().time_since_epoch()).count();
+#endif
+        }
+    }
+
+private:
+    static const unsigned int TSC_SHIFT = 32; // tscMult is nanoseconds per tick in 32.32 fixed point
+
+#ifdef __linux__
+    static uint64_t read(clockid_t id)
+    {
+        timespec ts;
+        clock_gettime(id, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    }
+#endif
+
+    LagerClockSource source;
+
+    // copied from the process wide calibration so now() doesn't touch shared state
+    uint64_t tscBase;
+    uint64_t tscBaseNanos;
+    uint64_t tscMult;
+};
+
+#endif
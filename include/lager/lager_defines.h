@@ -1,6 +1,8 @@
 #ifndef LAGER_DEFINES
 #define LAGER_DEFINES
 
+#include <stdint.h>
+
 // CHP port offsets
 const unsigned int CHP_SNAPSHOT_OFFSET = 0;
 const unsigned int CHP_PUBLISHER_OFFSET = 1;
@@ -8,15 +10,45 @@ const unsigned int CHP_COLLECTOR_OFFSET = 2;
 const unsigned int FORWARDER_FRONTEND_OFFSET = 10;
 const unsigned int FORWARDER_BACKEND_OFFSET = 11;
 
+// Transports, ipc and inproc endpoints are named after the port they stand in for
+enum class LagerTransport
+{
+    TCP, // tcp://host:port, works across hosts
+    IPC, // ipc://IPC_PATH_PREFIX<port>, components on the same host
+    INPROC // inproc://INPROC_NAME_PREFIX<port>, components in the same process sharing one zmq context
+};
+
+const char* const IPC_PATH_PREFIX = "/tmp/lager-";
+const char* const INPROC_NAME_PREFIX = "lager-";
+
 // Data Format sizes
 const unsigned int UUID_SIZE_BYTES = 16;
 const unsigned int VERSION_SIZE_BYTES = 8;
 const unsigned int COMPRESSION_SIZE_BYTES = 4;
 const unsigned int TIMESTAMP_SIZE_BYTES = 8;
 
+// Data message flags
+const uint8_t DATA_FLAG_PACKED_PAYLOAD = 0x01; // payload is one frame holding the whole row
+const uint8_t DATA_FLAG_BATCHED = 0x02; // payload is one frame holding several (timestamp, length, row) records
+const uint8_t DATA_FLAG_DELTA = 0x04; // rows are a change bitmap followed by only the changed columns
+const uint8_t DATA_FLAG_LITTLE_ENDIAN = 0x08; // row values are little endian instead of network order
+const unsigned int BATCH_ROW_LENGTH_SIZE_BYTES = 4;
+const unsigned int DELTA_SEQUENCE_SIZE_BYTES = 4;
+
 // other
 const int BASEPORT_MAX = 65535;
 const unsigned int THREAD_CLOSE_WAIT_MILLIS = 100;
 const unsigned int THREAD_CLOSE_WAIT_RETRIES = 10;
+const unsigned int TAP_QUEUE_DEPTH_DEFAULT = 1024;
+const unsigned int TAP_IDLE_WAKE_MILLIS = 1000;
+const unsigned int TAP_DELTA_KEYFRAME_INTERVAL_DEFAULT = 100;
+const unsigned int TAP_BUFFER_POOL_SIZE_DEFAULT = 64;
+const unsigned int TAP_SNAPSHOT_RETRIES = 16;
+const unsigned int TAP_REALTIME_POLL_MICROS_DEFAULT = 1000;
+const unsigned int MUG_PARKED_ROWS_MAX = 1024;
+const unsigned int MUG_PARKED_ROWS_PER_TAP_MAX = 256;
+const unsigned int MUG_PARKED_ROWS_MAX_AGE_MILLIS = 5000;
+const unsigned int MUG_PIPELINE_QUEUE_DEPTH_DEFAULT = 1024;
+const unsigned int MUG_PIPELINE_IDLE_WAKE_MILLIS = 100;
 
 #endif
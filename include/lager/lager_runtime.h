@@ -0,0 +1,125 @@
+#ifndef LAGER_RUNTIME
+#define LAGER_RUNTIME
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <zmq.hpp>
+
+#include "chp_client.h"
+
+/**
+ * @brief Process-wide zmq context, publishing thread and CHP clients shared by any number of Taps and Mugs
+ *
+ * Standalone, every Tap has its own context, publisher thread and CHP client (three more threads), so thread count
+ * grows with the number of taps.  Taps and Mugs initialized with a runtime instead share one context, one CHP client
+ * per bartender, and every Tap's queue is published by the runtime's single reactor thread through one socket per
+ * endpoint.
+ *
+ * Registered publishers are called in turn from the reactor thread.  When none has pending work the reactor sleeps
+ * until one of them calls wake() or the earliest time any of them asked to be called again.
+ *
+ * Embedded publishers skip zmq and the Forwarder entirely: they hand each row to deliverRow(), which passes it
+ * straight to every registered row sink (e.g. an embedded Mug's Keg), still from the reactor thread.  They are
+ * called with deliverMutex held instead of publishersMutex, so a slow sink doesn't hold up the zmq publishers or
+ * add().
+ */
+class LagerRuntime final
+{
+public:
+    // publishes whatever is pending using the given socket, returns the longest the reactor may wait before calling
+    // again (zero if there's more to do right away)
+    typedef std::function<std::chrono::microseconds(zmq::socket_t&)> PublishFunction;
+
+    // returns true when there is work waiting, checked before the reactor goes to sleep
+    typedef std::function<bool()> PendingFunction;
+
+    // hands whatever is pending to deliverRow(), returns as PublishFunction does
+    typedef std::function<std::chrono::microseconds()> DeliverFunction;
+
+    // receives one row: the 16 byte uuid of its tap and the network order timestamp followed by the row
+    typedef std::function<void(const std::string& uuid, const uint8_t* row, size_t size)> RowSinkFunction;
+
+    LagerRuntime();
+    explicit LagerRuntime(std::shared_ptr<zmq::context_t> context_in);
+    ~LagerRuntime();
+
+    static std::shared_ptr<LagerRuntime> getDefault();
+
+    std::shared_ptr<zmq::context_t> getContext() const {return context;}
+    std::shared_ptr<ClusteredHashmapClient> getChpClient(const std::string& serverHost, int basePort,
+                                                         int timeoutMillis,
+                                                         LagerTransport transport = LagerTransport::TCP);
+
+    unsigned int addPublisher(const std::string& uri, const PublishFunction& publish, const PendingFunction& pending);
+    unsigned int addEmbeddedPublisher(const DeliverFunction& deliver, const PendingFunction& pending);
+    void removePublisher(unsigned int id);
+    size_t getPublisherCount();
+
+    unsigned int addRowSink(const RowSinkFunction& sink);
+    void removeRowSink(unsigned int id);
+    void deliverRow(const std::string& uuid, const uint8_t* row, size_t size);
+
+    void wake();
+
+    /**
+     * @brief Checks whether the reactor is asleep, so a producer knows it has to call wake()
+     * Producers must make their work visible (followed by a seq_cst fence) before checking.
+     */
+    bool isWaiting() const
+    {
+        return reactorWaiting.load(std::memory_order_relaxed);
+    }
+
+private:
+    LagerRuntime(const LagerRuntime&) = delete;
+    LagerRuntime& operator=(const LagerRuntime&) = delete;
+
+    /**
+     * @brief A registered publisher and the endpoint its messages go to
+     */
+    struct Publisher
+    {
+        std::string uri;
+        PublishFunction publish;
+        DeliverFunction deliver; // set instead of publish for embedded publishers
+        PendingFunction pending;
+        zmq::socket_t* socket; // set by the reactor thread on its first pass
+    };
+
+    unsigned int add(const Publisher& p);
+    void reactorThread();
+    bool anyPending();
+
+    std::shared_ptr<zmq::context_t> context;
+    std::thread reactorThreadHandle;
+
+    std::mutex deliverMutex; // held while embedded publishers and row sinks are called, taken before publishersMutex
+    std::mutex publishersMutex; // held by the reactor for a whole pass, so removePublisher() waits it out
+    std::map<unsigned int, Publisher> publishers; // embedded ones are only erased with deliverMutex held too
+    std::map<unsigned int, RowSinkFunction> rowSinks; // guarded by deliverMutex
+    std::vector<const DeliverFunction*> embeddedPass; // only used by the reactor thread, with deliverMutex held
+    unsigned int nextPublisherId;
+    unsigned int nextRowSinkId;
+
+    std::mutex wakeMutex;
+    std::condition_variable wakeCv;
+    std::atomic<bool> reactorWaiting;
+    bool wakePending; // set by wake(), guarded by wakeMutex, so a wake before the reactor sleeps isn't lost
+
+    std::mutex chpMutex;
+    std::map<std::string, std::weak_ptr<ClusteredHashmapClient>> chpClients; // <server uri, client>
+
+    std::atomic<bool> running;
+    bool reactorStarted;
+};
+
+#endif
@@ -22,6 +22,7 @@
 
 #include <zmq.hpp>
 
+#include "byte_swap.h"
 #include "lager_defines.h"
 
 namespace lager_utils
@@ -161,13 +162,41 @@ namespace lager_utils
 #endif
     }
 
+    /**
+    * @brief Helper to get a zmq uri for a transport that doesn't go through the network, named after the port
+    * @param port is a port number generate the uri with
+    * @param transport is LagerTransport::IPC or LagerTransport::INPROC
+    * @returns a string containing the uri
+    */
+    static std::string getHostLocalUri(int port, LagerTransport transport)
+    {
+        std::stringstream ss;
+
+        if (transport == LagerTransport::IPC)
+        {
+            ss << "ipc://" << IPC_PATH_PREFIX << port;
+        }
+        else
+        {
+            ss << "inproc://" << INPROC_NAME_PREFIX << port;
+        }
+
+        return ss.str();
+    }
+
     /**
     * @brief Helper to get a local zmq uri
     * @param port is a port number generate the uri with
+    * @param transport selects tcp (the default), ipc or inproc
     * @returns a string containing the uri
     */
-    static std::string getLocalUri(int port)
+    static std::string getLocalUri(int port, LagerTransport transport = LagerTransport::TCP)
     {
+        if (transport != LagerTransport::TCP)
+        {
+            return getHostLocalUri(port, transport);
+        }
+
         std::stringstream ss;
         ss << "tcp://*:" << port;
         return ss.str();
@@ -175,12 +204,20 @@ namespace lager_utils
 
     /**
     * @brief Helper to get a remote zmq uri
-    * @param remoteUriBase is a string with the IP address or hostname to generate the uri with
+    * @param remoteUriBase is a string with the IP address or hostname to generate the uri with, unused by ipc and
+    * inproc which only reach the same host or process
     * @param remotePort is a port number generate the uri with
+    * @param transport selects tcp (the default), ipc or inproc
     * @returns a string containing the uri
     */
-    static std::string getRemoteUri(const std::string& remoteUriBase, int remotePort)
+    static std::string getRemoteUri(const std::string& remoteUriBase, int remotePort,
+                                    LagerTransport transport = LagerTransport::TCP)
     {
+        if (transport != LagerTransport::TCP)
+        {
+            return getHostLocalUri(remotePort, transport);
+        }
+
         std::stringstream ss;
         ss << "tcp://" << remoteUriBase << ":" << remotePort;
         return ss.str();
@@ -262,21 +299,8 @@ namespace lager_utils
     */
     static uint64_t htonll(uint64_t value)
     {
-        // The answer is 42
-        static const int num = 42;
-
-        // Check the endianness
-        if (*reinterpret_cast<const char*>(&num) == num)
-        {
-            const uint32_t high_part = htonl(static_cast<uint32_t>(value >> 32));
-            const uint32_t low_part = htonl(static_cast<uint32_t>(value & 0xFFFFFFFFLL));
-
-            return (static_cast<uint64_t>(low_part) << 32) | high_part;
-        }
-        else
-        {
-            return value;
-        }
+        // endianness is known at compile time, so this is a single bswap or nothing
+        return byte_swap::isLittleEndian() ? byte_swap::swap(value) : value;
     }
 
     /**
@@ -288,6 +312,51 @@ namespace lager_utils
     {
         return lager_utils::htonll(value);
     }
+
+    /**
+    * @brief Matches a key against a glob, where * is any run of characters (including /) and ? is any one character
+    * @param pattern is the glob, e.g. "/RobotA/" followed by * for every key under /RobotA/
+    * @param text is the key to match
+    * @returns true if the whole key matches
+    */
+    static bool matchesGlob(const std::string& pattern, const std::string& text)
+    {
+        size_t p = 0;
+        size_t t = 0;
+        size_t star = std::string::npos; // position of the last * seen in pattern
+        size_t resume = 0; // where in text that * is currently matched up to
+
+        while (t < text.size())
+        {
+            if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == text[t]))
+            {
+                ++p;
+                ++t;
+            }
+            else if (p < pattern.size() && pattern[p] == '*')
+            {
+                star = p++;
+                resume = t;
+            }
+            else if (star != std::string::npos)
+            {
+                // let the last * swallow one more character and try again from there
+                p = star + 1;
+                t = ++resume;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        while (p < pattern.size() && pattern[p] == '*')
+        {
+            ++p;
+        }
+
+        return p == pattern.size();
+    }
 }
 
 #endif
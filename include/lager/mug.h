@@ -1,15 +1,100 @@
 #ifndef MUG
 #define MUG
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <future>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <set>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "chp_client.h"
 #include "data_format_parser.h"
 #include "lager/keg.h"
+#include "lager/lager_runtime.h"
+#include "lager/mug_sink.h"
+#include "lager/row_ring_buffer.h"
+
+/**
+* @brief Per tap state needed to rebuild full rows from delta encoded ones
+*/
+struct MugDeltaState
+{
+    MugDeltaState(): nextSequence(0), synced(false) {}
+
+    std::shared_ptr<DataFormat> format; // the format items and lastRow were built from
+    std::vector<DataItem> items;
+    std::vector<uint8_t> lastRow; // network order row as of the last message
+    uint32_t nextSequence; // the sequence number the tap's next delta row should have
+    bool synced; // true once a keyframe has filled every column, until a row is missed
+};
+
+/**
+* @brief Rows of one tap received before its format, see Mug::parkRow()
+*/
+struct MugParkedRows
+{
+    std::chrono::steady_clock::time_point since; // when the oldest row was parked
+    std::vector<std::vector<uint8_t>> rows; // uuid, network order timestamp and row
+};
+
+/**
+* @brief The frames of one data message, reused from message to message
+*/
+struct MugMessage
+{
+    MugMessage(): count(0) {}
+
+    std::vector<zmq::message_t> frames; // only the first count belong to the current message
+    size_t count;
+};
+
+/**
+* @brief A decoded row on its way from a decode worker to the writer, reused from row to row
+*/
+struct MugRowBuffer
+{
+    std::shared_ptr<DataFormat> format;
+    std::vector<uint8_t> data; // uuid, network order timestamp and row
+};
+
+/**
+* @brief Decode stage state.  Without a pipeline the subscriber thread has the only one, in a pipeline each decode
+* thread has its own and every message of a tap goes to the same one, so the tap's rows stay in order.
+*/
+struct MugWorker
+{
+    MugWorker(): parkedCount(0), waiting(false) {}
+
+    std::map<std::string, MugDeltaState> deltaStates; // <uuid, delta state>
+    std::map<std::string, MugParkedRows> parkedRows; // <uuid, rows>, received before the format
+    size_t parkedCount; // rows in parkedRows
+    std::vector<uint8_t> data; // the row being assembled, sized from its tap's format
+
+    // pipeline only, each ring holds pointers and has exactly one producer and one consumer thread
+    std::unique_ptr<RowRingBuffer> inbox; // MugMessage* from the subscriber thread
+    std::unique_ptr<RowRingBuffer> freeMessages; // MugMessage* back to the subscriber thread
+    std::unique_ptr<RowRingBuffer> outbox; // MugRowBuffer* to the writer thread
+    std::unique_ptr<RowRingBuffer> freeRows; // MugRowBuffer* back from the writer thread
+    std::thread thread;
+    std::mutex wakeMutex;
+    std::condition_variable wakeCv; // signalled when the inbox or freeRows gets something while the thread waits
+    std::atomic<bool> waiting;
+};
+
+/**
+* @brief How far behind each pipeline stage is, see Mug::getQueueDepths()
+*/
+struct MugQueueDepths
+{
+    std::vector<size_t> decode; // messages waiting for each decode worker
+    std::vector<size_t> write; // rows each decode worker has waiting for the writer
+};
 
 /**
 * @brief The data sink object for the lager system
@@ -22,34 +107,96 @@ public:
 
     bool init(const std::string& serverHost_in, int basePort, int timeOutMillis,
               const std::string& kegDir = "./");
+    bool init(const std::shared_ptr<LagerRuntime>& runtime_in, const std::string& serverHost_in, int basePort,
+              int timeOutMillis, const std::string& kegDir = "./");
     void start();
     void stop();
+    void setTransport(LagerTransport transport_in);
+    void setEmbedded(bool enabled);
+    void subscribe(const std::string& pattern);
+    void addSink(const std::shared_ptr<MugSink>& sink);
+    void setPipeline(size_t decodeThreads, size_t queueDepth = MUG_PIPELINE_QUEUE_DEPTH_DEFAULT);
+    MugQueueDepths getQueueDepths() const;
+    uint64_t getDroppedCount() const {return droppedCount;}
 
 protected:
     void subscriberThread();
+    void receiveFrames(zmq::socket_t& socket, MugMessage& message);
+    void receiveMessage(zmq::socket_t& socket, MugMessage& message);
+    void dispatchMessage(MugMessage*& message);
+    void decodeMessage(MugWorker& worker, const MugMessage& message);
+    void dropMessage(MugWorker& worker, const MugMessage& message);
+    void startPipeline();
+    void stopPipeline();
+    void decodeThread(MugWorker& worker);
+    void writerThread();
     void hashMapUpdated();
+    void updateFormats(const std::map<std::string, std::string>& newHashMap,
+                       const std::map<std::string, std::string>& newUuidMap);
+    bool isSubscribed(const std::string& topic) const;
+    void updateFilters();
+    void applyFilters(zmq::socket_t& socket, std::set<std::string>& installed);
+    std::shared_ptr<DataFormat> getFormat(const std::string& uuid);
+    bool isKnownWithoutFormat(const std::string& uuid);
+    void writeBatch(MugWorker& worker, const std::string& uuid, const std::shared_ptr<DataFormat>& format,
+                    uint8_t flags, const uint8_t* payload, size_t size);
+    bool applyDelta(MugWorker& worker, const std::string& uuid, const std::shared_ptr<DataFormat>& format,
+                    const uint8_t* encoded, size_t size);
+    void dropRow(MugWorker& worker, const std::string& uuid);
+    void parkRow(MugWorker& worker, const std::string& uuid, size_t size);
+    void flushParked(MugWorker& worker, const std::string& uuid, const std::shared_ptr<DataFormat>& format);
+    void flushParked(MugWorker& worker);
+    void discardParked(MugWorker& worker, std::map<std::string, MugParkedRows>::iterator parked);
+    void emitRow(MugWorker& worker, const std::shared_ptr<DataFormat>& format, const uint8_t* data, size_t size);
+    void writeEmbedded(const std::string& uuid, const uint8_t* row, size_t size);
+    void writeRow(const DataFormat* format, const uint8_t* data, size_t size);
+    void writeRow(const uint8_t* tapUuid, const uint8_t* record, size_t rowSize, const DataFormat* format);
 
     std::shared_ptr<Keg> keg;
+    std::unique_ptr<KegSink> kegSink; // always the first sink
+    FanOutSink sinks; // added with addSink(), after the keg
     std::shared_ptr<ClusteredHashmapClient> chpClient;
     std::shared_ptr<zmq::context_t> context;
+    std::shared_ptr<LagerRuntime> runtime; // set when sharing a runtime's context and CHP client
     std::shared_ptr<zmq::socket_t> subscriber;
     std::function<void()> hashMapUpdatedHandle;
 
     std::thread subscriberThreadHandle;
+    std::thread writerThreadHandle;
     std::mutex mutex;
+    std::mutex writerWakeMutex;
+    std::condition_variable writerWakeCv; // signalled when an outbox gets a row while the writer waits
 
     std::map<std::string, std::string> hashMap; // <topic name, xml format>
     std::map<std::string, std::shared_ptr<DataFormat>> formatMap; // <uuid, dataformat>
-    std::vector<std::string> subscribedList; // <topic name>
+    std::unordered_map<std::string, std::shared_ptr<DataFormat>> formatCache; // <xml format, dataformat>
+    std::map<std::string, std::string> uuidMap; // <uuid, topic name>
+    std::vector<std::string> subscribedList; // <key glob>, everything when empty
+    std::set<std::string> subscriberFilters; // uuid prefixes the subscriber socket should have, "" for everything
+    std::atomic<bool> filtersChanged; // set when subscriberFilters changes, cleared by the subscriber thread
     std::shared_ptr<DataFormatParser> formatParser;
+    std::vector<std::unique_ptr<MugWorker>> workers; // one per decode thread, or the subscriber thread's own
+    std::vector<std::unique_ptr<MugMessage>> messagePool; // the first is the subscriber thread's, the rest are queued
+    std::vector<std::unique_ptr<MugRowBuffer>> rowPool;
 
     std::string serverHost;
     std::string uuid;
 
     int subscriberPort;
+    unsigned int chpCallbackId;
+    unsigned int rowSinkId;
+    size_t pipelineThreads; // decode threads, 0 to do everything on the subscriber thread
+    size_t pipelineDepth; // messages and rows each decode thread can have queued
+    std::atomic<uint64_t> droppedCount; // rows that didn't match their format or couldn't be parked or queued
+    std::atomic<bool> decodeStopping; // decode threads finish their queued messages and end
+    std::atomic<bool> writeStopping; // the writer finishes its queued rows and ends
+    std::atomic<bool> writerWaiting;
+    LagerTransport transport;
 
+    bool embedded; // rows come from the runtime's embedded taps instead of a subscriber socket
     bool running;
     bool subscriberRunning;
+    bool pipelined; // the decode and writer threads are running
 };
 
 #endif
@@ -0,0 +1,90 @@
+#ifndef MUG_SINK
+#define MUG_SINK
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "data_format.h"
+#include "lager/keg.h"
+#include "lager/lager_defines.h"
+
+/**
+* @brief Non-owning view of one row received by a Mug, only valid for the duration of MugSink::write()
+*
+* The network order timestamp always sits right before the payload, so record() is the row exactly as a keg stores
+* it after the uuid.
+*/
+struct MugRow
+{
+    const uint8_t* uuid; // UUID_SIZE_BYTES of the tap the row is from
+    uint64_t timestamp; // nanoseconds, host order
+    const uint8_t* payload; // columns laid out by the format's item offsets, in the format's byte order
+    size_t payloadSize;
+    const DataFormat* format; // nullptr if the tap's format hasn't arrived yet, only possible for embedded rows
+
+    MugRow(const uint8_t* u, uint64_t t, const uint8_t* p, size_t s, const DataFormat* f):
+        uuid(u), timestamp(t), payload(p), payloadSize(s), format(f) {}
+
+    const uint8_t* record() const {return payload - TIMESTAMP_SIZE_BYTES;}
+    size_t recordSize() const {return TIMESTAMP_SIZE_BYTES + payloadSize;}
+};
+
+/**
+* @brief Where a Mug sends the rows it receives, one row at a time and never concurrently.  Called from the mug's
+* subscriber thread, or its writer thread once Mug::setPipeline() has split it into stages.  In embedded mode it is
+* called from the runtime's reactor thread, or from a stopping tap's thread handing over its last rows.
+*/
+class MugSink
+{
+public:
+    virtual ~MugSink() {}
+
+    virtual void write(const MugRow& row) = 0;
+};
+
+/**
+* @brief Writes rows to a keg, every Mug has one of these first
+*/
+class KegSink : public MugSink
+{
+public:
+    explicit KegSink(const std::shared_ptr<Keg>& keg_in): keg(keg_in) {}
+
+    void write(const MugRow& row) override;
+
+private:
+    std::shared_ptr<Keg> keg;
+};
+
+/**
+* @brief Hands rows to a function, e.g. for a live view or statistics
+*/
+class CallbackSink : public MugSink
+{
+public:
+    explicit CallbackSink(const std::function<void(const MugRow&)>& callback_in): callback(callback_in) {}
+
+    void write(const MugRow& row) override;
+
+private:
+    std::function<void(const MugRow&)> callback;
+};
+
+/**
+* @brief Passes each row to several sinks in the order they were added, all of them see the same buffer.  Fan-outs
+* can be nested to build chains and trees of sinks.
+*/
+class FanOutSink : public MugSink
+{
+public:
+    void add(const std::shared_ptr<MugSink>& sink);
+    bool empty() const {return sinks.empty();}
+
+    void write(const MugRow& row) override;
+
+private:
+    std::vector<std::shared_ptr<MugSink>> sinks;
+};
+
+#endif
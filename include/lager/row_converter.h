@@ -0,0 +1,67 @@
+#ifndef ROW_CONVERTER
+#define ROW_CONVERTER
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+#include "lager/data_format.h"
+
+/**
+ * @brief A contiguous run of same sized values within a row
+ */
+struct SwapRun
+{
+    size_t offset; // offset in bytes of the run from the start of the row
+    size_t elementSize; // size in bytes of each value, 1 means copy only
+    size_t count; // number of values in the run
+
+    SwapRun(size_t o, size_t e, size_t c): offset(o), elementSize(e), count(c) {}
+};
+
+/**
+ * @brief One step of the vectorized plan, either a 16 byte shuffle or a whole run
+ */
+struct ShuffleStep
+{
+    size_t offset; // offset in bytes of the step from the start of the row
+    size_t elementSize; // 0 for a shuffle through mask, otherwise as SwapRun
+    size_t count; // number of values for a run, number of values swapped by a shuffle
+    uint8_t mask[16]; // byte shuffle for the 16 bytes at offset, unused for a run
+};
+
+/**
+ * @brief Converts whole rows between host and network byte order using a plan built from the data format
+ *
+ * Adjacent columns with the same element size are merged into runs, long runs are swapped a vector at a
+ * time and the short mixed columns in between are packed into one shuffle per 16 bytes of row, so a row
+ * costs a handful of instructions instead of a call per value.  The kernel (AVX2, SSSE3 or scalar) is picked once at
+ * runtime from what the CPU supports.
+ */
+class RowConverter
+{
+public:
+    explicit RowConverter(const std::vector<DataItem>& items);
+    explicit RowConverter(DataFormat& format);
+
+    void toNetwork(const uint8_t* src, uint8_t* dst) const;
+    void toHost(const uint8_t* src, uint8_t* dst) const;
+
+    const std::vector<SwapRun>& getPlan() const {return plan;}
+    size_t getStepCount() const {return steps.size();}
+    size_t getRowSize() const {return rowSize;}
+
+    static const char* getKernelName();
+
+private:
+    void buildPlan(const std::vector<DataItem>& items);
+    void buildSteps();
+    void convert(const uint8_t* src, uint8_t* dst) const;
+
+    std::vector<SwapRun> plan; // used by the scalar kernel
+    std::vector<ShuffleStep> steps; // used by the vector kernels
+    size_t rowSize;
+    bool swapNeeded;
+};
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef ROW_RING_BUFFER
+#define ROW_RING_BUFFER
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * @brief Bounded ring of fixed size row slots with a single consumer and one or many producers
+ *
+ * The producer reserves a slot with beginWrite(), fills it in place and publishes it with
+ * commitWrite().  The consumer does the same with beginRead() and commitRead().  Neither side
+ * ever blocks or allocates after construction.
+ *
+ * In multi producer mode every slot carries a sequence number (as in Vyukov's bounded queue): producers claim
+ * slots with a compare and swap on the head and publish them by bumping the slot's sequence, so they only ever
+ * contend on the head and never wait on each other.  Producers must then pass their slot to commitWrite().  The
+ * consumer takes slots in claim order, so a producer preempted between claiming and committing holds up the rows
+ * claimed after it until it commits.
+ */
+class RowRingBuffer final
+{
+public:
+    RowRingBuffer(size_t slotSize_in, size_t depth_in, bool multiProducer_in = false);
+
+    uint8_t* beginWrite();
+    void commitWrite();
+    void commitWrite(uint8_t* slot);
+    uint8_t* beginRead();
+    void commitRead();
+
+    bool empty() const;
+    size_t size() const;
+    size_t getSlotSize() const {return slotSize;}
+    size_t getDepth() const {return depth;}
+    bool isMultiProducer() const {return multiProducer;}
+
+private:
+    RowRingBuffer(const RowRingBuffer&) = delete;
+    RowRingBuffer& operator=(const RowRingBuffer&) = delete;
+
+    std::vector<uint8_t> buffer;
+    std::unique_ptr<std::atomic<size_t>[]> sequence; // per slot, only allocated in multi producer mode
+
+    size_t slotSize;
+    size_t depth;
+    size_t mask;
+    bool multiProducer;
+
+    // head and tail are kept on separate cache lines so the producer and consumer don't
+    // invalidate each other on every write
+    std::atomic<size_t> head; // next slot to write, only modified by the producer(s)
+    char headPad[64 - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> tail; // next slot to read, only modified by the consumer
+    char tailPad[64 - sizeof(std::atomic<size_t>)];
+};
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef ROW_SAMPLER
+#define ROW_SAMPLER
+
+#include <cstddef>
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "lager/data_format.h"
+
+/**
+ * @brief An absolute and relative deadband for one floating point column
+ */
+struct Deadband
+{
+    double absolute; // changes at or below this are ignored
+    double relative; // changes at or below this fraction of the last logged value are ignored
+
+    Deadband(): absolute(0), relative(0) {}
+    Deadband(double a, double r): absolute(a), relative(r) {}
+};
+
+/**
+ * @brief A range of the row compared as one piece, either byte for byte or value by value against a deadband
+ */
+struct SampleRange
+{
+    size_t offset; // offset in bytes of the range from the start of the row
+    size_t size; // size in bytes of the range
+    size_t elementSize; // 0 for a byte for byte range, otherwise 4 or 8 for a deadband column of float32 or float64
+    Deadband deadband;
+
+    SampleRange(size_t o, size_t s, size_t e, const Deadband& d): offset(o), size(s), elementSize(e), deadband(d) {}
+};
+
+/**
+ * @brief Decides which rows a Tap actually logs, so rows nobody asked for are dropped before they are queued
+ *
+ * Rows can be limited to a minimum interval between them, and to rows where something changed since the last
+ * logged row.  Floating point columns may be given a deadband so noise doesn't count as a change.  The plan is
+ * built once from the data format, neighbouring columns without a deadband are compared with a single memcmp.
+ */
+class RowSampler
+{
+public:
+    RowSampler(const std::vector<DataItem>& items, uint64_t minIntervalNanos_in, bool logOnChange_in,
+               const std::map<std::string, Deadband>& deadbands);
+
+    bool isDue(uint64_t timestamp) const;
+    bool isChangeGated() const {return changeGated;}
+    bool hasChanged(const uint8_t* row) const;
+    void logged(uint64_t timestamp, const uint8_t* row);
+
+    const std::vector<SampleRange>& getPlan() const {return plan;}
+
+private:
+    std::vector<SampleRange> plan;
+    std::vector<uint8_t> lastRow; // host order copy of the last logged row, only kept when change gated
+
+    uint64_t minIntervalNanos;
+    uint64_t lastTimestamp;
+
+    bool changeGated;
+    bool hasLast;
+};
+
+#endif
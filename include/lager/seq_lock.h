@@ -0,0 +1,100 @@
+#ifndef SEQ_LOCK
+#define SEQ_LOCK
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * @brief Sequence lock letting a Tap take consistent snapshots of values another thread keeps updating
+ *
+ * The thread that owns the values brackets each update with writeBegin() and writeEnd() (or a WriteGuard),
+ * which never blocks.  Readers copy the values between readBegin() and readRetry() and copy again if a write
+ * overlapped.  Writers must not overlap each other.
+ *
+ * Example:
+ *     SeqLock lock;
+ *     tap.setSnapshotLock(&lock);
+ *     ...
+ *     {
+ *         SeqLock::WriteGuard guard(lock);
+ *         x = ...;
+ *         y = ...;
+ *     }
+ *     tap.log();
+ */
+class SeqLock final
+{
+public:
+    /**
+     * @brief Marks the values as being updated for the lifetime of the guard
+     */
+    class WriteGuard
+    {
+    public:
+        explicit WriteGuard(SeqLock& lock_in): lock(lock_in)
+        {
+            lock.writeBegin();
+        }
+
+        ~WriteGuard()
+        {
+            lock.writeEnd();
+        }
+
+    private:
+        WriteGuard(const WriteGuard&) = delete;
+        WriteGuard& operator=(const WriteGuard&) = delete;
+
+        SeqLock& lock;
+    };
+
+    SeqLock(): sequence(0) {}
+
+    /**
+     * @brief Starts an update, the sequence is odd until writeEnd()
+     */
+    void writeBegin()
+    {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+        // keeps the writes to the values from moving above the sequence change
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    /**
+     * @brief Ends an update, the sequence is even again
+     */
+    void writeEnd()
+    {
+        sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Starts a read
+     * @returns the sequence to pass to readRetry()
+     */
+    uint64_t readBegin() const
+    {
+        return sequence.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Checks whether the values read since readBegin() may be torn
+     * @param start is the value returned by readBegin()
+     * @returns true if a write was in progress or happened meanwhile and the read has to be repeated
+     */
+    bool readRetry(uint64_t start) const
+    {
+        // keeps the reads of the values from moving below the sequence check
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (start & 1) != 0 || sequence.load(std::memory_order_relaxed) != start;
+    }
+
+private:
+    SeqLock(const SeqLock&) = delete;
+    SeqLock& operator=(const SeqLock&) = delete;
+
+    std::atomic<uint64_t> sequence;
+};
+
+#endif
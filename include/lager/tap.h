@@ -1,12 +1,45 @@
 #ifndef TAP
 #define TAP
 
+#include <algorithm>
+#include <atomic>
 #include <future>
 #include <memory>
+#include <unordered_set>
 #include <vector>
 
 #include "chp_client.h"
-#include "data_format_parser.h"
+#include "data_format_writer.h"
+#include "lager/buffer_pool.h"
+#include "lager/lager_clock.h"
+#include "lager/lager_runtime.h"
+#include "lager/row_converter.h"
+#include "lager/row_ring_buffer.h"
+#include "lager/row_sampler.h"
+#include "lager/seq_lock.h"
+
+/**
+* @brief What Tap::log() does when the publisher has fallen a full queue behind
+*/
+enum class TapOverflowPolicy
+{
+    DROP_NEWEST, // discard the row being logged and count it as dropped
+    BLOCK // spin until the publisher frees a slot
+};
+
+/**
+* @brief One copy of the capture plan, either a run of columns that are contiguous both in user memory and in the
+* row, or a single column captured through its item
+*/
+struct CaptureRun
+{
+    const uint8_t* source; // nullptr to capture through item
+    AbstractDataRefItem* item;
+    size_t offset; // offset in bytes of the run from the start of the row
+    size_t size; // size in bytes of the run
+
+    CaptureRun(const uint8_t* s, AbstractDataRefItem* i, size_t o, size_t n): source(s), item(i), offset(o), size(n) {}
+};
 
 /**
 * @brief The data source object for the lager system
@@ -18,24 +51,89 @@ public:
     virtual ~Tap();
 
     bool init(const std::string& serverHost_in, int basePort, int timeOutMillis);
+    bool init(const std::shared_ptr<LagerRuntime>& runtime_in, const std::string& serverHost_in, int basePort,
+              int timeOutMillis);
     void addItem(AbstractDataRefItem* item);
-    std::vector<AbstractDataRefItem*> getItems() const;
+    void addItems(const std::vector<AbstractDataRefItem*>& items);
+    const std::vector<AbstractDataRefItem*>& getItems() const;
+    virtual std::vector<DataItem> getFormatItems() const;
     void start(const std::string& key_in);
     void stop();
     void log();
+    void log(uint64_t timestamp);
     uint8_t getFlag();
     void setFlag(uint8_t setFlag);
+    void setQueueDepth(size_t depth);
+    void setOverflowPolicy(TapOverflowPolicy policy);
+    void setPackedPayload(bool packed);
+    void setBusySpin(bool spin);
+    void setBatching(size_t maxRows, unsigned int lingerMicros);
+    void setDeltaEncoding(bool enabled, unsigned int keyframeInterval = TAP_DELTA_KEYFRAME_INTERVAL_DEFAULT);
+    void setNativeByteOrder(bool native);
+    void setBufferPoolSize(size_t count);
+    void setTransport(LagerTransport transport_in);
+    void setEmbedded(bool enabled);
+    void setMultiProducer(bool enabled);
+    void setSnapshotLock(const SeqLock* lock);
+    void setRealtime(bool enabled, unsigned int pollMicros = TAP_REALTIME_POLL_MICROS_DEFAULT);
+    void setClock(LagerClockSource source);
+    void setMaxRate(double rowsPerSecond);
+    void setMinInterval(unsigned int intervalMicros);
+    void setLogOnChange(bool enabled);
+    void setDeadband(const std::string& column, double absolute, double relative = 0);
+    uint64_t getDroppedCount() const {return droppedCount;}
+    uint64_t getFilteredCount() const {return filteredCount;}
+    uint64_t getTornCount() const {return tornCount;}
 
 protected:
     void publisherThread();
+    std::chrono::microseconds publishPending(zmq::socket_t& publisher);
+    void flushPending(zmq::socket_t& publisher);
+    std::chrono::microseconds deliverPending();
+    void publishRow(zmq::socket_t& publisher, const uint8_t* slot);
+    void publishHeader(zmq::socket_t& publisher, uint8_t wireFlags, const uint8_t* timestamp);
+    void appendToBatch(const uint8_t* slot);
+    size_t encodeDelta(const uint8_t* row, uint8_t* encoded);
+    void publishBatch(zmq::socket_t& publisher);
+    uint8_t* acquirePayload(uint8_t* fallback);
+    void sendPayload(zmq::socket_t& publisher, const uint8_t* payload, size_t size);
+    void releaseBatch();
+    void waitForRows(std::chrono::microseconds timeout);
+    void wakePublisher();
+    void insertItem(AbstractDataRefItem* item);
+    void buildCapturePlan();
+    void buildPayloadBuffers();
+    void captureSnapshot(uint8_t* row);
+    virtual void captureRow(uint8_t* row);
 
     std::shared_ptr<ClusteredHashmapClient> chpClient;
     std::shared_ptr<zmq::context_t> context;
+    std::shared_ptr<LagerRuntime> runtime; // set when sharing a runtime instead of running a publisher thread
     std::thread publisherThreadHandle;
     std::condition_variable cv;
     std::mutex mutex;
+    std::condition_variable wakeCv; // signalled by log() when the publisher is asleep
+    std::mutex wakeMutex;
+
+    std::vector<std::unique_ptr<AbstractDataRefItem>> ownedItems; // the tap owns every item added to it
+    std::vector<AbstractDataRefItem*> dataRefItems; // the same items in offset order, what getItems() hands out
+    std::unordered_set<std::string> itemNames; // for the duplicate check, so adding n items is O(n)
+    std::vector<CaptureRun> capturePlan; // built at start()
+    const SeqLock* snapshotLock; // guards the referenced values when set, owned by the user
+    LagerClock clock; // timestamps rows logged without one
+    std::vector<DataItem> formatItems; // row layout as registered with the bartender
+    std::vector<uint8_t> batchBuffer; // batch records go here instead when the buffer pool is empty
+    std::vector<uint8_t> deltaBuffer; // delta rows go here instead when the buffer pool is empty
+    std::vector<uint8_t> lastSentRow; // the row the next delta is computed against
+    std::unique_ptr<RowRingBuffer> ringBuffer; // <timestamp, row> slots waiting to be published
+    std::unique_ptr<RowConverter> rowConverter; // swap plan for the whole row, built at start()
+    std::unique_ptr<RowSampler> rowSampler; // only set when a sampling policy is configured, built at start()
+    std::map<std::string, Deadband> deadbands; // <column name, deadband>
+    std::vector<uint8_t> sampleRow; // change gated rows are captured here first and only queued if they changed
+    std::unique_ptr<BufferPool, BufferPool::Retirer> bufferPool; // payload buffers zmq sends without copying
 
-    std::vector<AbstractDataRefItem*> dataRefItems;
+    uint8_t* batchData; // <timestamp, length, row> records waiting to be sent as one message
+    size_t batchSize;
 
     std::string uuid;
     std::string key;
@@ -43,14 +141,42 @@ protected:
     std::string version;
     std::string serverHost;
 
-    uint64_t timestamp;
+    std::atomic<uint64_t> droppedCount;
+    std::atomic<uint64_t> filteredCount; // rows skipped by the sampling policy, not counted as dropped
+    std::atomic<uint64_t> tornCount; // rows logged after running out of snapshot retries
+    uint64_t minIntervalNanos;
     uint8_t flags;
 
     int publisherPort;
     off_t offsetCount;
+    size_t queueDepth;
+    size_t bufferPoolSize;
+    size_t batchMaxRows;
+    size_t batchRows;
+    unsigned int batchLingerMicros;
+    unsigned int runtimePublisherId;
+    std::chrono::steady_clock::time_point batchStart; // when the oldest row in the pending batch was added
+    std::chrono::microseconds idleWait; // longest the publisher sleeps with nothing queued, set at start()
+    unsigned int realtimePollMicros;
+    unsigned int deltaKeyframeInterval;
+    unsigned int rowsSinceKeyframe;
+    uint32_t deltaSequence; // of the next delta row, so a Mug can tell when it missed one
+    TapOverflowPolicy overflowPolicy;
+    LagerTransport transport;
+
+    bool packedPayload;
+    bool busySpin;
+    bool deltaEncoding;
+    bool nativeByteOrder;
+    bool littleEndianPayload; // rows go out unswapped, only set on little endian hosts
+    bool embedded; // rows go straight to the runtime's row sinks instead of through zmq
+    bool logOnChange;
+    bool multiProducer; // log() may be called from any number of threads at once
+    bool realtime; // log() never wakes the publisher, which polls instead
+    bool fixedLayout; // set by subclasses whose columns are fixed, no items may be added
 
-    bool newData;
-    bool running;
+    std::atomic<bool> running;
+    std::atomic<bool> publisherWaiting;
     bool publisherRunning;
 };
 
@@ -46,11 +46,13 @@ fmt_suffix_map = {
 #uuid is in Item so that it knows where it comes from when adding to the dict
 #key is so that it knows which key to add when seperating it in a hdf5 file
 class Item(object):
-    def __init__(self, name, offset, size, dtype, uuid, key):
+    def __init__(self, name, offset, size, dtype, uuid, key, count=1, endian='!'):
         self.name = name
         self.offset = int(offset)
         self.size = int(size)
         self.dtype = dtype
+        self.count = int(count)
+        self.endian = endian
         self.uuid = uuid
         self.key = key
 
@@ -105,6 +107,8 @@ with open(args['LAGER'], 'rb') as f:
         uuid = m.get('uuid')
         version = m.get('version')
         key = m.get('key')
+        #native order taps mark their format, everything else is network order
+        endian = '<' if m.get('byteorder') == 'little' else '!'
         form = Format(uuid, version, key)
         keys.append(form)
         for n in m:
@@ -112,7 +116,8 @@ with open(args['LAGER'], 'rb') as f:
             offset = n.get('offset')
             size = n.get('size')
             dtype = n.get('type')
-            i = Item(name, offset, size, dtype, uuid, key)
+            count = n.get('count', 1)
+            i = Item(name, offset, size, dtype, uuid, key, count, endian)
             items.append(i)
             column_size = column_size + i.size
 
@@ -139,13 +144,18 @@ with open(args['LAGER'], 'rb') as f:
         for i in items:
             if i.uuid.replace("-","") == uuid:
                 b = bytes(f.read(i.size))
-                val = struct.unpack('!'+type_map[i.dtype], b)[0]
+                vals = struct.unpack(i.endian+str(i.count)+type_map[i.dtype], b)
                 if len(i.name) < minwidth:
                     l = minwidth
                 else:
                     len(i.name)
 
-                d1 = '{val:<{LEN}{suffix}}'.format(val=val, LEN=l, suffix=fmt_suffix_map[i.dtype])
+                d1 = ['{val:<{LEN}{suffix}}'.format(val=val, LEN=l, suffix=fmt_suffix_map[i.dtype]) for val in vals]
+
+                #arrays become one row of count values per sample
+                if i.count == 1:
+                    d1 = d1[0]
+
                 hdf5[i.name + "|" + i.key].append(d1)
 
     #create hdf5 groups
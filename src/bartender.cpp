@@ -7,9 +7,10 @@ Bartender::Bartender()
 /**
  * @brief Starts the zmq context and initializes the underlying CHP and XPUB sockets
  * @param basePort is the base port used for all Lager communication
+ * @param transport is what Taps and Mugs reach the bartender over, tcp by default
  * @return true on success, false on failure
  */
-bool Bartender::init(int basePort)
+bool Bartender::init(int basePort, LagerTransport transport)
 {
     // make sure basePort is a valid port
     if (basePort < 0 || basePort > BASEPORT_MAX)
@@ -22,10 +23,10 @@ bool Bartender::init(int basePort)
     {
         context.reset(new zmq::context_t(1));
 
-        registrar.reset(new ClusteredHashmapServer(basePort));
+        registrar.reset(new ClusteredHashmapServer(basePort, transport));
         registrar->init(context);
 
-        forwarder.reset(new Forwarder(basePort));
+        forwarder.reset(new Forwarder(basePort, transport));
         forwarder->init(context);
     }
     catch (...)
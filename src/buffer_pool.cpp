@@ -0,0 +1,133 @@
+#include "lager/buffer_pool.h"
+
+#include <stdexcept>
+
+namespace
+{
+    const uint64_t INDEX_MASK = 0xffffffff;
+    const size_t BUFFER_ALIGNMENT = 64;
+}
+
+/**
+ * @brief Constructor, preallocates every buffer and puts them all on the free list
+ * @param bufferSize_in is the size in bytes of each buffer, rounded up so buffers don't share cache lines
+ * @param count_in is the number of buffers
+ * @throws runtime_error on a zero size or count, or a count that doesn't fit the free list
+ */
+BufferPool::BufferPool(size_t bufferSize_in, size_t count_in): count(count_in), head(0), refs(1)
+{
+    if (bufferSize_in == 0 || count_in == 0 || count_in >= INDEX_MASK)
+    {
+        throw std::runtime_error("BufferPool requires a non-zero buffer size and count");
+    }
+
+    bufferSize = (bufferSize_in + BUFFER_ALIGNMENT - 1) & ~(BUFFER_ALIGNMENT - 1);
+
+    storage.reset(new uint8_t[bufferSize * count]);
+    next.reset(new std::atomic<uint32_t>[count]);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        next[i].store(static_cast<uint32_t>(i + 1), std::memory_order_relaxed);
+    }
+
+    // index count marks the end of the list
+    head.store(0, std::memory_order_release);
+}
+
+/**
+ * @brief Takes a buffer off the free list
+ * @returns a buffer of at least getBufferSize() bytes, or nullptr when every buffer is in use
+ */
+uint8_t* BufferPool::acquire()
+{
+    uint64_t current = head.load(std::memory_order_acquire);
+    uint32_t index;
+
+    do
+    {
+        index = static_cast<uint32_t>(current & INDEX_MASK);
+
+        if (index == count)
+        {
+            return nullptr;
+        }
+
+        uint64_t replacement = (((current >> 32) + 1) << 32) | next[index].load(std::memory_order_relaxed);
+
+        if (head.compare_exchange_weak(current, replacement, std::memory_order_acquire, std::memory_order_acquire))
+        {
+            break;
+        }
+    }
+    while (true);
+
+    refs.fetch_add(1, std::memory_order_relaxed);
+
+    return storage.get() + index * bufferSize;
+}
+
+/**
+ * @brief Puts the buffer at the given index back on the free list
+ */
+void BufferPool::push(uint32_t index)
+{
+    uint64_t current = head.load(std::memory_order_relaxed);
+    uint64_t replacement;
+
+    do
+    {
+        next[index].store(static_cast<uint32_t>(current & INDEX_MASK), std::memory_order_relaxed);
+        replacement = (((current >> 32) + 1) << 32) | index;
+    }
+    while (!head.compare_exchange_weak(current, replacement, std::memory_order_release, std::memory_order_relaxed));
+}
+
+/**
+ * @brief Gives a buffer back to its pool, matches zmq_free_fn so it can be passed straight to zmq::message_t
+ * @param data is a buffer returned by acquire()
+ * @param hint is the pool the buffer came from
+ */
+void BufferPool::release(void* data, void* hint)
+{
+    BufferPool* pool = static_cast<BufferPool*>(hint);
+
+    pool->push(static_cast<uint32_t>((static_cast<uint8_t*>(data) - pool->storage.get()) / pool->bufferSize));
+
+    if (pool->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete pool;
+    }
+}
+
+/**
+ * @brief Drops the owner's hold on the pool, it is deleted now or once the last outstanding buffer is released
+ * The owner must not call acquire() afterwards.
+ */
+void BufferPool::retire()
+{
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete this;
+    }
+}
+
+/**
+ * @brief Checks whether a pointer is one of this pool's buffers
+ * @param data is the pointer to check
+ * @returns true if data points into the pool's storage
+ */
+bool BufferPool::owns(const void* data) const
+{
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    return p >= storage.get() && p < storage.get() + bufferSize * count;
+}
+
+/**
+ * @brief Gets the number of buffers acquired and not yet released
+ * @returns the number of buffers, exact only while no other thread is acquiring or releasing
+ */
+size_t BufferPool::getOutstanding() const
+{
+    return refs.load(std::memory_order_acquire) - 1;
+}
@@ -5,11 +5,13 @@
  * @param serverHost_in is a string containing the host or IP address of the Lager Bartender
  * @param basePort is an int base port Lager will use to calculate the other used ports
  * @param timeoutMillis_in is an int which sets the polling timeout of the various zmq sockets used
+ * @param transport_in is the transport used to reach the server
  */
-ClusteredHashmapClient::ClusteredHashmapClient(const std::string& serverHost_in, int basePort, int timeoutMillis_in):
-    initialized(false), running(false), snapshotRunning(false), subscriberRunning(false),
-    publisherRunning(false), timedOut(false), sequence(-1), uuid("invalid"),
-    serverHost(serverHost_in), timeoutMillis(timeoutMillis_in)
+ClusteredHashmapClient::ClusteredHashmapClient(const std::string& serverHost_in, int basePort, int timeoutMillis_in,
+                                               LagerTransport transport_in):
+    nextCallbackId(1), uuid("invalid"), serverHost(serverHost_in), timeoutMillis(timeoutMillis_in),
+    transport(transport_in), sequence(-1), initialized(false), running(false), timedOut(false),
+    snapshotRunning(false), subscriberRunning(false), publisherRunning(false)
 {
     snapshotPort = basePort + CHP_SNAPSHOT_OFFSET;
     subscriberPort = basePort + CHP_PUBLISHER_OFFSET;
@@ -68,11 +70,15 @@ void ClusteredHashmapClient::stop()
     running = false;
     mutex.unlock();
 
+    // when the context is shared (see LagerRuntime) it isn't shut down first, so the threads only notice at the end
+    // of their current poll
+    const unsigned int maxRetries = THREAD_CLOSE_WAIT_RETRIES + timeoutMillis / THREAD_CLOSE_WAIT_MILLIS;
+
     unsigned int retries = 0;
 
     while (subscriberRunning)
     {
-        if (retries > THREAD_CLOSE_WAIT_RETRIES)
+        if (retries > maxRetries)
         {
             throw std::runtime_error("ClusteredHashmapClient::subscriber thread failed to end");
         }
@@ -85,7 +91,7 @@ void ClusteredHashmapClient::stop()
 
     while (snapshotRunning)
     {
-        if (retries > THREAD_CLOSE_WAIT_RETRIES)
+        if (retries > maxRetries)
         {
             throw std::runtime_error("ClusteredHashmapClient::snapshot thread failed to end");
         }
@@ -98,7 +104,7 @@ void ClusteredHashmapClient::stop()
 
     while (publisherRunning)
     {
-        if (retries > THREAD_CLOSE_WAIT_RETRIES)
+        if (retries > maxRetries)
         {
             throw std::runtime_error("ClusteredHashmapClient::publisher thread failed to end");
         }
@@ -119,8 +125,21 @@ void ClusteredHashmapClient::addOrUpdateKeyValue(const std::string& key, const s
     // make sure we keep track of our own (key, value) changes.
     // we don't remove the key completely on delete because we want to
     // know if the removed item was in fact removed
+    addOrUpdateKeyValue(key, value, uuid);
+}
+
+/**
+ * @brief Adds or updates a key owned by a different uuid than the client's own, as when several Taps share one client
+ * @param key is a string containing the key of the key, value pair
+ * @param value is a string containing the value of the key, value pair
+ * @param keyUuid is the 16 byte uuid the key is published under
+ */
+void ClusteredHashmapClient::addOrUpdateKeyValue(const std::string& key, const std::string& value,
+                                                 const std::string& keyUuid)
+{
     mutex.lock();
     selfMap[key] = value;
+    selfUuids[key] = keyUuid;
     mutex.unlock();
 }
 
@@ -137,6 +156,25 @@ void ClusteredHashmapClient::removeKey(const std::string& key)
     // know if the removed item was in fact removed
     mutex.lock();
     selfMap[key] = "";
+
+    if (selfUuids.find(key) == selfUuids.end())
+    {
+        selfUuids[key] = uuid;
+    }
+
+    mutex.unlock();
+}
+
+/**
+ * @brief Stops keeping a key in sync with the server without removing it from the map, as Tap::stop() does
+ * when the client outlives the tap
+ * @param key is a string containing the key to stop tracking
+ */
+void ClusteredHashmapClient::untrackKey(const std::string& key)
+{
+    mutex.lock();
+    selfMap.erase(key);
+    selfUuids.erase(key);
     mutex.unlock();
 }
 
@@ -146,7 +184,47 @@ void ClusteredHashmapClient::removeKey(const std::string& key)
  */
 void ClusteredHashmapClient::setCallback(const std::function<void()>& func)
 {
-    hashMapUpdated = func;
+    std::lock_guard<std::mutex> lock(callbackMutex);
+    callbacks.clear();
+    callbacks[0] = func;
+}
+
+/**
+ * @brief Adds a callback alongside any others, for clients shared by several Mugs
+ * @param func is a function pointer passed in to be called when the hashmap is updated
+ * @returns the id to pass to removeCallback()
+ */
+unsigned int ClusteredHashmapClient::addCallback(const std::function<void()>& func)
+{
+    std::lock_guard<std::mutex> lock(callbackMutex);
+    callbacks[nextCallbackId] = func;
+    return nextCallbackId++;
+}
+
+/**
+ * @brief Removes a callback, once this returns it won't be called again
+ * @param id is the id returned by addCallback()
+ */
+void ClusteredHashmapClient::removeCallback(unsigned int id)
+{
+    std::lock_guard<std::mutex> lock(callbackMutex);
+    callbacks.erase(id);
+}
+
+/**
+ * @brief Calls every callback, if any, after the hashmap was updated
+ */
+void ClusteredHashmapClient::notifyUpdated()
+{
+    std::lock_guard<std::mutex> lock(callbackMutex);
+
+    for (auto i = callbacks.begin(); i != callbacks.end(); ++i)
+    {
+        if (i->second)
+        {
+            i->second();
+        }
+    }
 }
 
 /**
@@ -178,7 +256,9 @@ std::map<std::string, std::string> ClusteredHashmapClient::getUnsyncedHashmap()
             {
                 if (j->second == i->first)
                 {
-                    if (uuid == j->first)
+                    auto self = selfUuids.find(i->first);
+
+                    if (self != selfUuids.end() && self->second == j->first)
                     {
                         uuidsMatch = true;
                     }
@@ -241,7 +321,7 @@ void ClusteredHashmapClient::subscriberThread()
         // we want all messages from the server
         subscriber->setsockopt(ZMQ_SUBSCRIBE, "", 0);
 
-        subscriber->connect(lager_utils::getRemoteUri(serverHost.c_str(), subscriberPort).c_str());
+        subscriber->connect(lager_utils::getRemoteUri(serverHost.c_str(), subscriberPort, transport).c_str());
 
         std::string key("");
         std::string value("");
@@ -300,10 +380,7 @@ void ClusteredHashmapClient::subscriberThread()
                             uuidMap[uuid] = key;
 
                             // if the user set a callback, call it
-                            if (hashMapUpdated)
-                            {
-                                hashMapUpdated();
-                            }
+                            notifyUpdated();
                         }
                     }
                 }
@@ -419,7 +496,7 @@ void ClusteredHashmapClient::snapshotThread()
         snapshot.reset(new zmq::socket_t(*context.get(), ZMQ_DEALER));
         snapshot->setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
         snapshot->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
-        snapshot->connect(lager_utils::getRemoteUri(serverHost.c_str(), snapshotPort).c_str());
+        snapshot->connect(lager_utils::getRemoteUri(serverHost.c_str(), snapshotPort, transport).c_str());
 
         snapshotRunning = true;
         cv.notify_all();
@@ -530,10 +607,7 @@ void ClusteredHashmapClient::snapshotThread()
     if (updateMap.size() > 0)
     {
         // if we had updates and the user specified a callback, call it
-        if (hashMapUpdated)
-        {
-            hashMapUpdated();
-        }
+        notifyUpdated();
     }
 
     // This thread ends after one successful call, subsequent hashmap updates come
@@ -578,6 +652,7 @@ void ClusteredHashmapClient::publisherThread()
     double zero = 0;
 
     std::map<std::string, std::string> unsyncedHashmap;
+    std::map<std::string, std::string> unsyncedUuids;
 
     try
     {
@@ -599,7 +674,7 @@ void ClusteredHashmapClient::publisherThread()
         publisher.reset(new zmq::socket_t(*context.get(), ZMQ_PUB));
         publisher->setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
         publisher->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
-        publisher->connect(lager_utils::getRemoteUri(serverHost.c_str(), publisherPort).c_str());
+        publisher->connect(lager_utils::getRemoteUri(serverHost.c_str(), publisherPort, transport).c_str());
 
         publisherRunning = true;
         cv.notify_all();
@@ -607,19 +682,24 @@ void ClusteredHashmapClient::publisherThread()
         while (running)
         {
             // keep sending the updates until we get them back from the server
+            mutex.lock();
             unsyncedHashmap = getUnsyncedHashmap();
+            unsyncedUuids = selfUuids;
+            mutex.unlock();
 
             for (auto i = unsyncedHashmap.begin(); i != unsyncedHashmap.end(); ++i)
             {
                 zmq::message_t frame0(i->first.size());
                 zmq::message_t frame1(sizeof(double));
-                zmq::message_t frame2(uuid.size());
+                const std::string& keyUuid = unsyncedUuids[i->first];
+
+                zmq::message_t frame2(keyUuid.size());
                 zmq::message_t frame3(properties.size());
                 zmq::message_t frame4(i->second.size());
 
                 memcpy(frame0.data(), i->first.c_str(), i->first.size());
                 memcpy(frame1.data(), (void*)&zero, sizeof(double));
-                memcpy(frame2.data(), uuid.c_str(), uuid.size());
+                memcpy(frame2.data(), keyUuid.c_str(), keyUuid.size());
                 memcpy(frame3.data(), properties.c_str(), properties.size());
                 memcpy(frame4.data(), i->second.c_str(), i->second.size());
 
@@ -2,9 +2,12 @@
 
 /**
  * @brief Ctor sets up ports for the three sockets used
+ * @param basePort is the base port the three ports (or ipc/inproc endpoint names) are calculated from
+ * @param transport_in is the transport the sockets bind with
  */
-ClusteredHashmapServer::ClusteredHashmapServer(int basePort): initialized(false),
-    running(false), publisherRunning(false), snapshotRunning(false), collectorRunning(false), sequence(0)
+ClusteredHashmapServer::ClusteredHashmapServer(int basePort, LagerTransport transport_in): transport(transport_in),
+    sequence(0), publisherRunning(false), snapshotRunning(false), collectorRunning(false), running(false),
+    initialized(false)
 {
     snapshotPort = basePort + CHP_SNAPSHOT_OFFSET;
     publisherPort = basePort + CHP_PUBLISHER_OFFSET;
@@ -147,7 +150,7 @@ void ClusteredHashmapServer::snapshotThread()
 
         snapshot.reset(new zmq::socket_t(*context.get(), ZMQ_ROUTER));
         snapshot->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
-        snapshot->bind(lager_utils::getLocalUri(snapshotPort).c_str());
+        snapshot->bind(lager_utils::getLocalUri(snapshotPort, transport).c_str());
 
         // Sets up a poller for the snapshot socket
         zmq::pollitem_t items[] = {{static_cast<void*>(*snapshot.get()), 0, ZMQ_POLLIN, 0}};
@@ -424,7 +427,7 @@ void ClusteredHashmapServer::publisherThread()
         publisher.reset(new zmq::socket_t(*context.get(), ZMQ_PUB));
         publisher->setsockopt(ZMQ_RCVHWM, &hwm, sizeof(hwm));
         publisher->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
-        publisher->bind(lager_utils::getLocalUri(publisherPort).c_str());
+        publisher->bind(lager_utils::getLocalUri(publisherPort, transport).c_str());
 
         while (running)
         {
@@ -555,7 +558,7 @@ void ClusteredHashmapServer::collectorThread()
         collector.reset(new zmq::socket_t(*context.get(), ZMQ_SUB));
         collector->setsockopt(ZMQ_RCVHWM, &hwm, sizeof(hwm));
         collector->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
-        collector->bind(lager_utils::getLocalUri(collectorPort).c_str());
+        collector->bind(lager_utils::getLocalUri(collectorPort, transport).c_str());
 
         // We want all messages on the socket
         collector->setsockopt(ZMQ_SUBSCRIBE, "", 0);
@@ -1,5 +1,7 @@
 #include "lager/data_format_parser.h"
 
+#include "lager/data_format_writer.h"
+
 /**
  * @brief Generates xml error string and stores in member lastError
  * @param ex is a SAXParseException to process (Xerces re-uses the SAX in the DOM parsing)
@@ -75,6 +77,8 @@ DataFormatParser::DataFormatParser(const std::string& xsdFile_in)
     attType = XMLString::transcode("type");
     attSize = XMLString::transcode("size");
     attOffset = XMLString::transcode("offset");
+    attCount = XMLString::transcode("count");
+    attByteOrder = XMLString::transcode("byteorder");
     attUuid = XMLString::transcode("uuid");
     attKey = XMLString::transcode("key");
     attValue = XMLString::transcode("value");
@@ -101,6 +105,8 @@ DataFormatParser::~DataFormatParser()
     XMLString::release(&attType);
     XMLString::release(&attSize);
     XMLString::release(&attOffset);
+    XMLString::release(&attCount);
+    XMLString::release(&attByteOrder);
     XMLString::release(&tagFormats);
     XMLString::release(&tagMeta);
     XMLString::release(&tagMetaData);
@@ -202,6 +208,11 @@ void DataFormatParser::parse()
 
         format.reset(new DataFormat(version, key));
 
+        // byte order is optional, network order unless the tap says otherwise
+        char* cByteOrder = XMLString::transcode(formatElement->getAttribute(attByteOrder));
+        format->setLittleEndian(std::string(cByteOrder) == "little");
+        XMLString::release(&cByteOrder);
+
         DOMNodeList* children = formatElement->getChildNodes();
 
         // iterate the child nodes, looking for item elements
@@ -220,10 +231,12 @@ void DataFormatParser::parse()
                     const XMLCh* xType = nodeElement->getAttribute(attType);
                     const XMLCh* xSize = nodeElement->getAttribute(attSize);
                     const XMLCh* xOffset = nodeElement->getAttribute(attOffset);
+                    const XMLCh* xCount = nodeElement->getAttribute(attCount);
 
                     // convert the numeric values to the needed types
                     size_t size;
                     off_t offset;
+                    size_t count = 1;
 
                     char* cSize = XMLString::transcode(xSize);
                     std::istringstream issSize(cSize);
@@ -233,11 +246,20 @@ void DataFormatParser::parse()
                     std::istringstream issOffset(cOffset);
                     issOffset >> offset;
 
+                    // count is optional and only present on array items
+                    if (XMLString::stringLen(xCount) > 0)
+                    {
+                        char* cCount = XMLString::transcode(xCount);
+                        std::istringstream issCount(cCount);
+                        issCount >> count;
+                        XMLString::release(&cCount);
+                    }
+
                     char* cName = XMLString::transcode(xName);
                     char* cType = XMLString::transcode(xType);
 
                     // add the item to the format
-                    format->addItem(DataItem(std::string(cName), std::string(cType), size, offset));
+                    format->addItem(DataItem(std::string(cName), std::string(cType), size, offset, count));
 
                     // release resources
                     XMLString::release(&cName);
@@ -266,81 +288,38 @@ void DataFormatParser::parse()
  */
 bool DataFormatParser::createFromDataRefItems(const std::vector<AbstractDataRefItem*>& items, const std::string& version, const std::string& key)
 {
-    // temporary xml strings to use during generation
-    XMLCh* xVersion = nullptr;
-    XMLCh* xKey = nullptr;
-    XMLCh* xName = nullptr;
-    XMLCh* xType = nullptr;
-    XMLCh* xSize = nullptr;
-    XMLCh* xOffset = nullptr;
-    XMLCh* xFormat = nullptr;
-
-    // grab available dom implementation (nullptr = no options)
-    DOMImplementation* impl = DOMImplementationRegistry::getDOMImplementation(nullptr);
+    std::vector<DataItem> dataItems;
+    dataItems.reserve(items.size());
 
-    if (!impl)
+    for (auto i = items.begin(); i != items.end(); ++i)
     {
-        return false;
+        dataItems.push_back(DataItem((*i)->getName(), (*i)->getType(), (*i)->getSize(), (*i)->getOffset(),
+                                    (*i)->getCount()));
     }
 
-    // root element is format
-    xFormat = XMLString::transcode("format");
-    xercesc::DOMDocument* doc = impl->createDocument(nullptr, xFormat, nullptr);
-    DOMElement* root = doc->getDocumentElement();
-
-    // add the version
-    xVersion = XMLString::transcode(version.c_str());
-    root->setAttribute(attVersion, xVersion);
-
-    // add the key
-    xKey = XMLString::transcode(key.c_str());
-    root->setAttribute(attKey, xKey);
-
-    std::stringstream ss;
+    return createFromDataItems(dataItems, version, key);
+}
 
-    for (auto i = items.begin(); i != items.end(); ++i)
+/**
+ * @brief Converts a given array of DataItems and generates and stores its xml string into the xmlStr member, then
+ * checks it against the schema.  See DataFormatWriter for generating it without Xerces.
+ * @param items is a vector of DataItem describing each column
+ * @param version is a string containing the version of the data format used
+ * @param key is a string containing the key from where the tap came from
+ * @param littleEndian is true when the rows are sent in little endian order instead of network order
+ * @returns true on successful generation, false on failure
+ */
+bool DataFormatParser::createFromDataItems(const std::vector<DataItem>& items, const std::string& version, const std::string& key,
+        bool littleEndian)
+{
+    try
     {
-        // grab the numeric values and put them into xml strings
-        size_t size = (*i)->getSize();
-        off_t offset = (*i)->getOffset();
-
-        ss.str(std::string());
-        ss << size;
-        xSize = XMLString::transcode(ss.str().c_str());
-
-        ss.str(std::string());
-        ss << offset;
-        xOffset = XMLString::transcode(ss.str().c_str());
-
-        // grab the remaining info
-        xName = XMLString::transcode((*i)->getName().c_str());
-        xType = XMLString::transcode((*i)->getType().c_str());
-
-        // create the new element and attributes
-        DOMElement* item = doc->createElement(tagItem);
-        item->setAttribute(attName, xName);
-        item->setAttribute(attType, xType);
-        item->setAttribute(attSize, xSize);
-        item->setAttribute(attOffset, xOffset);
-
-        root->appendChild(item);
-
-        // release resources
-        XMLString::release(&xType);
-        XMLString::release(&xSize);
-        XMLString::release(&xName);
-        XMLString::release(&xOffset);
+        xmlStr = DataFormatWriter::fromDataItems(items, version, key, littleEndian);
+    }
+    catch (const std::runtime_error&)
+    {
+        return false;
     }
-
-    // set the member string
-    xmlStr = getStringFromDoc(doc);
-
-    // release resources
-    XMLString::release(&xFormat);
-    XMLString::release(&xVersion);
-    XMLString::release(&xKey);
-
-    doc->release();
 
     // check validity against the schema
     if (!isValid(xmlStr, items.size()))
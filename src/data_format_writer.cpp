@@ -0,0 +1,176 @@
+#include "lager/data_format_writer.h"
+
+#include <stdexcept>
+
+namespace
+{
+    const char XML_DECLARATION[] = "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"no\" ?>";
+
+    // rough size of one item element with short names, only used to reserve the string up front
+    const size_t ITEM_SIZE_ESTIMATE = 80;
+}
+
+/**
+ * @brief Builds the xml format of a row layout
+ * @param items is a vector of DataItem describing each column
+ * @param version is a string containing the version of the data format used
+ * @param key is a string containing the key from where the tap came from
+ * @param littleEndian is true when the rows are sent in little endian order instead of network order
+ * @returns the xml string
+ * @throws runtime_error if a name, type, version or key contains characters xml can't represent
+ */
+std::string DataFormatWriter::fromDataItems(const std::vector<DataItem>& items, const std::string& version,
+                                            const std::string& key, bool littleEndian)
+{
+    std::string xml;
+    xml.reserve(sizeof(XML_DECLARATION) + key.size() + 64 + items.size() * ITEM_SIZE_ESTIMATE);
+
+    xml += XML_DECLARATION;
+    xml += "<format";
+    appendAttribute(xml, "version", version);
+    appendAttribute(xml, "key", key);
+
+    // network order formats leave the byte order off so they are unchanged
+    if (littleEndian)
+    {
+        appendAttribute(xml, "byteorder", std::string("little"));
+    }
+
+    xml += '>';
+
+    for (auto i = items.begin(); i != items.end(); ++i)
+    {
+        xml += "<item";
+        appendAttribute(xml, "name", i->name);
+        appendAttribute(xml, "type", i->type);
+        appendAttribute(xml, "size", i->size);
+        appendAttribute(xml, "offset", static_cast<size_t>(i->offset));
+
+        // scalars leave the count off so their formats are unchanged
+        if (i->count > 1)
+        {
+            appendAttribute(xml, "count", i->count);
+        }
+
+        xml += "/>";
+    }
+
+    xml += "</format>";
+
+    return xml;
+}
+
+/**
+ * @brief Builds the xml format of a list of data ref items
+ * @param items is a vector of AbstractDataRefItem with their offsets set
+ * @param version is a string containing the version of the data format used
+ * @param key is a string containing the key from where the tap came from
+ * @param littleEndian is true when the rows are sent in little endian order instead of network order
+ * @returns the xml string
+ * @throws runtime_error if a name, type, version or key contains characters xml can't represent
+ */
+std::string DataFormatWriter::fromDataRefItems(const std::vector<AbstractDataRefItem*>& items,
+                                               const std::string& version, const std::string& key, bool littleEndian)
+{
+    std::vector<DataItem> dataItems;
+    dataItems.reserve(items.size());
+
+    for (auto i = items.begin(); i != items.end(); ++i)
+    {
+        dataItems.push_back(DataItem((*i)->getName(), (*i)->getType(), (*i)->getSize(), (*i)->getOffset(),
+                                     (*i)->getCount()));
+    }
+
+    return fromDataItems(dataItems, version, key, littleEndian);
+}
+
+/**
+ * @brief Appends name="value" with the value escaped for a double quoted attribute.  Tabs and line breaks are
+ * written as character references so attribute value normalization doesn't turn them into spaces.
+ * @param xml is the string to append to
+ * @param name is the attribute name
+ * @param value is the attribute value, UTF-8
+ * @throws runtime_error on a control character xml 1.0 doesn't allow
+ */
+void DataFormatWriter::appendAttribute(std::string& xml, const char* name, const std::string& value)
+{
+    xml += ' ';
+    xml += name;
+    xml += "=\"";
+
+    for (auto i = value.begin(); i != value.end(); ++i)
+    {
+        switch (*i)
+        {
+            case '&':
+                xml += "&amp;";
+                break;
+
+            case '<':
+                xml += "&lt;";
+                break;
+
+            case '>':
+                xml += "&gt;";
+                break;
+
+            case '"':
+                xml += "&quot;";
+                break;
+
+            case '\'':
+                xml += "&apos;";
+                break;
+
+            case '\t':
+                xml += "&#9;";
+                break;
+
+            case '\n':
+                xml += "&#10;";
+                break;
+
+            case '\r':
+                xml += "&#13;";
+                break;
+
+            default:
+                if (static_cast<unsigned char>(*i) < 0x20)
+                {
+                    throw std::runtime_error("data format attribute " + std::string(name) +
+                                             " contains a control character");
+                }
+
+                xml += *i;
+                break;
+        }
+    }
+
+    xml += '"';
+}
+
+/**
+ * @brief Appends name="value" for an unsigned number
+ * @param xml is the string to append to
+ * @param name is the attribute name
+ * @param value is the number
+ */
+void DataFormatWriter::appendAttribute(std::string& xml, const char* name, size_t value)
+{
+    char digits[24];
+    char* end = digits + sizeof(digits);
+    char* p = end;
+
+    do
+    {
+        *--p = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    while (value > 0);
+
+    xml += ' ';
+    xml += name;
+    xml += "=\"";
+    xml.append(p, end - p);
+    xml += '"';
+}
@@ -3,8 +3,9 @@
 /**
  * @brief Constructor for forwarder
  * @param basePort is the base port which Lager uses to calculate all used ports in the system
+ * @param transport_in is the transport the frontend and backend bind with
  */
-Forwarder::Forwarder(int basePort): running(false)
+Forwarder::Forwarder(int basePort, LagerTransport transport_in): transport(transport_in), running(false)
 {
     frontendPort = basePort + FORWARDER_FRONTEND_OFFSET;
     backendPort = basePort + FORWARDER_BACKEND_OFFSET;
@@ -49,13 +50,13 @@ void Forwarder::stop()
 void Forwarder::forwarderThread()
 {
     frontend.reset(new zmq::socket_t(*context.get(), ZMQ_SUB));
-    frontend->bind(lager_utils::getLocalUri(frontendPort).c_str());
+    frontend->bind(lager_utils::getLocalUri(frontendPort, transport).c_str());
 
     // Make sure the frontend subscribes to everything
     frontend->setsockopt(ZMQ_SUBSCRIBE, "", 0);
 
     backend.reset(new zmq::socket_t(*context.get(), ZMQ_PUB));
-    backend->bind(lager_utils::getLocalUri(backendPort).c_str());
+    backend->bind(lager_utils::getLocalUri(backendPort, transport).c_str());
 
     // C call which sets up the forwarder and blocks until the zmq context is closed
     zmq_device(ZMQ_FORWARDER, (void*)*frontend.get(), (void*)*backend.get());
@@ -103,11 +103,21 @@ void Keg::stop()
  * @param size is the size of the given array
  */
 void Keg::write(const std::vector<uint8_t>& data, size_t size)
+{
+    write(data.data(), size);
+}
+
+/**
+ * @brief Writes bytes to the file, a row may be written in several pieces
+ * @param data points to the bytes to write
+ * @param size is the number of bytes
+ */
+void Keg::write(const uint8_t* data, size_t size)
 {
     // TODO check for file open
     if (running)
     {
-        logFile.write((char*)&data[0], size);
+        logFile.write(reinterpret_cast<const char*>(data), size);
     }
 }
 
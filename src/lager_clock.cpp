@@ -0,0 +1,112 @@
+#include "lager/lager_clock.h"
+
+#include <stdexcept>
+#include <thread>
+
+#ifdef LAGER_CLOCK_TSC
+#include <cpuid.h>
+#endif
+
+namespace
+{
+    /**
+    * @brief Maps TSC ticks to wall clock nanoseconds, measured once per process
+    */
+    struct TscCalibration
+    {
+        uint64_t base; // tick count at the anchor
+        uint64_t baseNanos; // wall clock nanoseconds at the anchor
+        uint64_t mult; // nanoseconds per tick in 32.32 fixed point
+    };
+
+#ifdef LAGER_CLOCK_TSC
+    const unsigned int TSC_CALIBRATION_MILLIS = 20;
+
+    /**
+    * @brief Reads a clock_gettime() clock in nanoseconds
+    */
+    uint64_t readClock(clockid_t id)
+    {
+        timespec ts;
+        clock_gettime(id, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+    }
+
+    /**
+    * @brief Counts ticks over a known stretch of CLOCK_MONOTONIC_RAW, then anchors the counter to the wall clock
+    */
+    TscCalibration calibrate()
+    {
+        uint64_t startNanos = readClock(CLOCK_MONOTONIC_RAW);
+        uint64_t startTicks = __rdtsc();
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(TSC_CALIBRATION_MILLIS));
+
+        uint64_t endNanos = readClock(CLOCK_MONOTONIC_RAW);
+        uint64_t endTicks = __rdtsc();
+
+        TscCalibration c;
+        c.mult = static_cast<uint64_t>((static_cast<unsigned __int128>(endNanos - startNanos) << 32) /
+                                       (endTicks - startTicks));
+        c.base = __rdtsc();
+        c.baseNanos = readClock(CLOCK_REALTIME);
+
+        return c;
+    }
+
+    /**
+    * @brief Gets the calibration, measured on first use
+    */
+    const TscCalibration& getCalibration()
+    {
+        static const TscCalibration calibration = calibrate();
+        return calibration;
+    }
+#endif
+}
+
+/**
+ * @brief Constructor, the first TSC clock in a process takes a few milliseconds to calibrate
+ * @param source_in is the clock to read
+ * @throws runtime_error if the source isn't supported on this machine
+ */
+LagerClock::LagerClock(LagerClockSource source_in): source(source_in), tscBase(0), tscBaseNanos(0), tscMult(0)
+{
+    if (!isSupported(source))
+    {
+        throw std::runtime_error("LagerClock source not supported on this machine");
+    }
+
+#ifdef LAGER_CLOCK_TSC
+    if (source == LagerClockSource::TSC)
+    {
+        const TscCalibration& c = getCalibration();
+        tscBase = c.base;
+        tscBaseNanos = c.baseNanos;
+        tscMult = c.mult;
+    }
+#endif
+}
+
+/**
+ * @brief Checks whether a clock source can be used here.  TSC needs an x86-64 CPU whose counter runs at a
+ * constant rate in every power state (invariant TSC), the others are always available.
+ * @param source is the source to check
+ * @returns true if a LagerClock can be created with it
+ */
+bool LagerClock::isSupported(LagerClockSource source)
+{
+    if (source != LagerClockSource::TSC)
+    {
+        return true;
+    }
+
+#ifdef LAGER_CLOCK_TSC
+    unsigned int eax, ebx, ecx, edx;
+
+    // CPUID.80000007H:EDX[8] is the invariant TSC flag
+    return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1 << 8)) != 0;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,432 @@
+#include "lager/lager_runtime.h"
+
+/**
+ * @brief Constructor, creates the shared zmq context.  The reactor thread starts with the first publisher.
+ */
+LagerRuntime::LagerRuntime(): context(new zmq::context_t(1)), nextPublisherId(1), nextRowSinkId(1),
+    reactorWaiting(false), wakePending(false), running(false), reactorStarted(false)
+{
+}
+
+/**
+ * @brief Constructor, shares an existing zmq context instead.  LagerTransport::INPROC only works between sockets of
+ * the same context, so in-process Taps and Mugs use a runtime built from Bartender::getContext().  Stopping the
+ * bartender then shuts down the runtime's sockets too, so it should be stopped last.
+ * @param context_in is the context to share
+ */
+LagerRuntime::LagerRuntime(std::shared_ptr<zmq::context_t> context_in): context(context_in), nextPublisherId(1),
+    nextRowSinkId(1), reactorWaiting(false), wakePending(false), running(false), reactorStarted(false)
+{
+}
+
+/**
+ * @brief Stops the reactor thread.  Every Tap, Mug and CHP client using the runtime holds a reference to it, so
+ * by now they are all gone.
+ */
+LagerRuntime::~LagerRuntime()
+{
+    running = false;
+    wake();
+
+    if (reactorThreadHandle.joinable())
+    {
+        reactorThreadHandle.join();
+    }
+}
+
+/**
+ * @brief Gets the process-wide runtime, created on first use and destroyed once nothing uses it
+ * @returns a shared_ptr to the runtime
+ */
+std::shared_ptr<LagerRuntime> LagerRuntime::getDefault()
+{
+    static std::mutex defaultMutex;
+    static std::weak_ptr<LagerRuntime> defaultRuntime;
+
+    std::lock_guard<std::mutex> lock(defaultMutex);
+
+    std::shared_ptr<LagerRuntime> runtime = defaultRuntime.lock();
+
+    if (!runtime)
+    {
+        runtime.reset(new LagerRuntime);
+        defaultRuntime = runtime;
+    }
+
+    return runtime;
+}
+
+/**
+ * @brief Gets the started CHP client for the given bartender, shared by every user of the runtime
+ * The client is stopped once its last user lets go of it.  The timeout of whichever user created it applies.
+ * @param serverHost is a string containing the IP address or hostname of the bartender
+ * @param basePort is the base port of the bartender
+ * @param timeoutMillis is the timeout to the bartender
+ * @param transport is the transport used to reach the bartender
+ * @returns a shared_ptr to the client
+ */
+std::shared_ptr<ClusteredHashmapClient> LagerRuntime::getChpClient(const std::string& serverHost, int basePort,
+                                                                   int timeoutMillis, LagerTransport transport)
+{
+    std::string serverUri = lager_utils::getRemoteUri(serverHost, basePort, transport);
+
+    std::lock_guard<std::mutex> lock(chpMutex);
+
+    std::shared_ptr<ClusteredHashmapClient> client = chpClients[serverUri].lock();
+
+    if (!client)
+    {
+        client.reset(new ClusteredHashmapClient(serverHost, basePort, timeoutMillis, transport),
+                     [](ClusteredHashmapClient * c)
+        {
+            try
+            {
+                c->stop();
+            }
+            catch (const std::exception& e)
+            {
+                std::clog << "LagerRuntime: " << e.what() << std::endl;
+            }
+
+            delete c;
+        });
+
+        client->init(context, lager_utils::getUuid());
+        client->start();
+
+        chpClients[serverUri] = client;
+    }
+
+    return client;
+}
+
+/**
+ * @brief Registers a publisher to be called from the reactor thread, starting the thread if needed
+ * @param uri is the zmq endpoint to publish to, publishers with the same endpoint share one socket
+ * @param publish is called with the socket whenever the reactor makes a pass
+ * @param pending tells the reactor whether it is safe to sleep
+ * @returns the id to pass to removePublisher()
+ */
+unsigned int LagerRuntime::addPublisher(const std::string& uri, const PublishFunction& publish,
+                                        const PendingFunction& pending)
+{
+    Publisher p;
+    p.uri = uri;
+    p.publish = publish;
+    p.pending = pending;
+    p.socket = nullptr;
+
+    return add(p);
+}
+
+/**
+ * @brief Registers a publisher that hands its rows to deliverRow() instead of sending them through zmq
+ * @param deliver is called whenever the reactor makes a pass
+ * @param pending tells the reactor whether it is safe to sleep
+ * @returns the id to pass to removePublisher()
+ */
+unsigned int LagerRuntime::addEmbeddedPublisher(const DeliverFunction& deliver, const PendingFunction& pending)
+{
+    Publisher p;
+    p.deliver = deliver;
+    p.pending = pending;
+    p.socket = nullptr;
+
+    return add(p);
+}
+
+/**
+ * @brief Adds a publisher to the reactor's list, starting the reactor thread if needed
+ * @param p is the publisher to add
+ * @returns its id
+ */
+unsigned int LagerRuntime::add(const Publisher& p)
+{
+    unsigned int id;
+
+    {
+        std::lock_guard<std::mutex> lock(publishersMutex);
+
+        id = nextPublisherId++;
+        publishers[id] = p;
+
+        if (!reactorStarted)
+        {
+            // a reactor that ended on its own, when its context was terminated, has nothing left to do but exit
+            if (reactorThreadHandle.joinable())
+            {
+                reactorThreadHandle.join();
+            }
+
+            running = true;
+            reactorStarted = true;
+            reactorThreadHandle = std::thread(&LagerRuntime::reactorThread, this);
+        }
+    }
+
+    wake();
+
+    return id;
+}
+
+/**
+ * @brief Unregisters a publisher, once this returns the reactor won't call it again.  The publisher is called one
+ * last time from this thread, until it has nothing pending, so a stopped Tap's queued rows still go out.
+ * @param id is the id returned by addPublisher() or addEmbeddedPublisher()
+ */
+void LagerRuntime::removePublisher(unsigned int id)
+{
+    // waits out the reactor's pass over the embedded publishers
+    std::lock_guard<std::mutex> deliverLock(deliverMutex);
+
+    DeliverFunction deliver;
+
+    {
+        std::lock_guard<std::mutex> lock(publishersMutex);
+
+        auto found = publishers.find(id);
+
+        if (found == publishers.end())
+        {
+            return;
+        }
+
+        Publisher& p = found->second;
+
+        if (p.deliver)
+        {
+            // the last rows go to the sinks below, without holding up the reactor's zmq publishers
+            deliver.swap(p.deliver);
+        }
+        else if (p.socket)
+        {
+            try
+            {
+                // the reactor only uses its sockets while holding the mutex, so this thread may borrow it.  A
+                // publisher the reactor hasn't made a pass over yet, or whose reactor has exited, has no socket.
+                while (p.publish(*p.socket).count() == 0)
+                {
+                }
+            }
+            catch (const zmq::error_t& e)
+            {
+                // the publisher is removed either way, so the reactor never calls into it again
+                if (e.num() != ETERM)
+                {
+                    std::clog << "LagerRuntime: " << e.what() << std::endl;
+                }
+            }
+        }
+
+        publishers.erase(found);
+    }
+
+    if (deliver)
+    {
+        while (deliver().count() == 0)
+        {
+        }
+    }
+}
+
+/**
+ * @brief Gets the number of registered publishers
+ * @returns the number of publishers
+ */
+size_t LagerRuntime::getPublisherCount()
+{
+    std::lock_guard<std::mutex> lock(publishersMutex);
+    return publishers.size();
+}
+
+/**
+ * @brief Registers a sink for the rows of embedded publishers, every sink gets every row
+ * @param sink is called from the reactor thread once per row
+ * @returns the id to pass to removeRowSink()
+ */
+unsigned int LagerRuntime::addRowSink(const RowSinkFunction& sink)
+{
+    std::lock_guard<std::mutex> lock(deliverMutex);
+    rowSinks[nextRowSinkId] = sink;
+    return nextRowSinkId++;
+}
+
+/**
+ * @brief Unregisters a row sink, once this returns it won't be called again
+ * @param id is the id returned by addRowSink()
+ */
+void LagerRuntime::removeRowSink(unsigned int id)
+{
+    std::lock_guard<std::mutex> lock(deliverMutex);
+    rowSinks.erase(id);
+}
+
+/**
+ * @brief Passes one row to every row sink, rows are dropped when there are none.  Only called by embedded
+ * publishers, from the reactor thread or removePublisher() with deliverMutex held.
+ * @param uuid is the 16 byte uuid of the tap the row is from
+ * @param row points to the network order timestamp followed by the row
+ * @param size is the size in bytes of the timestamp and row
+ */
+void LagerRuntime::deliverRow(const std::string& uuid, const uint8_t* row, size_t size)
+{
+    for (auto i = rowSinks.begin(); i != rowSinks.end(); ++i)
+    {
+        i->second(uuid, row, size);
+    }
+}
+
+/**
+ * @brief Wakes the reactor thread if it is sleeping, or keeps it from going to sleep if it's about to
+ */
+void LagerRuntime::wake()
+{
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    wakePending = true;
+    wakeCv.notify_one();
+}
+
+/**
+ * @brief Checks every publisher for pending work
+ * @returns true if any publisher has work waiting
+ */
+bool LagerRuntime::anyPending()
+{
+    std::lock_guard<std::mutex> lock(publishersMutex);
+
+    for (auto i = publishers.begin(); i != publishers.end(); ++i)
+    {
+        if (i->second.pending())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Main reactor thread, makes passes over every publisher and sleeps when none of them has work
+ */
+void LagerRuntime::reactorThread()
+{
+    // setting linger so the sockets don't hang around after being stopped
+    int linger = 0;
+
+    const std::chrono::microseconds idleWait = std::chrono::milliseconds(TAP_IDLE_WAKE_MILLIS);
+
+    std::map<std::string, std::unique_ptr<zmq::socket_t>> sockets; // <uri, socket>, only used by this thread
+
+    try
+    {
+        while (running)
+        {
+            std::chrono::microseconds wait = idleWait;
+
+            {
+                std::lock_guard<std::mutex> lock(publishersMutex);
+
+                for (auto i = publishers.begin(); i != publishers.end(); ++i)
+                {
+                    if (i->second.deliver)
+                    {
+                        continue;
+                    }
+
+                    if (!i->second.socket)
+                    {
+                        std::unique_ptr<zmq::socket_t>& socket = sockets[i->second.uri];
+
+                        if (!socket)
+                        {
+                            socket.reset(new zmq::socket_t(*context.get(), ZMQ_PUB));
+                            socket->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+                            socket->connect(i->second.uri.c_str());
+                        }
+
+                        i->second.socket = socket.get();
+                    }
+
+                    wait = std::min(wait, i->second.publish(*i->second.socket));
+                }
+            }
+
+            {
+                // embedded publishers run the row sinks (e.g. keg writes) without publishersMutex held.  Their
+                // entries stay put until this lock is released, since removePublisher() takes it before erasing.
+                std::lock_guard<std::mutex> deliverLock(deliverMutex);
+
+                embeddedPass.clear();
+
+                {
+                    std::lock_guard<std::mutex> lock(publishersMutex);
+
+                    for (auto i = publishers.begin(); i != publishers.end(); ++i)
+                    {
+                        if (i->second.deliver)
+                        {
+                            embeddedPass.push_back(&i->second.deliver);
+                        }
+                    }
+                }
+
+                for (auto i = embeddedPass.begin(); i != embeddedPass.end(); ++i)
+                {
+                    wait = std::min(wait, (**i)());
+                }
+            }
+
+            if (wait.count() == 0)
+            {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(wakeMutex);
+
+            reactorWaiting.store(true, std::memory_order_relaxed);
+
+            // pairs with the fence producers make before checking isWaiting(), so either this sees their work or
+            // they see the reactor waiting and call wake()
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+
+            if (!wakePending && running && !anyPending())
+            {
+                wakeCv.wait_for(lock, wait, [this]()
+                {
+                    return wakePending;
+                });
+            }
+
+            wakePending = false;
+            reactorWaiting.store(false, std::memory_order_relaxed);
+        }
+    }
+    catch (const zmq::error_t& e)
+    {
+        if (e.num() != ETERM)
+        {
+            std::stringstream ss;
+            ss << "LagerRuntime::reactorThread() uncaught zmq exception: " << e.what();
+            throw std::runtime_error(ss.str());
+        }
+    }
+
+    {
+        // the context was terminated or the runtime is going away, either way nothing may use the sockets closed
+        // below, and the next add() starts a new reactor instead of counting on this one
+        std::lock_guard<std::mutex> lock(publishersMutex);
+
+        for (auto i = publishers.begin(); i != publishers.end(); ++i)
+        {
+            i->second.socket = nullptr;
+        }
+
+        running = false;
+        reactorStarted = false;
+    }
+
+    for (auto i = sockets.begin(); i != sockets.end(); ++i)
+    {
+        i->second->close();
+    }
+}
@@ -7,12 +7,33 @@
 /**
 * @brief Constructor, sets an invalid port to ensure the user initializes properly
 */
-Mug::Mug(): running(false), subscriberPort(-1), subscriberRunning(false)
+Mug::Mug(): filtersChanged(false), subscriberPort(-1), chpCallbackId(0), rowSinkId(0), pipelineThreads(0),
+    pipelineDepth(MUG_PIPELINE_QUEUE_DEPTH_DEFAULT), droppedCount(0), decodeStopping(false), writeStopping(false),
+    writerWaiting(false), transport(LagerTransport::TCP), embedded(false), running(false), subscriberRunning(false),
+    pipelined(false)
 {
+    workers.push_back(std::unique_ptr<MugWorker>(new MugWorker()));
+    messagePool.push_back(std::unique_ptr<MugMessage>(new MugMessage()));
 }
 
 Mug::~Mug()
 {
+    // a shared client outlives the mug, so it must not call back into it
+    if (runtime && chpCallbackId != 0)
+    {
+        chpClient->removeCallback(chpCallbackId);
+    }
+
+    if (runtime && rowSinkId != 0)
+    {
+        runtime->removeRowSink(rowSinkId);
+    }
+
+    // joinable threads can't be destroyed
+    if (pipelined)
+    {
+        stopPipeline();
+    }
 }
 
 /**
@@ -38,7 +59,7 @@ bool Mug::init(const std::string& serverHost_in, int basePort, int timeOutMillis
     context.reset(new zmq::context_t(1));
 
     // TODO make this not magic 2000 default timeout for testing
-    chpClient.reset(new ClusteredHashmapClient(serverHost_in, basePort, timeOutMillis));
+    chpClient.reset(new ClusteredHashmapClient(serverHost_in, basePort, timeOutMillis, transport));
     chpClient->init(context, uuid);
     hashMapUpdatedHandle = std::bind(&Mug::hashMapUpdated, this);
     chpClient->setCallback(hashMapUpdatedHandle);
@@ -46,22 +67,98 @@ bool Mug::init(const std::string& serverHost_in, int basePort, int timeOutMillis
     formatParser.reset(new DataFormatParser);
 
     keg.reset(new Keg(kegDir));
+    kegSink.reset(new KegSink(keg));
+
+    return true;
+}
+
+/**
+* @brief Initializes the mug to use a shared runtime's zmq context and CHP client instead of its own
+* @param runtime_in is the runtime to share, e.g. LagerRuntime::getDefault()
+* @param serverHost_in is a string containing the IP or hostname of the bartender to connect to
+* @param basePort is an integer containing a the port of the bartender to connect to
+* @param timeOutMillis is the timeout for the bartender, if this is the first user of the runtime's client for it
+* @param kegDir is a string containing a path to an accessible directory to store the keg files
+* @returns true on successful initialization, false on failure
+*/
+bool Mug::init(const std::shared_ptr<LagerRuntime>& runtime_in, const std::string& serverHost_in, int basePort,
+               int timeOutMillis, const std::string& kegDir)
+{
+    subscriberPort = basePort + FORWARDER_BACKEND_OFFSET;
+
+    if (!runtime_in || subscriberPort < 0 || subscriberPort > BASEPORT_MAX)
+    {
+        return false;
+    }
+
+    serverHost = serverHost_in;
+
+    runtime = runtime_in;
+    context = runtime->getContext();
+    chpClient = runtime->getChpClient(serverHost_in, basePort, timeOutMillis, transport);
+    hashMapUpdatedHandle = std::bind(&Mug::hashMapUpdated, this);
+
+    formatParser.reset(new DataFormatParser);
+
+    keg.reset(new Keg(kegDir));
+    kegSink.reset(new KegSink(keg));
 
     return true;
 }
 
 /**
-* @brief Starts the mug subscriber thread
+* @brief Starts the mug subscriber thread, or in embedded mode starts taking rows from the runtime's embedded taps
+* @throws runtime_error in embedded mode without a LagerRuntime, or with a pipeline
 */
 void Mug::start()
 {
+    if (embedded && !runtime)
+    {
+        throw std::runtime_error("Mug embedded mode requires a LagerRuntime");
+    }
+
+    if (embedded && pipelineThreads > 0)
+    {
+        throw std::runtime_error("Mug embedded mode can't be pipelined");
+    }
+
     running = true;
 
     keg->start();
 
+    // until the first format update this is everything, or nothing if there are subscriptions
+    mutex.lock();
+    updateFilters();
+    mutex.unlock();
+
+    if (embedded)
+    {
+        rowSinkId = runtime->addRowSink([this](const std::string & tapUuid, const uint8_t* row, size_t size)
+        {
+            writeEmbedded(tapUuid, row, size);
+        });
+
+        chpCallbackId = chpClient->addCallback(hashMapUpdatedHandle);
+        hashMapUpdated();
+        return;
+    }
+
+    if (pipelineThreads > 0)
+    {
+        startPipeline();
+    }
+
     subscriberThreadHandle = std::thread(&Mug::subscriberThread, this);
     subscriberThreadHandle.detach();
 
+    if (runtime)
+    {
+        // the shared client is already running, so pick up whatever it has seen so far
+        chpCallbackId = chpClient->addCallback(hashMapUpdatedHandle);
+        hashMapUpdated();
+        return;
+    }
+
     chpClient->start();
 }
 
@@ -75,7 +172,22 @@ void Mug::stop()
     running = false;
     mutex.unlock();
 
-    zmq_ctx_shutdown((void*)*context.get());
+    if (runtime)
+    {
+        chpClient->removeCallback(chpCallbackId);
+        chpCallbackId = 0;
+
+        // once removed the reactor is done writing to the keg
+        if (rowSinkId != 0)
+        {
+            runtime->removeRowSink(rowSinkId);
+            rowSinkId = 0;
+        }
+    }
+    else
+    {
+        zmq_ctx_shutdown((void*)*context.get());
+    }
 
     unsigned int retries = 0;
 
@@ -90,211 +202,1323 @@ void Mug::stop()
         retries++;
     }
 
-    chpClient->stop();
+    // the rows already received still make it to the keg
+    if (pipelined)
+    {
+        stopPipeline();
+    }
+
     keg->stop();
-    context->close();
+
+    // a shared context and client stay up for the runtime's other users
+    if (!runtime)
+    {
+        chpClient->stop();
+        context->close();
+    }
 }
 
 /**
-* @brief Callback function to update the hashmap and format maps whenever the chp client hashmap is updated
+* @brief Selects how the mug reaches the bartender, must be called before init()
+* See Tap::setTransport(), the same restrictions apply.
+* @param transport_in is the transport to use, tcp by default
 */
-void Mug::hashMapUpdated()
+void Mug::setTransport(LagerTransport transport_in)
 {
-    std::map<std::string, std::string> tmpUuidMap; // <uuid, topic name>
-    std::shared_ptr<DataFormat> tmpDataFormat;
+    transport = transport_in;
+}
 
-    mutex.lock();
-    hashMap = chpClient->getHashMap();
-    tmpUuidMap = chpClient->getUuidMap();
+/**
+* @brief Takes rows straight from the Taps sharing the mug's runtime instead of subscribing to the Forwarder, must be
+* called before start() and requires a mug initialized with a LagerRuntime.  Only taps in embedded mode on the same
+* runtime are logged, formats still come from the bartender.
+* @param enabled is true to skip zmq for data
+*/
+void Mug::setEmbedded(bool enabled)
+{
+    embedded = enabled;
+}
+
+/**
+* @brief Splits the mug into pipeline stages so a slow disk or sink doesn't hold up receiving: the subscriber thread
+* only receives, decode threads assemble the rows, each tap always on the same one so its rows stay in order, and a
+* writer thread passes them to the keg and sinks.  The stages are connected by bounded lock-free queues, a message
+* that arrives while its decode thread is a full queue behind is dropped and counted.  Must be called before
+* start(), not available in embedded mode.
+* @param decodeThreads is the number of decode threads, 0 (the default) to do everything on the subscriber thread
+* @param queueDepth is the number of messages, and of rows, each decode thread can have queued
+*/
+void Mug::setPipeline(size_t decodeThreads, size_t queueDepth)
+{
+    pipelineThreads = decodeThreads;
+    pipelineDepth = queueDepth > 0 ? queueDepth : 1;
+}
+
+/**
+* @brief Reports how many messages and rows are queued between the pipeline stages, safe to call from any thread
+* while the mug is running
+* @returns the queue depths, empty without a pipeline
+*/
+MugQueueDepths Mug::getQueueDepths() const
+{
+    MugQueueDepths depths;
 
-    // TODO later only parse the subscribed topic names
-    for (auto i = hashMap.begin(); i != hashMap.end(); ++i)
+    if (!pipelined)
     {
-        // parse the xml data format into a DataFormat object
-        tmpDataFormat = formatParser->parseFromString(i->second);
+        return depths;
+    }
 
-        // look for our DataFormat object's topic name in the uuid map
-        for (auto j = tmpUuidMap.begin(); j != tmpUuidMap.end(); ++j)
-        {
-            if (j->second == i->first)
-            {
-                // index the formats by uuid for ease of use as the data comes in
-                formatMap[j->first] = tmpDataFormat;
-                keg->addFormat(j->first, i->second);
-                break;
-            }
-        }
+    for (auto i = workers.begin(); i != workers.end(); ++i)
+    {
+        depths.decode.push_back((*i)->inbox->size());
+        depths.write.push_back((*i)->outbox->size());
     }
 
+    return depths;
+}
+
+/**
+* @brief Adds a sink that gets every row after the keg, e.g. a live cache, statistics or a CallbackSink.  Must be
+* called before start().  Sinks get a view of the mug's own buffer, so adding more doesn't copy rows.
+* @param sink is the sink to add, use a FanOutSink to group several
+* @throws runtime_error on an empty sink
+*/
+void Mug::addSink(const std::shared_ptr<MugSink>& sink)
+{
+    sinks.add(sink);
+}
+
+/**
+* @brief Only receives and logs taps whose key matches the glob, e.g. /RobotA/<anything>.  A mug that hasn't subscribed
+* to anything receives every tap.  Can be called before or after start(), taps registered later are picked up as
+* they appear.
+* @param pattern is a glob over tap keys, * matches any run of characters including / and ? any one character
+*/
+void Mug::subscribe(const std::string& pattern)
+{
+    mutex.lock();
+    subscribedList.push_back(pattern);
     mutex.unlock();
+
+    // formats of taps that just became subscribed haven't been parsed yet
+    if (running)
+    {
+        hashMapUpdated();
+    }
 }
 
 /**
-* @brief The main data subscriber thread
+* @brief Callback function to update the hashmap and format maps whenever the chp client hashmap is updated
 */
-void Mug::subscriberThread()
+void Mug::hashMapUpdated()
 {
-    subscriberRunning = true;
+    mutex.lock();
+    updateFormats(chpClient->getHashMap(), chpClient->getUuidMap());
+    mutex.unlock();
+}
 
-    // setting linger so the socket doesn't hang around after being stopped
-    int linger = 0;
+/**
+* @brief Brings the format map up to date with new CHP maps, must be called with mutex held.  Only taps that are new,
+* newly subscribed or whose format changed are looked at, and each distinct format xml is only parsed once: taps
+* restarted under a new uuid, or several taps registering the same format, share one DataFormat.  Taps that are gone
+* or no longer subscribed are forgotten, as are cached formats nothing uses anymore.
+* @param newHashMap is the CHP hash map, <topic name, xml format>
+* @param newUuidMap is the CHP uuid map, <uuid, topic name>
+*/
+void Mug::updateFormats(const std::map<std::string, std::string>& newHashMap,
+                        const std::map<std::string, std::string>& newUuidMap)
+{
+    // formats that failed to parse stay cached as empty while a subscribed tap still uses them, so they aren't parsed
+    // again on every update
+    std::set<std::string> failed;
 
-    try
+    for (auto i = newUuidMap.begin(); i != newUuidMap.end(); ++i)
     {
-        if (!context)
+        auto xml = newHashMap.find(i->second);
+
+        // taps we aren't subscribed to never reach the subscriber, so their formats aren't needed
+        if (xml == newHashMap.end() || !isSubscribed(i->second))
         {
-            if (running)
+            continue;
+        }
+
+        if (formatMap.count(i->first))
+        {
+            auto oldTopic = uuidMap.find(i->first);
+
+            if (oldTopic != uuidMap.end() && oldTopic->second == i->second)
             {
-                throw std::runtime_error("Mug::subscriberThread attempted to start with a NULL context");
+                auto oldXml = hashMap.find(i->second);
+
+                if (oldXml != hashMap.end() && oldXml->second == xml->second)
+                {
+                    continue;
+                }
             }
-            else
+        }
+
+        // the cache is keyed by the whole xml, so a hash collision can't hand out the wrong format
+        auto cached = formatCache.find(xml->second);
+
+        if (cached == formatCache.end())
+        {
+            std::shared_ptr<DataFormat> format;
+
+            try
             {
-                mutex.lock();
-                subscriberRunning = false;
-                mutex.unlock();
-                return;
+                format = formatParser->parseFromString(xml->second);
+            }
+            catch (const std::runtime_error& e)
+            {
+                std::clog << "Mug failed to parse the format of " << i->second << ": " << e.what() << std::endl;
             }
+
+            cached = formatCache.insert(std::make_pair(xml->second, format)).first;
         }
 
-        subscriber.reset(new zmq::socket_t(*context.get(), ZMQ_SUB));
-        subscriber->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
-        subscriber->connect(lager_utils::getRemoteUri(serverHost.c_str(), subscriberPort).c_str());
+        if (!cached->second)
+        {
+            // its rows are dropped rather than checked against a format it no longer has
+            failed.insert(xml->second);
+            formatMap.erase(i->first);
+            continue;
+        }
 
-        // subscribe to everything (for now)
-        // TODO set up filter by uuid of subscribed topics
-        subscriber->setsockopt(ZMQ_SUBSCRIBE, "", 0);
+        // index the formats by uuid for ease of use as the data comes in
+        formatMap[i->first] = cached->second;
+        keg->addFormat(i->first, xml->second);
+    }
 
-        uint64_t timestamp;
-        std::vector<uint8_t> data; // the main buffer we're keeping
+    for (auto i = formatMap.begin(); i != formatMap.end();)
+    {
+        auto topic = newUuidMap.find(i->first);
 
-        // all data that comes from a tap will be one of these sizes
-        uint8_t tmp8;
-        uint16_t tmp16;
-        uint32_t tmp32;
-        uint64_t tmp64;
+        if (topic == newUuidMap.end() || !newHashMap.count(topic->second) || !isSubscribed(topic->second))
+        {
+            i = formatMap.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
 
-        off_t offset; // keeps track of the current offset of the buffer while recieving more frames
+    // a format only the cache still holds isn't used by any tap anymore
+    for (auto i = formatCache.begin(); i != formatCache.end();)
+    {
+        if (i->second ? i->second.use_count() == 1 : !failed.count(i->first))
+        {
+            i = formatCache.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
 
-        uint32_t rcvMore = 0;
-        size_t moreSize = sizeof(rcvMore);
+    hashMap = newHashMap;
+    uuidMap = newUuidMap;
 
-        // set up a poller for the subscriber socket
-        zmq::pollitem_t items[] = {{static_cast<void*>(*subscriber.get()), 0, ZMQ_POLLIN, 0}};
+    updateFilters();
+}
 
-#ifdef WITH_LTTNG
-        int msgPartCount = 0;
-        tracepoint(lager_tp, lager_tp_general, "Mug::subscriberThread()", "start");
-#endif
+/**
+* @brief Checks a tap key against the subscriptions, must be called with mutex held
+* @param topic is the tap's key
+* @returns true if the tap's rows should be logged
+*/
+bool Mug::isSubscribed(const std::string& topic) const
+{
+    if (subscribedList.empty())
+    {
+        return true;
+    }
 
-        while (running)
+    for (auto i = subscribedList.begin(); i != subscribedList.end(); ++i)
+    {
+        if (lager_utils::matchesGlob(*i, topic))
         {
-            // TODO check if this timeout should be different or setable by user
-            zmq::poll(&items[0], 1, 1000);
+            return true;
+        }
+    }
 
-            if (items[0].revents & ZMQ_POLLIN)
+    return false;
+}
+
+/**
+* @brief Works out the uuid prefix filters for the current taps and subscriptions and flags them for the subscriber
+* thread if they changed, must be called with mutex held
+*/
+void Mug::updateFilters()
+{
+    std::set<std::string> filters;
+
+    if (subscribedList.empty())
+    {
+        filters.insert(std::string());
+    }
+    else
+    {
+        // the uuid is the first frame of every data message, so it works as a zmq prefix filter
+        for (auto i = uuidMap.begin(); i != uuidMap.end(); ++i)
+        {
+            if (isSubscribed(i->second))
             {
-                // clear the buffer each time
-                data.clear();
-                offset = 0;
+                filters.insert(i->first);
+            }
+        }
+    }
 
-                zmq::message_t msg;
+    if (filters != subscriberFilters)
+    {
+        subscriberFilters.swap(filters);
+        filtersChanged = true;
+    }
+}
 
-                subscriber->recv(&msg);
-                std::string uuid(static_cast<char*>(msg.data()), msg.size());
+/**
+* @brief Brings the socket's subscriptions in line with subscriberFilters, zmq sockets may only be touched by the
+* thread that uses them so this runs on the subscriber thread
+* @param socket is the subscriber socket
+* @param installed holds the filters the socket has, updated to the new ones
+*/
+void Mug::applyFilters(zmq::socket_t& socket, std::set<std::string>& installed)
+{
+    std::set<std::string> filters;
 
-                // Version frame, string, currently unused
-                subscriber->recv(&msg);
+    mutex.lock();
+    filtersChanged = false;
+    filters = subscriberFilters;
+    mutex.unlock();
 
-                // Compression frame, uint16_t, currently unused
-                subscriber->recv(&msg);
+    // subscribe first so there is no gap in the rows of taps that stay subscribed
+    for (auto i = filters.begin(); i != filters.end(); ++i)
+    {
+        if (!installed.count(*i))
+        {
+            socket.setsockopt(ZMQ_SUBSCRIBE, i->data(), i->size());
+        }
+    }
 
-                subscriber->recv(&msg);
-                timestamp = *static_cast<uint64_t*>(msg.data());
+    for (auto i = installed.begin(); i != installed.end(); ++i)
+    {
+        if (!filters.count(*i))
+        {
+            socket.setsockopt(ZMQ_UNSUBSCRIBE, i->data(), i->size());
+        }
+    }
 
-                if (uuid.size() != UUID_SIZE_BYTES)
-                {
-                    throw std::runtime_error("received invalid uuid size");
-                }
+    installed.swap(filters);
+}
 
-#ifdef WITH_LTTNG
-                // the four message parts above
-                msgPartCount = 4;
-#endif
+/**
+* @brief Looks up the format a tap registered
+* @param uuid is the 16 byte uuid of the tap
+* @returns the format, or an empty pointer if it hasn't been seen yet
+*/
+std::shared_ptr<DataFormat> Mug::getFormat(const std::string& uuid)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = formatMap.find(uuid);
 
-                // uuid is first in the buffer
-                for (size_t i = 0; i < uuid.size(); ++i)
-                {
-                    data.push_back(uuid[i]);
-                }
+    return found != formatMap.end() ? found->second : std::shared_ptr<DataFormat>();
+}
 
-                offset += UUID_SIZE_BYTES;
+/**
+* @brief Checks whether a tap is registered with the bartender but has no format here, because it isn't subscribed
+* or its format failed to parse.  Its rows will never be written, so there is no point parking them.
+* @param uuid is the 16 byte uuid of the tap
+* @returns true if the tap is known and has no format
+*/
+bool Mug::isKnownWithoutFormat(const std::string& uuid)
+{
+    std::lock_guard<std::mutex> lock(mutex);
 
-                // timestamp is next in the buffer
-                data.resize(data.size() + TIMESTAMP_SIZE_BYTES);
-                *(reinterpret_cast<uint64_t*>(data.data() + offset)) = timestamp;
+    return uuidMap.count(uuid) && !formatMap.count(uuid);
+}
 
-                offset += TIMESTAMP_SIZE_BYTES;
+/**
+* @brief Unpacks a batched payload and writes each record as its own row with its own timestamp
+* @param worker is the decode stage the tap belongs to, its row buffer already holds the uuid and is sized for the
+* timestamp and one row
+* @param uuid is the 16 byte uuid of the tap that sent the batch
+* @param format is the tap's format, records are parked while it is empty
+* @param flags are the data message flags, DATA_FLAG_DELTA means every record is delta encoded
+* @param payload points to the (timestamp, length, row) records
+* @param size is the size of the payload in bytes
+* @throws runtime_error on a truncated record
+*/
+void Mug::writeBatch(MugWorker& worker, const std::string& uuid, const std::shared_ptr<DataFormat>& format,
+                     uint8_t flags, const uint8_t* payload, size_t size)
+{
+    std::vector<uint8_t>& data = worker.data;
+    const size_t recordHeaderSize = TIMESTAMP_SIZE_BYTES + BATCH_ROW_LENGTH_SIZE_BYTES;
+    const size_t rowOffset = UUID_SIZE_BYTES + TIMESTAMP_SIZE_BYTES;
+    size_t pos = 0;
 
-                // make sure we have more of the multipart zmq message waiting
-                subscriber->getsockopt(ZMQ_RCVMORE, &rcvMore, &moreSize);
+    while (pos < size)
+    {
+        if (size - pos < recordHeaderSize)
+        {
+            throw std::runtime_error("received truncated batch record header");
+        }
 
-                while (rcvMore != 0)
-                {
-                    subscriber->recv(&msg);
-
-                    // TODO eventually move to a size + blob architecture, if necessary,
-                    // since these reallocs may be expensive
-                    switch (msg.size())
-                    {
-                        case 1:
-                            tmp8 = *static_cast<uint8_t*>(msg.data());
-                            data.push_back(tmp8);
-                            offset += 1;
-                            break;
-
-                        case 2:
-                            data.resize(data.size() + 2);
-                            tmp16 = *static_cast<uint16_t*>(msg.data());
-                            *(reinterpret_cast<uint16_t*>(data.data() + offset)) = tmp16;
-                            offset += 2;
-                            break;
-
-                        case 4:
-                            data.resize(data.size() + 4);
-                            tmp32 = *static_cast<uint32_t*>(msg.data());
-                            *(reinterpret_cast<uint32_t*>(data.data() + offset)) = tmp32;
-                            offset += 4;
-                            break;
-
-                        case 8:
-                            data.resize(data.size() + 8);
-                            tmp64 = *static_cast<uint64_t*>(msg.data());
-                            *(reinterpret_cast<uint64_t*>(data.data() + offset)) = tmp64;
-                            offset += 8;
-                            break;
-
-                        default:
-                            throw std::runtime_error("received unsupported zmq message size");
-                            break;
-                    }
+        uint32_t length;
+        memcpy(&length, payload + pos + TIMESTAMP_SIZE_BYTES, BATCH_ROW_LENGTH_SIZE_BYTES);
+        length = ntohl(length);
 
-#ifdef WITH_LTTNG
-                    msgPartCount++;
-#endif
-                    // check for more multipart messages
-                    subscriber->getsockopt(ZMQ_RCVMORE, &rcvMore, &moreSize);
-                }
+        if (size - pos - recordHeaderSize < length)
+        {
+            throw std::runtime_error("received truncated batch record");
+        }
 
-#ifdef WITH_LTTNG
-                tracepoint(lager_tp, lager_tp_zmq_msg, "Mug::subscriberThread()", "msg_rcvd",
-                           msgPartCount, data.size());
-#endif
+        // the timestamp stays in network order, same as unbatched rows
+        memcpy(data.data() + UUID_SIZE_BYTES, payload + pos, TIMESTAMP_SIZE_BYTES);
 
-                // write out the data
-                // TODO this should probably be some kind of callback function
-                keg->write(data, data.size());
+        if (flags & DATA_FLAG_DELTA)
+        {
+            if (applyDelta(worker, uuid, format, payload + pos + recordHeaderSize, length))
+            {
+                emitRow(worker, format, data.data(), data.size());
             }
         }
+        else if (!format)
+        {
+            data.resize(rowOffset + length);
+            memcpy(data.data() + rowOffset, payload + pos + recordHeaderSize, length);
+            parkRow(worker, uuid, data.size());
+        }
+        else if (rowOffset + length == data.size())
+        {
+            memcpy(data.data() + rowOffset, payload + pos + recordHeaderSize, length);
+            emitRow(worker, format, data.data(), data.size());
+        }
+        else
+        {
+            dropRow(worker, uuid);
+        }
+
+        pos += recordHeaderSize + length;
+    }
+}
+
+/**
+* @brief Rebuilds a full row from a delta encoded one (see Tap::encodeDelta()).  A gap in the tap's sequence numbers
+* means a row was missed somewhere, e.g. dropped by the subscriber thread, so the tap's rows are dropped again until
+* the next keyframe.
+* @param worker is the decode stage the tap belongs to, its row buffer already holds the uuid and timestamp and the
+* full row is written after them
+* @param uuid is the 16 byte uuid of the tap that sent the row
+* @param format is the tap's format, the row is dropped while it is empty
+* @param encoded points to the sequence number and change bitmap followed by the changed columns
+* @param size is the size of the encoded row in bytes
+* @returns true if the row buffer now holds a full row, false if the tap's format or a keyframe hasn't been seen yet
+* @throws runtime_error on a truncated row
+*/
+bool Mug::applyDelta(MugWorker& worker, const std::string& uuid, const std::shared_ptr<DataFormat>& format,
+                     const uint8_t* encoded, size_t size)
+{
+    const size_t rowOffset = UUID_SIZE_BYTES + TIMESTAMP_SIZE_BYTES;
+
+    // without the column sizes there is no way to tell where the changed columns are
+    if (!format)
+    {
+        dropRow(worker, uuid);
+        return false;
+    }
+
+    MugDeltaState& state = worker.deltaStates[uuid];
+
+    if (state.format != format)
+    {
+        state.format = format;
+        state.items = format->getItems();
+        state.lastRow.assign(format->getItemsSize(), 0);
+        state.synced = false;
+    }
+
+    size_t bitmapSize = (state.items.size() + 7) / 8;
+
+    if (size < DELTA_SEQUENCE_SIZE_BYTES + bitmapSize)
+    {
+        throw std::runtime_error("received truncated delta row");
+    }
+
+    uint32_t sequence;
+    memcpy(&sequence, encoded, DELTA_SEQUENCE_SIZE_BYTES);
+    sequence = ntohl(sequence);
+
+    if (sequence != state.nextSequence)
+    {
+        state.synced = false;
+    }
+
+    state.nextSequence = sequence + 1;
+
+    const uint8_t* bitmap = encoded + DELTA_SEQUENCE_SIZE_BYTES;
+    const uint8_t* column = bitmap + bitmapSize;
+    const uint8_t* end = encoded + size;
+    size_t present = 0;
+
+    for (size_t i = 0; i < state.items.size(); ++i)
+    {
+        if (bitmap[i / 8] & (1 << (i % 8)))
+        {
+            if (static_cast<size_t>(end - column) < state.items[i].size)
+            {
+                throw std::runtime_error("received truncated delta row");
+            }
+
+            memcpy(state.lastRow.data() + state.items[i].offset, column, state.items[i].size);
+            column += state.items[i].size;
+            present++;
+        }
+    }
+
+    if (present == state.items.size())
+    {
+        state.synced = true;
+    }
+
+    if (!state.synced)
+    {
+        return false;
+    }
+
+    worker.data.resize(rowOffset + state.lastRow.size());
+    memcpy(worker.data.data() + rowOffset, state.lastRow.data(), state.lastRow.size());
+
+    return true;
+}
+
+/**
+* @brief Writes one row from an embedded tap, called by the runtime's reactor thread
+* @param uuid is the 16 byte uuid of the tap the row is from
+* @param row points to the network order timestamp followed by the row, already in the tap's registered byte order
+* @param size is the size in bytes of the timestamp and row
+*/
+void Mug::writeEmbedded(const std::string& uuid, const uint8_t* row, size_t size)
+{
+    std::shared_ptr<DataFormat> format;
+
+    mutex.lock();
+    bool subscribed = subscriberFilters.count(std::string()) || subscriberFilters.count(uuid);
+
+    if (subscribed)
+    {
+        auto found = formatMap.find(uuid);
+
+        if (found != formatMap.end())
+        {
+            format = found->second;
+        }
+    }
+
+    mutex.unlock();
+
+    if (!subscribed || size < TIMESTAMP_SIZE_BYTES)
+    {
+        return;
+    }
+
+    // the tap's queue slot is passed on as is, the sinks see it without a copy
+    writeRow(reinterpret_cast<const uint8_t*>(uuid.data()), row, size - TIMESTAMP_SIZE_BYTES, format.get());
+}
+
+/**
+* @brief Passes a row to the keg and then to any added sinks
+* @param format is the tap's format
+* @param data points to the uuid, network order timestamp and row
+* @param size is the size of all three in bytes
+*/
+void Mug::writeRow(const DataFormat* format, const uint8_t* data, size_t size)
+{
+    writeRow(data, data + UUID_SIZE_BYTES, size - UUID_SIZE_BYTES - TIMESTAMP_SIZE_BYTES, format);
+}
+
+/**
+* @brief Passes a row to the keg and then to any added sinks
+* @param tapUuid points to the 16 byte uuid of the tap the row is from
+* @param record points to the network order timestamp, immediately followed by the row
+* @param rowSize is the size of the row in bytes, not counting the timestamp
+* @param format is the tap's format, or nullptr if it isn't known yet
+*/
+void Mug::writeRow(const uint8_t* tapUuid, const uint8_t* record, size_t rowSize, const DataFormat* format)
+{
+    uint64_t timestamp;
+    memcpy(&timestamp, record, TIMESTAMP_SIZE_BYTES);
+
+    MugRow row(tapUuid, lager_utils::ntohll(timestamp), record + TIMESTAMP_SIZE_BYTES, rowSize, format);
+
+    kegSink->write(row);
+
+    if (!sinks.empty())
+    {
+        sinks.write(row);
+    }
+}
+
+namespace
+{
+    /**
+    * @brief Copies one column frame into the row
+    * @param data is the row buffer
+    * @param offset is where the frame goes, advanced past it
+    * @param msg is the frame
+    * @returns false if the frame runs past the end of the row
+    */
+    bool copyFrame(std::vector<uint8_t>& data, size_t& offset, const zmq::message_t& msg)
+    {
+        size_t size = msg.size();
+
+        if (size > data.size() - offset)
+        {
+            offset += size;
+            return false;
+        }
+
+        // fixed size copies for the common column sizes compile down to single moves
+        switch (size)
+        {
+            case 1:
+                memcpy(data.data() + offset, msg.data(), 1);
+                break;
+
+            case 2:
+                memcpy(data.data() + offset, msg.data(), 2);
+                break;
+
+            case 4:
+                memcpy(data.data() + offset, msg.data(), 4);
+                break;
+
+            case 8:
+                memcpy(data.data() + offset, msg.data(), 8);
+                break;
+
+            default:
+                // array items and packed payloads arrive as one frame, already in the row's byte order
+                memcpy(data.data() + offset, msg.data(), size);
+                break;
+        }
+
+        offset += size;
+        return true;
+    }
+
+    /**
+    * @brief Queues a pointer on a ring used as a pointer queue between two pipeline threads
+    * @returns false if the ring is full
+    */
+    template <typename T>
+    bool pushPointer(RowRingBuffer& ring, T* pointer)
+    {
+        uint8_t* slot = ring.beginWrite();
+
+        if (!slot)
+        {
+            return false;
+        }
+
+        memcpy(slot, &pointer, sizeof(pointer));
+        ring.commitWrite();
+        return true;
+    }
+
+    /**
+    * @brief Takes the next pointer off a ring used as a pointer queue between two pipeline threads
+    * @returns the pointer, or nullptr if the ring is empty
+    */
+    template <typename T>
+    T* popPointer(RowRingBuffer& ring)
+    {
+        uint8_t* slot = ring.beginRead();
+
+        if (!slot)
+        {
+            return nullptr;
+        }
+
+        T* pointer;
+        memcpy(&pointer, slot, sizeof(pointer));
+        ring.commitRead();
+        return pointer;
+    }
+
+    /**
+    * @brief Puts a pipeline thread to sleep until another one wakes it or MUG_PIPELINE_IDLE_WAKE_MILLIS pass, the same
+    * handshake as Tap::waitForRows()
+    * @param ready is checked after announcing the wait, the thread doesn't sleep if it already returns true
+    */
+    template <typename Ready>
+    void waitUntil(std::mutex& wakeMutex, std::condition_variable& wakeCv, std::atomic<bool>& waiting, Ready ready)
+    {
+        std::unique_lock<std::mutex> lock(wakeMutex);
+
+        waiting.store(true, std::memory_order_relaxed);
+
+        // pairs with the fence in wake(), so either the waker sees this thread waiting or this thread sees its work
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!ready())
+        {
+            wakeCv.wait_for(lock, std::chrono::milliseconds(MUG_PIPELINE_IDLE_WAKE_MILLIS));
+        }
+
+        waiting.store(false, std::memory_order_relaxed);
+    }
+
+    /**
+    * @brief Wakes a pipeline thread waiting in waitUntil(), called after queueing its work
+    */
+    void wake(std::mutex& wakeMutex, std::condition_variable& wakeCv, const std::atomic<bool>& waiting)
+    {
+        // pairs with the fence in waitUntil(), see there
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (waiting.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wakeCv.notify_one();
+        }
+    }
+}
+
+/**
+* @brief Receives every frame of one data message
+* @param socket is the subscriber socket, with a message waiting
+* @param message is filled with the frames, reusing the ones it already has
+*/
+void Mug::receiveFrames(zmq::socket_t& socket, MugMessage& message)
+{
+    uint32_t rcvMore = 1;
+    size_t moreSize = sizeof(rcvMore);
+
+    message.count = 0;
+
+    while (rcvMore != 0)
+    {
+        if (message.count == message.frames.size())
+        {
+            message.frames.resize(message.count + 1);
+        }
+
+        socket.recv(&message.frames[message.count++]);
+        socket.getsockopt(ZMQ_RCVMORE, &rcvMore, &moreSize);
+    }
+}
+
+/**
+* @brief Receives one data message and decodes it on the calling thread, a malformed message is dropped and counted
+* @param socket is the subscriber socket, with a message waiting
+* @param message holds the frames, reused for every message
+*/
+void Mug::receiveMessage(zmq::socket_t& socket, MugMessage& message)
+{
+    receiveFrames(socket, message);
+
+    try
+    {
+        decodeMessage(*workers.front(), message);
+    }
+    catch (const std::runtime_error&)
+    {
+        dropMessage(*workers.front(), message);
+    }
+}
+
+/**
+* @brief Hands a received message to the decode thread of its tap, on the subscriber thread.  The message is swapped
+* for one of that thread's free ones, if it has none left it is a full queue behind and the message is dropped.
+* @param message is the received message, replaced by the one to receive the next message into
+*/
+void Mug::dispatchMessage(MugMessage*& message)
+{
+    size_t index = 0;
+
+    // malformed messages can go anywhere, the decode thread rejects them
+    if (message->count > 0 && message->frames[0].size() == UUID_SIZE_BYTES)
+    {
+        std::string tapUuid(static_cast<const char*>(message->frames[0].data()), UUID_SIZE_BYTES);
+        index = std::hash<std::string>()(tapUuid) % workers.size();
+    }
+
+    MugWorker& worker = *workers[index];
+    MugMessage* spare = popPointer<MugMessage>(*worker.freeMessages);
+
+    // the decode thread can't be told from here, it notices the gap in the tap's delta sequence instead
+    if (!spare)
+    {
+        droppedCount++;
+        return;
+    }
+
+    // the inbox can hold every message the worker owns, so this always fits
+    pushPointer(*worker.inbox, message);
+    wake(worker.wakeMutex, worker.wakeCv, worker.waiting);
+    message = spare;
+}
+
+/**
+* @brief Decodes one data message into rows.  The tap's format is looked up once and each row is assembled in place
+* in a buffer of exactly the registered size.  Rows of taps whose format hasn't arrived yet are parked until it
+* does, rows that don't match their format are dropped and counted.
+* @param worker is the decode stage the message's tap belongs to
+* @param message is the received message
+* @throws runtime_error on a malformed message
+*/
+void Mug::decodeMessage(MugWorker& worker, const MugMessage& message)
+{
+    const size_t rowOffset = UUID_SIZE_BYTES + TIMESTAMP_SIZE_BYTES;
+    const size_t headerFrames = 4; // uuid, version, flags and timestamp
+
+    if (message.count < headerFrames)
+    {
+        throw std::runtime_error("received truncated data message");
+    }
+
+    const zmq::message_t& uuidFrame = message.frames[0];
+
+    if (uuidFrame.size() != UUID_SIZE_BYTES)
+    {
+        throw std::runtime_error("received invalid uuid size");
+    }
+
+    std::string tapUuid(static_cast<const char*>(uuidFrame.data()), UUID_SIZE_BYTES);
+    std::shared_ptr<DataFormat> format = getFormat(tapUuid);
+
+    if (format && worker.parkedCount > 0)
+    {
+        // keeps the tap's rows in order
+        flushParked(worker, tapUuid, format);
+    }
+
+    std::vector<uint8_t>& data = worker.data;
+
+    // parked rows grow as their frames are copied, the rest are written in place
+    data.resize(rowOffset + (format ? format->getItemsSize() : 0));
+    memcpy(data.data(), tapUuid.data(), UUID_SIZE_BYTES);
+
+    // frame 1 is the version, currently unused
+    const zmq::message_t& flagsFrame = message.frames[2];
+    uint8_t flags = flagsFrame.size() > 0 ? *static_cast<const uint8_t*>(flagsFrame.data()) : 0;
+
+    // the timestamp stays in network order
+    const zmq::message_t& timestampFrame = message.frames[3];
+
+    if (timestampFrame.size() != TIMESTAMP_SIZE_BYTES)
+    {
+        throw std::runtime_error("received invalid timestamp size");
+    }
+
+    memcpy(data.data() + UUID_SIZE_BYTES, timestampFrame.data(), TIMESTAMP_SIZE_BYTES);
+
+    if ((flags & (DATA_FLAG_BATCHED | DATA_FLAG_DELTA)) && message.count > headerFrames)
+    {
+        if (message.count != headerFrames + 1)
+        {
+            throw std::runtime_error("received unexpected frames after batched or delta payload");
+        }
+
+        const zmq::message_t& payload = message.frames[headerFrames];
+
+        if (flags & DATA_FLAG_BATCHED)
+        {
+            writeBatch(worker, tapUuid, format, flags, static_cast<const uint8_t*>(payload.data()), payload.size());
+        }
+        else if (applyDelta(worker, tapUuid, format, static_cast<const uint8_t*>(payload.data()), payload.size()))
+        {
+            // rows that can't be rebuilt yet (no keyframe seen) are dropped
+            emitRow(worker, format, data.data(), data.size());
+        }
+
+        return;
+    }
+
+    // a packed payload is a single frame holding the whole row, otherwise there is one frame per column
+    if ((flags & DATA_FLAG_PACKED_PAYLOAD) && message.count > headerFrames + 1)
+    {
+        throw std::runtime_error("received unexpected frames after packed payload");
+    }
+
+    size_t offset = rowOffset;
+    bool fits = true;
+
+    for (size_t i = headerFrames; i < message.count; ++i)
+    {
+        const zmq::message_t& frame = message.frames[i];
+
+        if (frame.size() == 0)
+        {
+            throw std::runtime_error("received unsupported zmq message size");
+        }
+
+        if (!format)
+        {
+            data.resize(offset + frame.size());
+        }
+
+        fits = copyFrame(data, offset, frame) && fits;
+    }
+
+#ifdef WITH_LTTNG
+    tracepoint(lager_tp, lager_tp_zmq_msg, "Mug::decodeMessage()", "msg_rcvd", static_cast<int>(message.count),
+               offset);
+#endif
+
+    if (!format)
+    {
+        parkRow(worker, tapUuid, offset);
+    }
+    else if (fits && offset == data.size())
+    {
+        emitRow(worker, format, data.data(), data.size());
+    }
+    else
+    {
+        dropRow(worker, tapUuid);
+    }
+}
+
+/**
+* @brief Passes a decoded row on, straight to the sinks without a pipeline or through the worker's queue to the
+* writer thread with one
+* @param worker is the decode stage the row's tap belongs to
+* @param format is the tap's format
+* @param data points to the uuid, network order timestamp and row
+* @param size is the size of all three in bytes
+*/
+void Mug::emitRow(MugWorker& worker, const std::shared_ptr<DataFormat>& format, const uint8_t* data, size_t size)
+{
+    if (!pipelined)
+    {
+        writeRow(format.get(), data, size);
+        return;
+    }
+
+    MugRowBuffer* row;
+
+    // a stalled writer holds up this worker, whose inbox then fills and the subscriber starts dropping
+    while ((row = popPointer<MugRowBuffer>(*worker.freeRows)) == nullptr)
+    {
+        waitUntil(worker.wakeMutex, worker.wakeCv, worker.waiting, [&worker]()
+        {
+            return !worker.freeRows->empty();
+        });
+    }
+
+    row->format = format;
+    row->data.assign(data, data + size);
+
+    // the outbox can hold every row the worker owns, so this always fits
+    pushPointer(*worker.outbox, row);
+    wake(writerWakeMutex, writerWakeCv, writerWaiting);
+}
+
+/**
+* @brief Drops one row of a tap and counts it.  The tap's delta rows can't be rebuilt from here on, so they are
+* dropped too until its next keyframe.
+* @param worker is the decode stage the tap belongs to
+* @param uuid is the 16 byte uuid of the tap
+*/
+void Mug::dropRow(MugWorker& worker, const std::string& uuid)
+{
+    worker.deltaStates.erase(uuid);
+    droppedCount++;
+}
+
+/**
+* @brief Drops a malformed message, see dropRow()
+* @param worker is the decode stage the message was given to
+* @param message is the message, its tap is only known if the uuid frame is intact
+*/
+void Mug::dropMessage(MugWorker& worker, const MugMessage& message)
+{
+    if (message.count > 0 && message.frames[0].size() == UUID_SIZE_BYTES)
+    {
+        worker.deltaStates.erase(std::string(static_cast<const char*>(message.frames[0].data()), UUID_SIZE_BYTES));
+    }
+
+    droppedCount++;
+}
+
+/**
+* @brief Holds on to a row whose tap's format hasn't arrived yet, e.g. when rows beat the bartender's update.  Each
+* tap may park at most MUG_PARKED_ROWS_PER_TAP_MAX rows so one can't use up the worker's whole budget, and a tap whose
+* format hasn't arrived MUG_PARKED_ROWS_MAX_AGE_MILLIS after its first parked row has them discarded.
+* @param worker is the decode stage the tap belongs to, its row buffer holds the uuid, timestamp and row
+* @param uuid is the 16 byte uuid of the tap
+* @param size is the size of the row in the buffer, including the uuid and timestamp
+*/
+void Mug::parkRow(MugWorker& worker, const std::string& uuid, size_t size)
+{
+    // e.g. a tap we aren't subscribed to, whose rows can still arrive until the new filters are in place
+    if (isKnownWithoutFormat(uuid))
+    {
+        dropRow(worker, uuid);
+        return;
+    }
+
+    if (worker.parkedCount >= MUG_PARKED_ROWS_MAX)
+    {
+        // makes room if any tap has been waiting too long
+        flushParked(worker);
+    }
+
+    auto found = worker.parkedRows.find(uuid);
+
+    if (worker.parkedCount >= MUG_PARKED_ROWS_MAX ||
+        (found != worker.parkedRows.end() && found->second.rows.size() >= MUG_PARKED_ROWS_PER_TAP_MAX))
+    {
+        dropRow(worker, uuid);
+        return;
+    }
+
+    if (found == worker.parkedRows.end())
+    {
+        found = worker.parkedRows.insert(std::make_pair(uuid, MugParkedRows())).first;
+        found->second.since = std::chrono::steady_clock::now();
+    }
+
+    found->second.rows.push_back(std::vector<uint8_t>(worker.data.begin(), worker.data.begin() + size));
+    worker.parkedCount++;
+}
+
+/**
+* @brief Writes the rows parked for a tap now that its format is known
+* @param worker is the decode stage the tap belongs to
+* @param uuid is the 16 byte uuid of the tap
+* @param format is the tap's format, parked rows of another size are dropped
+*/
+void Mug::flushParked(MugWorker& worker, const std::string& uuid, const std::shared_ptr<DataFormat>& format)
+{
+    auto found = worker.parkedRows.find(uuid);
+
+    if (found == worker.parkedRows.end())
+    {
+        return;
+    }
+
+    size_t rowSize = format->getItemsSize();
+    std::vector<std::vector<uint8_t>>& rows = found->second.rows;
+
+    for (auto i = rows.begin(); i != rows.end(); ++i)
+    {
+        if (i->size() == UUID_SIZE_BYTES + TIMESTAMP_SIZE_BYTES + rowSize)
+        {
+            emitRow(worker, format, i->data(), i->size());
+        }
+        else
+        {
+            dropRow(worker, uuid);
+        }
+    }
+
+    worker.parkedCount -= rows.size();
+    worker.parkedRows.erase(found);
+}
+
+/**
+* @brief Writes the parked rows of every tap whose format is known by now, and discards those of taps that will never
+* get one: taps known to have no format and taps that have been waiting longer than MUG_PARKED_ROWS_MAX_AGE_MILLIS,
+* e.g. ones registered with another bartender
+* @param worker is the decode stage whose rows to write
+*/
+void Mug::flushParked(MugWorker& worker)
+{
+    const auto expired = std::chrono::steady_clock::now() -
+                         std::chrono::milliseconds(MUG_PARKED_ROWS_MAX_AGE_MILLIS);
+    std::vector<std::pair<std::string, std::shared_ptr<DataFormat>>> ready; // <uuid, format>
+
+    for (auto i = worker.parkedRows.begin(); i != worker.parkedRows.end();)
+    {
+        auto parked = i++;
+        std::shared_ptr<DataFormat> format = getFormat(parked->first);
+
+        if (format)
+        {
+            ready.push_back(std::make_pair(parked->first, format));
+        }
+        else if (parked->second.since < expired || isKnownWithoutFormat(parked->first))
+        {
+            discardParked(worker, parked);
+        }
+    }
+
+    for (auto i = ready.begin(); i != ready.end(); ++i)
+    {
+        flushParked(worker, i->first, i->second);
+    }
+}
+
+/**
+* @brief Drops every row parked for a tap, counting them as dropped
+* @param worker is the decode stage the tap belongs to
+* @param parked is the tap's entry in the worker's parked rows, erased
+*/
+void Mug::discardParked(MugWorker& worker, std::map<std::string, MugParkedRows>::iterator parked)
+{
+    worker.deltaStates.erase(parked->first);
+    droppedCount += parked->second.rows.size();
+    worker.parkedCount -= parked->second.rows.size();
+    worker.parkedRows.erase(parked);
+}
+
+/**
+* @brief Sets up the decode workers, their queues and buffers, and starts the decode and writer threads
+*/
+void Mug::startPipeline()
+{
+    workers.clear();
+    messagePool.resize(1);
+    rowPool.clear();
+
+    decodeStopping = false;
+    writeStopping = false;
+    writerWaiting = false;
+
+    for (size_t i = 0; i < pipelineThreads; ++i)
+    {
+        std::unique_ptr<MugWorker> worker(new MugWorker());
+
+        worker->inbox.reset(new RowRingBuffer(sizeof(MugMessage*), pipelineDepth));
+        worker->freeMessages.reset(new RowRingBuffer(sizeof(MugMessage*), pipelineDepth));
+        worker->outbox.reset(new RowRingBuffer(sizeof(MugRowBuffer*), pipelineDepth));
+        worker->freeRows.reset(new RowRingBuffer(sizeof(MugRowBuffer*), pipelineDepth));
+
+        for (size_t j = 0; j < pipelineDepth; ++j)
+        {
+            messagePool.push_back(std::unique_ptr<MugMessage>(new MugMessage()));
+            pushPointer(*worker->freeMessages, messagePool.back().get());
+
+            rowPool.push_back(std::unique_ptr<MugRowBuffer>(new MugRowBuffer()));
+            pushPointer(*worker->freeRows, rowPool.back().get());
+        }
+
+        workers.push_back(std::move(worker));
+    }
+
+    pipelined = true;
+
+    for (auto i = workers.begin(); i != workers.end(); ++i)
+    {
+        (*i)->thread = std::thread(&Mug::decodeThread, this, std::ref(**i));
+    }
+
+    writerThreadHandle = std::thread(&Mug::writerThread, this);
+}
+
+/**
+* @brief Lets the decode threads and then the writer finish whatever is queued and waits for them to end, the
+* subscriber thread must have ended already
+*/
+void Mug::stopPipeline()
+{
+    decodeStopping = true;
+
+    for (auto i = workers.begin(); i != workers.end(); ++i)
+    {
+        wake((*i)->wakeMutex, (*i)->wakeCv, (*i)->waiting);
+
+        if ((*i)->thread.joinable())
+        {
+            (*i)->thread.join();
+        }
+    }
+
+    writeStopping = true;
+    wake(writerWakeMutex, writerWakeCv, writerWaiting);
+
+    if (writerThreadHandle.joinable())
+    {
+        writerThreadHandle.join();
+    }
+
+    pipelined = false;
+}
+
+/**
+* @brief Decode stage of the pipeline, turns one worker's messages into rows for the writer
+* @param worker is the worker to run
+*/
+void Mug::decodeThread(MugWorker& worker)
+{
+    while (true)
+    {
+        MugMessage* message = popPointer<MugMessage>(*worker.inbox);
+
+        if (message)
+        {
+            try
+            {
+                decodeMessage(worker, *message);
+            }
+            catch (const std::runtime_error&)
+            {
+                dropMessage(worker, *message);
+            }
+
+            // the subscriber thread runs out of messages to receive into without it
+            pushPointer(*worker.freeMessages, message);
+            continue;
+        }
+
+        if (decodeStopping)
+        {
+            break;
+        }
+
+        if (worker.parkedCount > 0)
+        {
+            // formats for taps that have gone quiet may have arrived meanwhile
+            flushParked(worker);
+        }
+
+        // woken by the subscriber thread and stopPipeline(), otherwise back in time to check the parked rows again
+        waitUntil(worker.wakeMutex, worker.wakeCv, worker.waiting, [this, &worker]()
+        {
+            return !worker.inbox->empty() || decodeStopping;
+        });
+    }
+
+    flushParked(worker);
+}
+
+/**
+* @brief Write stage of the pipeline, the only thread that touches the keg and sinks.  Takes rows from every decode
+* worker in turn, so a tap's rows stay in order but rows of different taps may be reordered.
+*/
+void Mug::writerThread()
+{
+    while (true)
+    {
+        bool idle = true;
+
+        for (auto i = workers.begin(); i != workers.end(); ++i)
+        {
+            MugWorker& worker = **i;
+            MugRowBuffer* row;
+            bool freed = false;
+
+            while ((row = popPointer<MugRowBuffer>(*worker.outbox)) != nullptr)
+            {
+                writeRow(row->format.get(), row->data.data(), row->data.size());
+                pushPointer(*worker.freeRows, row);
+                freed = true;
+            }
+
+            // the worker may be waiting for a free row
+            if (freed)
+            {
+                wake(worker.wakeMutex, worker.wakeCv, worker.waiting);
+                idle = false;
+            }
+        }
+
+        if (!idle)
+        {
+            continue;
+        }
+
+        // every decode thread has ended before this is set, so an idle pass after it means nothing is left
+        if (writeStopping)
+        {
+            break;
+        }
+
+        waitUntil(writerWakeMutex, writerWakeCv, writerWaiting, [this]()
+        {
+            for (auto i = workers.begin(); i != workers.end(); ++i)
+            {
+                if (!(*i)->outbox->empty())
+                {
+                    return true;
+                }
+            }
+
+            return writeStopping.load();
+        });
+    }
+}
+
+/**
+* @brief The main data subscriber thread
+*/
+void Mug::subscriberThread()
+{
+    subscriberRunning = true;
+
+    // setting linger so the socket doesn't hang around after being stopped
+    int linger = 0;
+
+    try
+    {
+        if (!context)
+        {
+            if (running)
+            {
+                throw std::runtime_error("Mug::subscriberThread attempted to start with a NULL context");
+            }
+            else
+            {
+                mutex.lock();
+                subscriberRunning = false;
+                mutex.unlock();
+                return;
+            }
+        }
+
+        subscriber.reset(new zmq::socket_t(*context.get(), ZMQ_SUB));
+        subscriber->setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+        subscriber->connect(lager_utils::getRemoteUri(serverHost.c_str(), subscriberPort, transport).c_str());
+
+        // every tap until the first format update, unless there are subscriptions
+        std::set<std::string> installedFilters;
+        applyFilters(*subscriber, installedFilters);
+
+        // without a pipeline this is reused for every message, in one it is swapped for a decode worker's free one
+        MugMessage* message = messagePool.front().get();
+
+        // set up a poller for the subscriber socket
+        zmq::pollitem_t items[] = {{static_cast<void*>(*subscriber.get()), 0, ZMQ_POLLIN, 0}};
+
+#ifdef WITH_LTTNG
+        tracepoint(lager_tp, lager_tp_general, "Mug::subscriberThread()", "start");
+#endif
+
+        while (running)
+        {
+            // a shared context isn't shut down to end this thread, so it has to notice stop() on its own
+            zmq::poll(&items[0], 1, THREAD_CLOSE_WAIT_MILLIS);
+
+            if (filtersChanged)
+            {
+                applyFilters(*subscriber, installedFilters);
+            }
+
+            if (items[0].revents & ZMQ_POLLIN)
+            {
+                if (pipelined)
+                {
+                    receiveFrames(*subscriber, *message);
+                    dispatchMessage(message);
+                }
+                else
+                {
+                    receiveMessage(*subscriber, *message);
+                }
+            }
+            else if (!pipelined && workers.front()->parkedCount > 0)
+            {
+                // formats for taps that have gone quiet may have arrived meanwhile
+                flushParked(*workers.front());
+            }
+        }
+
+        if (!pipelined)
+        {
+            flushParked(*workers.front());
+        }
     }
     catch (const zmq::error_t& e)
     {
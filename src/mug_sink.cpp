@@ -0,0 +1,49 @@
+#include "lager/mug_sink.h"
+
+#include <stdexcept>
+
+/**
+* @brief Writes the uuid followed by the timestamp and row
+* @param row is the row to write
+*/
+void KegSink::write(const MugRow& row)
+{
+    keg->write(row.uuid, UUID_SIZE_BYTES);
+    keg->write(row.record(), row.recordSize());
+}
+
+/**
+* @brief Calls the callback with the row
+* @param row is the row to pass on
+*/
+void CallbackSink::write(const MugRow& row)
+{
+    callback(row);
+}
+
+/**
+* @brief Adds a sink after the ones already added
+* @param sink is the sink to add
+* @throws runtime_error on an empty sink
+*/
+void FanOutSink::add(const std::shared_ptr<MugSink>& sink)
+{
+    if (!sink)
+    {
+        throw std::runtime_error("attempted to add an empty sink");
+    }
+
+    sinks.push_back(sink);
+}
+
+/**
+* @brief Passes the row to every sink
+* @param row is the row to pass on
+*/
+void FanOutSink::write(const MugRow& row)
+{
+    for (auto i = sinks.begin(); i != sinks.end(); ++i)
+    {
+        (*i)->write(row);
+    }
+}
@@ -0,0 +1,523 @@
+#include "lager/row_converter.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "lager/byte_swap.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ROW_CONVERTER_X86_DISPATCH
+#include <immintrin.h>
+#endif
+
+namespace
+{
+    /**
+    * @brief Swaps count values of elementSize bytes one at a time
+    */
+    void swapValues(const uint8_t* src, uint8_t* dst, size_t elementSize, size_t count)
+    {
+        switch (elementSize)
+        {
+            case 2:
+                byte_swap::swapScalar<uint16_t>(src, dst, count);
+                break;
+
+            case 4:
+                byte_swap::swapScalar<uint32_t>(src, dst, count);
+                break;
+
+            case 8:
+                byte_swap::swapScalar<uint64_t>(src, dst, count);
+                break;
+
+            default:
+                if (src != dst)
+                {
+                    memcpy(dst, src, elementSize * count);
+                }
+
+                break;
+        }
+    }
+
+    /**
+    * @brief Swaps a single value, the common case for values straddling two windows
+    */
+    inline void swapOne(const uint8_t* src, uint8_t* dst, size_t elementSize)
+    {
+        uint16_t tmp16;
+        uint32_t tmp32;
+        uint64_t tmp64;
+
+        switch (elementSize)
+        {
+            case 2:
+                memcpy(&tmp16, src, sizeof(tmp16));
+                tmp16 = byte_swap::swap(tmp16);
+                memcpy(dst, &tmp16, sizeof(tmp16));
+                break;
+
+            case 4:
+                memcpy(&tmp32, src, sizeof(tmp32));
+                tmp32 = byte_swap::swap(tmp32);
+                memcpy(dst, &tmp32, sizeof(tmp32));
+                break;
+
+            case 8:
+                memcpy(&tmp64, src, sizeof(tmp64));
+                tmp64 = byte_swap::swap(tmp64);
+                memcpy(dst, &tmp64, sizeof(tmp64));
+                break;
+
+            default:
+                if (src != dst)
+                {
+                    memcpy(dst, src, elementSize);
+                }
+
+                break;
+        }
+    }
+
+    /**
+    * @brief Scalar kernel, runs the plan value by value
+    */
+    void convertScalar(const std::vector<SwapRun>& plan, const std::vector<ShuffleStep>&,
+                       const uint8_t* src, uint8_t* dst)
+    {
+        for (auto i = plan.begin(); i != plan.end(); ++i)
+        {
+            swapValues(src + i->offset, dst + i->offset, i->elementSize, i->count);
+        }
+    }
+
+#ifdef ROW_CONVERTER_X86_DISPATCH
+    // shuffle masks reversing every 2, 4 and 8 byte lane of a 16 byte vector
+    const uint8_t swapMask16[16] = {1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14};
+    const uint8_t swapMask32[16] = {3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12};
+    const uint8_t swapMask64[16] = {7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8};
+
+    const uint8_t* getSwapMask(size_t elementSize)
+    {
+        return elementSize == 2 ? swapMask16 : (elementSize == 4 ? swapMask32 : swapMask64);
+    }
+
+    /**
+    * @brief Swaps a run of count values of elementSize bytes, 16 bytes per shuffle
+    */
+    __attribute__((target("ssse3")))
+    void swapRunSsse3(const uint8_t* in, uint8_t* out, size_t elementSize, size_t count)
+    {
+        size_t bytes = elementSize * count;
+        size_t done = 0;
+
+        if (elementSize > 1)
+        {
+            __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(getSwapMask(elementSize)));
+
+            for (; done + 16 <= bytes; done += 16)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + done), _mm_shuffle_epi8(v, mask));
+            }
+        }
+
+        swapValues(in + done, out + done, elementSize, (bytes - done) / elementSize);
+    }
+
+    /**
+    * @brief Swaps a run of count values of elementSize bytes, 32 bytes per shuffle
+    */
+    __attribute__((target("avx2")))
+    void swapRunAvx2(const uint8_t* in, uint8_t* out, size_t elementSize, size_t count)
+    {
+        size_t bytes = elementSize * count;
+        size_t done = 0;
+
+        if (elementSize > 1)
+        {
+            __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(getSwapMask(elementSize)));
+            __m256i mask256 = _mm256_broadcastsi128_si256(mask);
+
+            for (; done + 32 <= bytes; done += 32)
+            {
+                __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + done));
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + done), _mm256_shuffle_epi8(v, mask256));
+            }
+
+            if (done + 16 <= bytes)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + done));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + done), _mm_shuffle_epi8(v, mask));
+                done += 16;
+            }
+        }
+
+        swapValues(in + done, out + done, elementSize, (bytes - done) / elementSize);
+    }
+
+    /**
+    * @brief SSSE3 kernel, one shuffle per 16 bytes
+    */
+    __attribute__((target("ssse3")))
+    void convertSsse3(const std::vector<SwapRun>&, const std::vector<ShuffleStep>& steps,
+                      const uint8_t* src, uint8_t* dst)
+    {
+        for (auto i = steps.begin(); i != steps.end(); ++i)
+        {
+            const uint8_t* in = src + i->offset;
+            uint8_t* out = dst + i->offset;
+
+            if (i->elementSize == 0)
+            {
+                if (i->count == 0 && src == dst)
+                {
+                    continue;
+                }
+
+                __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(i->mask));
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(v, mask));
+                continue;
+            }
+
+            if (i->count == 1)
+            {
+                swapOne(in, out, i->elementSize);
+                continue;
+            }
+
+            swapRunSsse3(in, out, i->elementSize, i->count);
+        }
+    }
+
+    /**
+    * @brief AVX2 kernel, same as SSSE3 but long runs go 32 bytes at a time
+    */
+    __attribute__((target("avx2")))
+    void convertAvx2(const std::vector<SwapRun>&, const std::vector<ShuffleStep>& steps,
+                     const uint8_t* src, uint8_t* dst)
+    {
+        for (auto i = steps.begin(); i != steps.end(); ++i)
+        {
+            const uint8_t* in = src + i->offset;
+            uint8_t* out = dst + i->offset;
+
+            if (i->elementSize == 0)
+            {
+                if (i->count == 0 && src == dst)
+                {
+                    continue;
+                }
+
+                __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(i->mask));
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(v, mask));
+                continue;
+            }
+
+            if (i->count == 1)
+            {
+                swapOne(in, out, i->elementSize);
+                continue;
+            }
+
+            swapRunAvx2(in, out, i->elementSize, i->count);
+        }
+    }
+#endif
+
+    struct RowKernel
+    {
+        void (*run)(const std::vector<SwapRun>& plan, const std::vector<ShuffleStep>& steps,
+                    const uint8_t* src, uint8_t* dst);
+        void (*swapRun)(const uint8_t* src, uint8_t* dst, size_t elementSize, size_t count);
+        const char* name;
+    };
+
+    /**
+    * @brief Picks the widest kernel the running CPU supports
+    */
+    RowKernel selectKernel()
+    {
+#ifdef ROW_CONVERTER_X86_DISPATCH
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return RowKernel{convertAvx2, swapRunAvx2, "avx2"};
+        }
+
+        if (__builtin_cpu_supports("ssse3"))
+        {
+            return RowKernel{convertSsse3, swapRunSsse3, "ssse3"};
+        }
+#endif
+
+        return RowKernel{convertScalar, swapValues, "scalar"};
+    }
+
+    /**
+    * @brief Gets the kernel, selected once on first use
+    */
+    const RowKernel& getKernel()
+    {
+        static const RowKernel kernel = selectKernel();
+        return kernel;
+    }
+}
+
+/**
+ * @brief Byte swaps count values of size bytes (2, 4 or 8) with the kernel selected for this CPU, the same one
+ * RowConverter uses for long runs
+ * @param src points to the values to swap
+ * @param dst points to room for count values, may be the same as src
+ * @param size is the size in bytes of one value
+ * @param count is the number of values
+ */
+void byte_swap::swapArray(const void* src, void* dst, size_t size, size_t count)
+{
+    getKernel().swapRun(static_cast<const uint8_t*>(src), static_cast<uint8_t*>(dst), size, count);
+}
+
+/**
+ * @brief Constructor, builds the swap plan from a list of columns
+ * @param items is a vector of DataItem describing each column
+ */
+RowConverter::RowConverter(const std::vector<DataItem>& items): rowSize(0), swapNeeded(byte_swap::isLittleEndian())
+{
+    buildPlan(items);
+    buildSteps();
+}
+
+/**
+ * @brief Constructor, builds the swap plan from a parsed data format
+ * @param format is the DataFormat of the rows to convert
+ */
+RowConverter::RowConverter(DataFormat& format): rowSize(0), swapNeeded(byte_swap::isLittleEndian())
+{
+    buildPlan(format.getItems());
+    buildSteps();
+}
+
+/**
+ * @brief Gets the name of the kernel selected for this CPU
+ * @returns "avx2", "ssse3" or "scalar"
+ */
+const char* RowConverter::getKernelName()
+{
+    return getKernel().name;
+}
+
+/**
+ * @brief Converts a host order row to network order
+ * @param src points to a row of getRowSize() bytes
+ * @param dst points to room for a row, may be the same as src
+ */
+void RowConverter::toNetwork(const uint8_t* src, uint8_t* dst) const
+{
+    convert(src, dst);
+}
+
+/**
+ * @brief Converts a network order row to host order
+ * @param src points to a row of getRowSize() bytes
+ * @param dst points to room for a row, may be the same as src
+ */
+void RowConverter::toHost(const uint8_t* src, uint8_t* dst) const
+{
+    // swapping is its own inverse
+    convert(src, dst);
+}
+
+/**
+ * @brief Sorts the columns by offset and merges neighbours with the same element size into runs.  Columns
+ * that aren't made of 2, 4 or 8 byte values and any gaps between columns become copy runs.
+ * @param items is a vector of DataItem describing each column
+ */
+void RowConverter::buildPlan(const std::vector<DataItem>& items)
+{
+    std::vector<DataItem> sorted(items);
+    std::sort(sorted.begin(), sorted.end(), [](const DataItem & a, const DataItem & b)
+    {
+        return a.offset < b.offset;
+    });
+
+    for (auto i = sorted.begin(); i != sorted.end(); ++i)
+    {
+        size_t offset = static_cast<size_t>(i->offset);
+        size_t elementSize = i->count > 0 ? i->size / i->count : i->size;
+
+        if (i->size == 0 || offset < rowSize)
+        {
+            continue;
+        }
+
+        if (offset > rowSize)
+        {
+            plan.push_back(SwapRun(rowSize, 1, offset - rowSize));
+        }
+
+        if ((elementSize != 2 && elementSize != 4 && elementSize != 8) || i->size % elementSize != 0)
+        {
+            elementSize = 1;
+        }
+
+        size_t count = i->size / elementSize;
+
+        if (!plan.empty() && plan.back().elementSize == elementSize
+                && plan.back().offset + plan.back().elementSize * plan.back().count == offset)
+        {
+            plan.back().count += count;
+        }
+        else
+        {
+            plan.push_back(SwapRun(offset, elementSize, count));
+        }
+
+        rowSize = offset + i->size;
+    }
+}
+
+/**
+ * @brief Builds the vector steps from the plan.  The row is cut into 16 byte windows at fixed positions and
+ * every value that sits entirely inside a window is swapped by that window's shuffle.  Windows never
+ * overlap, so converting in place doesn't stall on reloading bytes that were just stored.  Swap runs of
+ * 32 bytes or more are looped over directly instead, and the few values that straddle two windows or sit
+ * in the tail past the last full window are fixed up one at a time at the end.
+ */
+void RowConverter::buildSteps()
+{
+    const size_t windowSize = 16;
+    size_t windowCount = rowSize / windowSize;
+
+    std::vector<bool> inLongRun(rowSize, false);
+    std::vector<ShuffleStep> runSteps;
+    std::vector<ShuffleStep> fixups;
+
+    for (auto run = plan.begin(); run != plan.end(); ++run)
+    {
+        if (run->elementSize > 1 && run->elementSize * run->count >= 2 * windowSize)
+        {
+            ShuffleStep step = ShuffleStep();
+            step.offset = run->offset;
+            step.elementSize = run->elementSize;
+            step.count = run->count;
+            runSteps.push_back(step);
+
+            std::fill(inLongRun.begin() + run->offset, inLongRun.begin() + run->offset + run->elementSize * run->count, true);
+        }
+    }
+
+    std::vector<ShuffleStep> windows(windowCount);
+
+    for (size_t w = 0; w < windowCount; ++w)
+    {
+        windows[w].offset = w * windowSize;
+        windows[w].elementSize = 0;
+        windows[w].count = 0;
+
+        for (uint8_t b = 0; b < windowSize; ++b)
+        {
+            windows[w].mask[b] = b;
+        }
+    }
+
+    for (auto run = plan.begin(); run != plan.end(); ++run)
+    {
+        if (inLongRun[run->offset])
+        {
+            continue;
+        }
+
+        for (size_t i = 0; i < run->count; ++i)
+        {
+            size_t offset = run->offset + i * run->elementSize;
+            size_t w = offset / windowSize;
+            bool inWindow = (offset + run->elementSize - 1) / windowSize == w && w < windowCount;
+
+            if (run->elementSize == 1)
+            {
+                // copies only need work past the last window, where nothing else touches the bytes
+                if (!inWindow)
+                {
+                    if (!fixups.empty() && fixups.back().elementSize == 1
+                            && fixups.back().offset + fixups.back().count == offset)
+                    {
+                        fixups.back().count++;
+                    }
+                    else
+                    {
+                        ShuffleStep step = ShuffleStep();
+                        step.offset = offset;
+                        step.elementSize = 1;
+                        step.count = 1;
+                        fixups.push_back(step);
+                    }
+                }
+
+                continue;
+            }
+
+            if (inWindow)
+            {
+                size_t base = offset - w * windowSize;
+
+                for (size_t b = 0; b < run->elementSize; ++b)
+                {
+                    windows[w].mask[base + b] = static_cast<uint8_t>(base + run->elementSize - 1 - b);
+                }
+
+                windows[w].count++;
+            }
+            else
+            {
+                ShuffleStep step = ShuffleStep();
+                step.offset = offset;
+                step.elementSize = run->elementSize;
+                step.count = 1;
+                fixups.push_back(step);
+            }
+        }
+    }
+
+    // windows first, then the long runs and fixups which overwrite whatever the windows passed through
+    for (size_t w = 0; w < windowCount; ++w)
+    {
+        bool covered = true;
+
+        for (size_t b = 0; b < windowSize && covered; ++b)
+        {
+            covered = inLongRun[w * windowSize + b];
+        }
+
+        if (!covered)
+        {
+            steps.push_back(windows[w]);
+        }
+    }
+
+    steps.insert(steps.end(), runSteps.begin(), runSteps.end());
+    steps.insert(steps.end(), fixups.begin(), fixups.end());
+}
+
+/**
+ * @brief Runs the plan over a row
+ * @param src points to a row of getRowSize() bytes
+ * @param dst points to room for a row, may be the same as src
+ */
+void RowConverter::convert(const uint8_t* src, uint8_t* dst) const
+{
+    if (!swapNeeded)
+    {
+        if (src != dst)
+        {
+            memcpy(dst, src, rowSize);
+        }
+
+        return;
+    }
+
+    getKernel().run(plan, steps, src, dst);
+}
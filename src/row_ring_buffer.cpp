@@ -0,0 +1,172 @@
+#include "lager/row_ring_buffer.h"
+
+#include <stdexcept>
+
+/**
+ * @brief Constructor, preallocates all of the slots
+ * @param slotSize_in is the size in bytes of a single slot, rounded up to keep slots 8 byte aligned
+ * @param depth_in is the number of slots in the ring, rounded up to the next power of two
+ * @param multiProducer_in is true to allow any number of threads to write concurrently
+ * @throws runtime_error on a zero slot size or depth
+ */
+RowRingBuffer::RowRingBuffer(size_t slotSize_in, size_t depth_in, bool multiProducer_in):
+    multiProducer(multiProducer_in), head(0), tail(0)
+{
+    if (slotSize_in == 0 || depth_in == 0)
+    {
+        throw std::runtime_error("RowRingBuffer requires a non-zero slot size and depth");
+    }
+
+    slotSize = (slotSize_in + 7) & ~static_cast<size_t>(7);
+
+    depth = 1;
+
+    while (depth < depth_in)
+    {
+        depth <<= 1;
+    }
+
+    mask = depth - 1;
+
+    buffer.resize(slotSize * depth);
+
+    if (multiProducer)
+    {
+        // slot i is free for the producer claiming position i, and readable once its sequence reaches i + 1
+        sequence.reset(new std::atomic<size_t>[depth]);
+
+        for (size_t i = 0; i < depth; ++i)
+        {
+            sequence[i].store(i, std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Reserves the next free slot for the producer
+ * @returns a pointer to the slot to fill, or nullptr if the ring is full
+ */
+uint8_t* RowRingBuffer::beginWrite()
+{
+    size_t currentHead = head.load(std::memory_order_relaxed);
+
+    if (!multiProducer)
+    {
+        if (currentHead - tail.load(std::memory_order_acquire) >= depth)
+        {
+            return nullptr;
+        }
+
+        return buffer.data() + (currentHead & mask) * slotSize;
+    }
+
+    while (true)
+    {
+        size_t slotSequence = sequence[currentHead & mask].load(std::memory_order_acquire);
+        ptrdiff_t diff = static_cast<ptrdiff_t>(slotSequence - currentHead);
+
+        if (diff < 0)
+        {
+            // the slot still holds the row from one lap ago
+            return nullptr;
+        }
+
+        if (diff == 0 && head.compare_exchange_weak(currentHead, currentHead + 1, std::memory_order_relaxed,
+                                                    std::memory_order_relaxed))
+        {
+            return buffer.data() + (currentHead & mask) * slotSize;
+        }
+
+        if (diff > 0)
+        {
+            // another producer claimed this position first
+            currentHead = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Makes the slot returned by the last beginWrite() visible to the consumer, single producer mode only
+ */
+void RowRingBuffer::commitWrite()
+{
+    head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Makes a slot returned by beginWrite() visible to the consumer, works in either mode
+ * @param slot is the pointer returned by beginWrite()
+ */
+void RowRingBuffer::commitWrite(uint8_t* slot)
+{
+    if (!multiProducer)
+    {
+        commitWrite();
+        return;
+    }
+
+    size_t index = static_cast<size_t>(slot - buffer.data()) / slotSize;
+
+    // only the claiming producer touches the slot's sequence until it is published
+    sequence[index].store(sequence[index].load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Gets the oldest committed slot for the consumer, which may modify it in place until commitRead()
+ * @returns a pointer to the slot to read, or nullptr if the ring is empty
+ */
+uint8_t* RowRingBuffer::beginRead()
+{
+    size_t currentTail = tail.load(std::memory_order_relaxed);
+
+    if (multiProducer)
+    {
+        // a claimed slot whose producer hasn't committed yet reads as empty
+        if (sequence[currentTail & mask].load(std::memory_order_acquire) != currentTail + 1)
+        {
+            return nullptr;
+        }
+    }
+    else if (currentTail == head.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+
+    return buffer.data() + (currentTail & mask) * slotSize;
+}
+
+/**
+ * @brief Releases the slot returned by the last beginRead() back to the producer
+ */
+void RowRingBuffer::commitRead()
+{
+    size_t currentTail = tail.load(std::memory_order_relaxed);
+
+    if (multiProducer)
+    {
+        // free for the producer claiming the same slot one lap later
+        sequence[currentTail & mask].store(currentTail + depth, std::memory_order_release);
+    }
+
+    tail.store(currentTail + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Checks for committed slots waiting to be read.  In multi producer mode slots still being written count too.
+ * @returns true if there is nothing to read
+ */
+bool RowRingBuffer::empty() const
+{
+    return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Gets the number of committed slots waiting to be read
+ * @returns the number of slots
+ */
+size_t RowRingBuffer::size() const
+{
+    // tail is read first so it can never be ahead of the head that's read after it
+    size_t currentTail = tail.load(std::memory_order_acquire);
+    return head.load(std::memory_order_acquire) - currentTail;
+}
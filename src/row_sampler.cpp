@@ -0,0 +1,178 @@
+#include "lager/row_sampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace
+{
+    /**
+    * @brief Checks whether any value moved by more than the deadband allows
+    */
+    template<class T>
+    bool exceedsDeadband(const uint8_t* current, const uint8_t* last, size_t count, const Deadband& deadband)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            T now;
+            T before;
+            memcpy(&now, current + i * sizeof(T), sizeof(T));
+            memcpy(&before, last + i * sizeof(T), sizeof(T));
+
+            if (std::isnan(now) || std::isnan(before))
+            {
+                if (std::isnan(now) != std::isnan(before))
+                {
+                    return true;
+                }
+
+                continue;
+            }
+
+            double threshold = std::max(deadband.absolute, deadband.relative * std::fabs(static_cast<double>(before)));
+
+            if (std::fabs(static_cast<double>(now) - static_cast<double>(before)) > threshold)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+}
+
+/**
+ * @brief Constructor, builds the comparison plan from the row layout
+ * @param items is a vector of DataItem describing each column
+ * @param minIntervalNanos_in is the least time between logged rows, 0 for no limit
+ * @param logOnChange_in is true to only log rows where some column changed
+ * @param deadbands holds the deadband of each float32 or float64 column by name, any deadband implies log on change
+ * @throws runtime_error if a deadband names a column that doesn't exist or isn't floating point
+ */
+RowSampler::RowSampler(const std::vector<DataItem>& items, uint64_t minIntervalNanos_in, bool logOnChange_in,
+                       const std::map<std::string, Deadband>& deadbands): minIntervalNanos(minIntervalNanos_in),
+    lastTimestamp(0), changeGated(logOnChange_in || !deadbands.empty()), hasLast(false)
+{
+    std::vector<DataItem> sorted(items);
+    std::sort(sorted.begin(), sorted.end(), [](const DataItem & a, const DataItem & b)
+    {
+        return a.offset < b.offset;
+    });
+
+    size_t rowSize = 0;
+    size_t found = 0;
+
+    for (auto i = sorted.begin(); i != sorted.end(); ++i)
+    {
+        size_t offset = static_cast<size_t>(i->offset);
+        rowSize = std::max(rowSize, offset + i->size);
+
+        auto deadband = deadbands.find(i->name);
+
+        if (deadband != deadbands.end())
+        {
+            if (i->type != "float32" && i->type != "float64")
+            {
+                throw std::runtime_error("deadband set on non floating point column " + i->name);
+            }
+
+            plan.push_back(SampleRange(offset, i->size, i->type == "float32" ? sizeof(float) : sizeof(double),
+                                       deadband->second));
+            found++;
+            continue;
+        }
+
+        if (!plan.empty() && plan.back().elementSize == 0 && plan.back().offset + plan.back().size == offset)
+        {
+            plan.back().size += i->size;
+        }
+        else
+        {
+            plan.push_back(SampleRange(offset, i->size, 0, Deadband()));
+        }
+    }
+
+    if (found != deadbands.size())
+    {
+        throw std::runtime_error("deadband set on a column that doesn't exist");
+    }
+
+    lastRow.assign(changeGated ? rowSize : 0, 0);
+}
+
+/**
+ * @brief Checks whether enough time has passed since the last logged row
+ * @param timestamp is the time of the row being logged, in nanoseconds
+ * @returns true if the row may be logged
+ */
+bool RowSampler::isDue(uint64_t timestamp) const
+{
+    // a clock stepping backwards counts as due rather than silencing the tap until it catches up
+    return !hasLast || minIntervalNanos == 0 || timestamp < lastTimestamp ||
+           timestamp - lastTimestamp >= minIntervalNanos;
+}
+
+/**
+ * @brief Compares a row against the last logged one, always true when not change gated or nothing was logged yet
+ * @param row is the captured host order row
+ * @returns true if any column without a deadband changed or any deadband column moved past its deadband
+ */
+bool RowSampler::hasChanged(const uint8_t* row) const
+{
+    if (!changeGated || !hasLast)
+    {
+        return true;
+    }
+
+    for (auto i = plan.begin(); i != plan.end(); ++i)
+    {
+        const uint8_t* current = row + i->offset;
+        const uint8_t* last = lastRow.data() + i->offset;
+
+        switch (i->elementSize)
+        {
+            case 0:
+                if (memcmp(current, last, i->size) != 0)
+                {
+                    return true;
+                }
+
+                break;
+
+            case sizeof(float):
+                if (exceedsDeadband<float>(current, last, i->size / sizeof(float), i->deadband))
+                {
+                    return true;
+                }
+
+                break;
+
+            default:
+                if (exceedsDeadband<double>(current, last, i->size / sizeof(double), i->deadband))
+                {
+                    return true;
+                }
+
+                break;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * @brief Records a row as logged, it becomes the reference for the interval and change checks
+ * @param timestamp is the time of the row, in nanoseconds
+ * @param row is the captured host order row, only read when change gated
+ */
+void RowSampler::logged(uint64_t timestamp, const uint8_t* row)
+{
+    lastTimestamp = timestamp;
+    hasLast = true;
+
+    if (changeGated)
+    {
+        memcpy(lastRow.data(), row, lastRow.size());
+    }
+}
@@ -1,16 +1,23 @@
 #include "lager/tap.h"
 
-Tap::Tap(): publisherPort(0), running(false), newData(false), flags(0), offsetCount(0), timestamp(0),
-    publisherRunning(false)
+Tap::Tap(): snapshotLock(nullptr), batchData(nullptr), batchSize(0), droppedCount(0), filteredCount(0), tornCount(0),
+    minIntervalNanos(0), flags(0), publisherPort(0), offsetCount(0), queueDepth(TAP_QUEUE_DEPTH_DEFAULT),
+    bufferPoolSize(TAP_BUFFER_POOL_SIZE_DEFAULT), batchMaxRows(1), batchRows(0), batchLingerMicros(0),
+    runtimePublisherId(0), idleWait(std::chrono::milliseconds(TAP_IDLE_WAKE_MILLIS)),
+    realtimePollMicros(TAP_REALTIME_POLL_MICROS_DEFAULT), deltaKeyframeInterval(TAP_DELTA_KEYFRAME_INTERVAL_DEFAULT),
+    rowsSinceKeyframe(0), deltaSequence(0), overflowPolicy(TapOverflowPolicy::DROP_NEWEST),
+    transport(LagerTransport::TCP), packedPayload(false), busySpin(false), deltaEncoding(false), nativeByteOrder(false),
+    littleEndianPayload(false), embedded(false), logOnChange(false), multiProducer(false), realtime(false),
+    fixedLayout(false), running(false), publisherWaiting(false), publisherRunning(false)
 {
 }
 
 Tap::~Tap()
 {
-    // TODO make these smart pointers
-    for (auto i = dataRefItems.begin(); i != dataRefItems.end(); ++i)
+    // the runtime's reactor must not call into a destroyed tap
+    if (runtime && runtimePublisherId != 0)
     {
-        delete (*i);
+        runtime->removePublisher(runtimePublisherId);
     }
 }
 
@@ -37,53 +44,137 @@ bool Tap::init(const std::string& serverHost_in, int basePort, int timeOutMillis
     serverHost = serverHost_in;
 
     // TODO make this not magic 2000 default timeout for testing
-    chpClient.reset(new ClusteredHashmapClient(serverHost_in, basePort, timeOutMillis));
+    chpClient.reset(new ClusteredHashmapClient(serverHost_in, basePort, timeOutMillis, transport));
     chpClient->init(context, uuid);
 
     return true;
 }
 
+/**
+* @brief Initializes the tap to use a shared runtime's zmq context, CHP client and publishing thread instead of its own
+* @param runtime_in is the runtime to share, e.g. LagerRuntime::getDefault()
+* @param serverHost_in is a string containing the IP address or hostname of the bartender to connect to
+* @param basePort is an integer containing the port of the bartender to connect to
+* @param timeOutMillis is the timeout to the bartender, if this is the first user of the runtime's client for it
+* @returns true on success, false on failure
+*/
+bool Tap::init(const std::shared_ptr<LagerRuntime>& runtime_in, const std::string& serverHost_in, int basePort,
+               int timeOutMillis)
+{
+    publisherPort = basePort + FORWARDER_FRONTEND_OFFSET;
+
+    if (!runtime_in || publisherPort < 0 || publisherPort > BASEPORT_MAX)
+    {
+        return false;
+    }
+
+    runtime = runtime_in;
+    context = runtime->getContext();
+
+    uuid = lager_utils::getUuid();
+    serverHost = serverHost_in;
+
+    chpClient = runtime->getChpClient(serverHost_in, basePort, timeOutMillis, transport);
+
+    return true;
+}
+
 /**
 * @brief Adds a new data column item to the tap which contains a reference to actual user data being logged
 * @param item is an DataRefItem inherited, templated object containing the info about a particular column as
-* well as a reference to the actual data.
+* well as a reference to the actual data.  The tap takes ownership, and deletes it right away if its name is
+* already used.
+* @throws runtime_error if the tap's columns are fixed, the item is deleted
 */
 void Tap::addItem(AbstractDataRefItem* item)
 {
-    bool dupeCheck = false;
+    insertItem(item);
+}
 
-    for (unsigned int i = 0; i < dataRefItems.size(); i++)
+/**
+* @brief Adds many data column items at once, in order, as if by addItem() on each.  Wide taps should prefer this,
+* the storage is grown once for the whole batch.
+* @param items is a vector of DataRefItem inherited objects, the tap takes ownership of all of them
+* @throws runtime_error if the tap's columns are fixed, all the items are deleted
+*/
+void Tap::addItems(const std::vector<AbstractDataRefItem*>& items)
+{
+    if (fixedLayout)
     {
-        if (dataRefItems[i]->getName() == item->getName())
+        for (auto i = items.begin(); i != items.end(); ++i)
         {
-            dupeCheck = true;
-            break;
+            delete *i;
         }
+
+        throw std::runtime_error("Tap columns are fixed, items can't be added");
     }
 
-    if (dupeCheck == false)
+    ownedItems.reserve(ownedItems.size() + items.size());
+    dataRefItems.reserve(dataRefItems.size() + items.size());
+    itemNames.reserve(itemNames.size() + items.size());
+
+    for (auto i = items.begin(); i != items.end(); ++i)
     {
-        // set the offset of the new item based on order of addition
-        item->setOffset(offsetCount);
+        insertItem(*i);
+    }
+}
 
-        dataRefItems.push_back(item);
+/**
+* @brief Returns the vector of Items, still owned by the tap
+* @return dataRefItems
+*/
+const std::vector<AbstractDataRefItem*>& Tap::getItems() const
+{
+    return dataRefItems;
+}
 
-        // keeps track of the offset for later generation of the data format xml
-        offsetCount += item->getSize();
+/**
+* @brief Takes ownership of an item and appends it as the next column unless its name is already used
+* @param item is the item to add
+* @throws runtime_error if the tap's columns are fixed, the item is deleted
+*/
+void Tap::insertItem(AbstractDataRefItem* item)
+{
+    std::unique_ptr<AbstractDataRefItem> owned(item);
+
+    // a subclass with a fixed layout captures its own columns, an added item would shift the row it registers
+    if (fixedLayout)
+    {
+        throw std::runtime_error("Tap columns are fixed, items can't be added");
     }
-    else
+
+    if (!itemNames.insert(item->getName()).second)
     {
         std::clog << "Duplicate References found at key: " << item->getName() << std::endl;
+        return;
     }
+
+    // set the offset of the new item based on order of addition
+    item->setOffset(offsetCount);
+
+    ownedItems.push_back(std::move(owned));
+    dataRefItems.push_back(item);
+
+    // keeps track of the offset for later generation of the data format xml
+    offsetCount += item->getSize();
 }
 
 /**
-* @brief Returns the vector of Items
-* @return dataRefItems
+* @brief Returns the row layout the tap registers, one DataItem per column
+* @return a vector of DataItem in offset order
 */
-std::vector<AbstractDataRefItem*> Tap::getItems() const
+std::vector<DataItem> Tap::getFormatItems() const
 {
-    return dataRefItems;
+    std::vector<DataItem> items;
+    items.reserve(dataRefItems.size());
+
+    for (auto i = dataRefItems.begin(); i != dataRefItems.end(); ++i)
+    {
+        items.push_back(DataItem((*i)->getName(), (*i)->getType(), (*i)->getSize(), (*i)->getOffset(),
+                                (*i)->getCount()));
+    }
+
+    return items;
 }
 
 /**
@@ -93,29 +184,101 @@ std::vector<AbstractDataRefItem*> Tap::getItems() const
 */
 void Tap::start(const std::string& key_in)
 {
-    if (dataRefItems.empty())
+    formatItems = getFormatItems();
+
+    if (formatItems.empty())
     {
         throw std::runtime_error("Tap started with zero data items");
     }
 
+    if (embedded && !runtime)
+    {
+        throw std::runtime_error("Tap embedded mode requires a LagerRuntime");
+    }
+
+    if (realtime && overflowPolicy == TapOverflowPolicy::BLOCK)
+    {
+        throw std::runtime_error("Tap realtime mode can't block on a full queue");
+    }
+
+    // with nobody waking it, a realtime tap's publisher has to come back on its own
+    idleWait = realtime ? std::chrono::microseconds(realtimePollMicros) :
+               std::chrono::microseconds(std::chrono::milliseconds(TAP_IDLE_WAKE_MILLIS));
+
     std::unique_lock<std::mutex> lock(mutex);
 
     // TODO this should probably be compiled in from the cmake or something
     version = "BEERR01";
+    key = key_in;
 
-    DataFormatParser p;
+    // native order only changes anything on little endian hosts, elsewhere it already is network order.  Embedded
+    // rows never leave the process, so they are always written as captured.
+    littleEndianPayload = (nativeByteOrder || embedded) && byte_swap::isLittleEndian();
 
-    if (p.createFromDataRefItems(dataRefItems, version, key_in))
+    // streamed straight from the items, so starting a tap needs neither Xerces nor the schema file
+    formatStr = DataFormatWriter::fromDataItems(formatItems, version, key_in, littleEndianPayload);
+
+    // every slot holds the network order timestamp followed by the host order row
+    ringBuffer.reset(new RowRingBuffer(TIMESTAMP_SIZE_BYTES + offsetCount, queueDepth, multiProducer));
+    rowConverter.reset(new RowConverter(formatItems));
+    buildCapturePlan();
+    droppedCount = 0;
+    filteredCount = 0;
+    tornCount = 0;
+
+    if (minIntervalNanos > 0 || logOnChange || !deadbands.empty())
     {
-        formatStr = p.getXmlStr();
+        // the sampler compares each row against the one logged before it, which only means something in one thread
+        if (multiProducer)
+        {
+            throw std::runtime_error("Tap sampling policies require a single producer");
+        }
+
+        rowSampler.reset(new RowSampler(formatItems, minIntervalNanos, logOnChange, deadbands));
     }
     else
     {
-        throw std::runtime_error("unable to build xml format of tap");
+        rowSampler.reset();
     }
 
+    sampleRow.resize(rowSampler && rowSampler->isChangeGated() ? offsetCount : 0);
+
+    buildPayloadBuffers();
+
     running = true;
 
+    if (runtime)
+    {
+        // the runtime's client is already running and publishes each key under its own tap's uuid
+        chpClient->addOrUpdateKeyValue(key_in, formatStr, uuid);
+
+        if (embedded)
+        {
+            runtimePublisherId = runtime->addEmbeddedPublisher([this]()
+            {
+                return deliverPending();
+            },
+            [this]()
+            {
+                return !ringBuffer->empty();
+            });
+
+            return;
+        }
+
+        runtimePublisherId = runtime->addPublisher(lager_utils::getRemoteUri(serverHost, publisherPort, transport),
+                                                   [this](zmq::socket_t & publisher)
+        {
+            return publishPending(publisher);
+        },
+        [this]()
+        {
+            return !ringBuffer->empty();
+        });
+
+        return;
+    }
+
     chpClient->start();
     // sets the hashmap value so it will be sent to the bartender
     chpClient->addOrUpdateKeyValue(key_in, formatStr);
@@ -135,15 +298,36 @@ void Tap::start(const std::string& key_in)
 */
 void Tap::stop()
 {
-    mutex.lock();
     running = false;
-    mutex.unlock();
+
+    if (runtime)
+    {
+        // the context and client belong to the runtime and stay up for the other taps.  Removing the publisher gives
+        // it one last pass, which sends whatever is still queued.
+        runtime->removePublisher(runtimePublisherId);
+        runtimePublisherId = 0;
+
+        releaseBatch();
+        chpClient->untrackKey(key);
+        return;
+    }
+
+    wakePublisher();
+
+    unsigned int retries = 0;
+
+    // the publisher sends the rows still queued on its way out, which needs the context
+    while (publisherRunning && retries <= THREAD_CLOSE_WAIT_RETRIES)
+    {
+        lager_utils::sleepMillis(THREAD_CLOSE_WAIT_MILLIS);
+        retries++;
+    }
 
     chpClient->stop();
 
     zmq_ctx_shutdown((void*)*context.get());
 
-    unsigned int retries = 0;
+    retries = 0;
 
     while (publisherRunning)
     {
@@ -160,16 +344,331 @@ void Tap::stop()
 }
 
 /**
-* @brief Logs the data references set up by the tap with the current system timestamp
-* The newData flag indicates to the publisher thread that it needs to publish again
+* @brief Hands rows straight to the runtime's row sinks (e.g. an embedded Mug) instead of publishing them through the
+* Forwarder, must be called before start() and requires a tap initialized with a LagerRuntime.  Registration with the
+* bartender is unchanged, but batching, delta encoding and packing don't apply since rows are never serialized.
+* @param enabled is true to skip zmq for data
+*/
+void Tap::setEmbedded(bool enabled)
+{
+    embedded = enabled;
+}
+
+/**
+* @brief Lets any number of threads call log() on this tap at once without locking, must be called before start()
+* Each row is still captured whole by the thread logging it.  Rows from different threads are queued in the order
+* they claimed a slot, which may differ from timestamp order by the time it took to capture them.  Sampling policies
+* can't be combined with it.
+* @param enabled is true to allow concurrent log() calls
+*/
+void Tap::setMultiProducer(bool enabled)
+{
+    multiProducer = enabled;
+}
+
+/**
+* @brief Makes log() safe to call from a realtime thread, must be called before start()
+* log() never takes a lock, allocates or throws: everything it touches is allocated at start(), and instead of
+* waking the publisher (which takes a mutex when it is asleep) it leaves the publisher to poll the queue every
+* pollMicros.  A full queue drops the row and counts it in getDroppedCount(), so the BLOCK overflow policy is
+* rejected.  Items added by the user must not allocate in getHostDataRef() either.
+* @param enabled is true for the realtime log path
+* @param pollMicros is how often the publisher checks the queue, which bounds the added latency
+*/
+void Tap::setRealtime(bool enabled, unsigned int pollMicros)
+{
+    realtime = enabled;
+    realtimePollMicros = pollMicros > 0 ? pollMicros : 1;
+}
+
+/**
+* @brief Selects the clock log() timestamps rows with, must be called before start()
+* @param source is the clock source, LagerClockSource::REALTIME by default
+* @throws runtime_error if the source isn't supported on this machine
+*/
+void Tap::setClock(LagerClockSource source)
+{
+    clock = LagerClock(source);
+}
+
+/**
+* @brief Limits how often rows are logged, calls to log() sooner than 1 / rowsPerSecond after the last logged row are
+* skipped.  Same as setMinInterval(), must be called before start().
+* @param rowsPerSecond is the highest rate to log at, 0 for no limit
+*/
+void Tap::setMaxRate(double rowsPerSecond)
+{
+    minIntervalNanos = rowsPerSecond > 0 ? static_cast<uint64_t>(1e9 / rowsPerSecond) : 0;
+}
+
+/**
+* @brief Sets the least time between logged rows, calls to log() sooner than that after the last logged row are
+* skipped.  Must be called before start().
+* @param intervalMicros is the minimum interval in microseconds, 0 for no limit
+*/
+void Tap::setMinInterval(unsigned int intervalMicros)
+{
+    minIntervalNanos = static_cast<uint64_t>(intervalMicros) * 1000;
+}
+
+/**
+* @brief Only logs rows where some column changed since the last logged row, must be called before start()
+* @param enabled is true to skip unchanged rows
+*/
+void Tap::setLogOnChange(bool enabled)
+{
+    logOnChange = enabled;
+}
+
+/**
+* @brief Sets a deadband on a float32 or float64 column, a change only counts once it is larger than the absolute
+* deadband or the relative one times the last logged value, whichever is larger.  Setting any deadband turns on
+* log on change for the whole row.  Must be called before start().
+* @param column is the name of the column
+* @param absolute is the absolute deadband
+* @param relative is the relative deadband, e.g. 0.01 for 1%
+* @throws runtime_error at start() if the column doesn't exist or isn't floating point
+*/
+void Tap::setDeadband(const std::string& column, double absolute, double relative)
+{
+    deadbands[column] = Deadband(absolute, relative);
+}
+
+/**
+* @brief Logs the data references set up by the tap, timestamped with the tap's clock (see setClock())
 */
-// TODO allow user to pass the timestamp in
 void Tap::log()
 {
-    mutex.lock();
-    timestamp = lager_utils::getCurrentTime();
-    newData = true;
-    mutex.unlock();
+    log(clock.now());
+}
+
+/**
+* @brief Logs the data references set up by the tap with the given timestamp, e.g. one the data's source already
+* produced, so no clock has to be read per row
+* The referenced values are captured into the next free queue slot so the publisher thread can send them
+* later without touching user memory.  Rows the sampling policy doesn't want are counted as filtered and never
+* queued.  When the queue is full the configured TapOverflowPolicy applies.
+* @param timestamp is the time of the row in nanoseconds, epoch based unless the tap's users agree otherwise
+*/
+void Tap::log(uint64_t timestamp)
+{
+    if (!running || !ringBuffer)
+    {
+        return;
+    }
+
+    if (rowSampler)
+    {
+        if (!rowSampler->isDue(timestamp))
+        {
+            filteredCount++;
+            return;
+        }
+
+        // the row has to be captured before it can be compared, but a slot is only taken if it changed
+        if (rowSampler->isChangeGated())
+        {
+            captureSnapshot(sampleRow.data());
+
+            if (!rowSampler->hasChanged(sampleRow.data()))
+            {
+                filteredCount++;
+                return;
+            }
+        }
+    }
+
+    uint8_t* slot = ringBuffer->beginWrite();
+
+    if (!slot)
+    {
+        if (overflowPolicy == TapOverflowPolicy::DROP_NEWEST)
+        {
+            droppedCount++;
+            return;
+        }
+
+        while (!(slot = ringBuffer->beginWrite()))
+        {
+            if (!running)
+            {
+                return;
+            }
+
+            std::this_thread::yield();
+        }
+    }
+
+    uint64_t networkTimestamp = lager_utils::htonll(timestamp);
+    memcpy(slot, &networkTimestamp, TIMESTAMP_SIZE_BYTES);
+
+    if (!sampleRow.empty())
+    {
+        memcpy(slot + TIMESTAMP_SIZE_BYTES, sampleRow.data(), sampleRow.size());
+    }
+    else
+    {
+        captureSnapshot(slot + TIMESTAMP_SIZE_BYTES);
+    }
+
+    if (rowSampler)
+    {
+        rowSampler->logged(timestamp, slot + TIMESTAMP_SIZE_BYTES);
+    }
+
+    ringBuffer->commitWrite(slot);
+
+    if (realtime)
+    {
+        return;
+    }
+
+    // pairs with the fence in waitForRows() so either the publisher sees this row or we see it waiting
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (runtime ? runtime->isWaiting() : publisherWaiting.load(std::memory_order_relaxed))
+    {
+        wakePublisher();
+    }
+}
+
+/**
+* @brief Builds the capture plan from the items, columns that follow each other both in the row and in user memory
+* (e.g. the members of a struct, or the elements of one array added as separate columns) are merged into one copy
+*/
+void Tap::buildCapturePlan()
+{
+    capturePlan.clear();
+
+    for (auto i = dataRefItems.begin(); i != dataRefItems.end(); ++i)
+    {
+        const uint8_t* source = static_cast<const uint8_t*>((*i)->getDataRef());
+        size_t offset = static_cast<size_t>((*i)->getOffset());
+
+        if (source && !capturePlan.empty() && capturePlan.back().source &&
+                capturePlan.back().source + capturePlan.back().size == source &&
+                capturePlan.back().offset + capturePlan.back().size == offset)
+        {
+            capturePlan.back().size += (*i)->getSize();
+        }
+        else
+        {
+            capturePlan.push_back(CaptureRun(source, *i, offset, (*i)->getSize()));
+        }
+    }
+}
+
+/**
+* @brief Sets a sequence lock the user updates the referenced values under, log() then only records rows where no
+* update overlapped the capture, retrying up to TAP_SNAPSHOT_RETRIES times.  Rows still overlapped after that are
+* logged anyway and counted by getTornCount(), so log() never waits on the writer.  Must be called before start().
+* @param lock is the lock, which must outlive the tap, or nullptr for none
+*/
+void Tap::setSnapshotLock(const SeqLock* lock)
+{
+    snapshotLock = lock;
+}
+
+/**
+* @brief Captures the row, as a consistent snapshot if a snapshot lock is set
+* @param row is a buffer of at least the row size, laid out by the item offsets
+*/
+void Tap::captureSnapshot(uint8_t* row)
+{
+    if (!snapshotLock)
+    {
+        captureRow(row);
+        return;
+    }
+
+    for (unsigned int attempt = 0; ; ++attempt)
+    {
+        uint64_t sequence = snapshotLock->readBegin();
+
+        captureRow(row);
+
+        if (!snapshotLock->readRetry(sequence))
+        {
+            return;
+        }
+
+        if (attempt == TAP_SNAPSHOT_RETRIES)
+        {
+            tornCount++;
+            return;
+        }
+    }
+}
+
+/**
+* @brief Copies the current value of every column into the given row in host order, one copy per run of the
+* capture plan.  The publisher thread converts the whole row to network order in one pass before sending it.
+* @param row is a buffer of at least the row size, laid out by the item offsets
+*/
+void Tap::captureRow(uint8_t* row)
+{
+    for (auto i = capturePlan.begin(); i != capturePlan.end(); ++i)
+    {
+        uint8_t* destination = row + i->offset;
+
+        if (!i->source)
+        {
+            i->item->getHostDataRef(destination);
+            continue;
+        }
+
+        // fixed size copies compile to a single move, only longer runs are worth a call to memcpy
+        switch (i->size)
+        {
+            case 1:
+                memcpy(destination, i->source, 1);
+                break;
+
+            case 2:
+                memcpy(destination, i->source, 2);
+                break;
+
+            case 4:
+                memcpy(destination, i->source, 4);
+                break;
+
+            case 8:
+                memcpy(destination, i->source, 8);
+                break;
+
+            default:
+                memcpy(destination, i->source, i->size);
+                break;
+        }
+    }
+}
+
+/**
+* @brief Sizes the delta and batch buffers and the buffer pool for the format items and resets the delta and batch
+* state, called by start()
+*/
+void Tap::buildPayloadBuffers()
+{
+    // a delta encoded row is never larger than the sequence number and bitmap plus the full row
+    size_t maxRowSize = offsetCount + (deltaEncoding ? DELTA_SEQUENCE_SIZE_BYTES + (formatItems.size() + 7) / 8 : 0);
+
+    deltaBuffer.resize(deltaEncoding ? maxRowSize : 0);
+    lastSentRow.assign(deltaEncoding ? offsetCount : 0, 0);
+    rowsSinceKeyframe = 0;
+    deltaSequence = 0;
+
+    size_t batchCapacity = batchMaxRows > 1 ?
+                           batchMaxRows * (TIMESTAMP_SIZE_BYTES + BATCH_ROW_LENGTH_SIZE_BYTES + maxRowSize) : 0;
+
+    batchBuffer.resize(batchCapacity);
+    batchData = nullptr;
+    batchSize = 0;
+    batchRows = 0;
+
+    // payloads are serialized straight into pooled buffers that zmq sends as is and hands back when done, any
+    // buffers still held by zmq from a previous start() go back to the old pool, which then deletes itself
+    bufferPool.reset(bufferPoolSize > 0 && !embedded ?
+                     new BufferPool(std::max(maxRowSize, batchCapacity), bufferPoolSize) : nullptr);
 }
 
 /**
@@ -199,59 +698,26 @@ void Tap::publisherThread()
 
         zmq::socket_t publisher(*context.get(), ZMQ_PUB);
         publisher.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
-        publisher.connect(lager_utils::getRemoteUri(serverHost, publisherPort).c_str());
+        publisher.connect(lager_utils::getRemoteUri(serverHost, publisherPort, transport).c_str());
 
         publisherRunning = true;
         cv.notify_all();
 
         while (running)
         {
-            if (newData)
-            {
-                zmq::message_t uuidMsg(uuid.size());
-                zmq::message_t versionMsg(version.size());
-                zmq::message_t flagsMsg(sizeof(flags));
-                zmq::message_t timestampMsg(sizeof(timestamp));
-
-                mutex.lock();
+            std::chrono::microseconds wait = publishPending(publisher);
 
-                memcpy(uuidMsg.data(), uuid.c_str(), uuid.size());
-                memcpy(versionMsg.data(), version.c_str(), version.size());
-
-                // TODO endianness
-                memcpy(flagsMsg.data(), (void*)&flags, sizeof(flags));
-                uint64_t networkTimestamp = lager_utils::htonll(timestamp);
-                memcpy(timestampMsg.data(), (void*)&networkTimestamp, sizeof(timestamp));
-
-                publisher.send(uuidMsg, ZMQ_SNDMORE);
-                publisher.send(versionMsg, ZMQ_SNDMORE);
-                publisher.send(flagsMsg, ZMQ_SNDMORE);
-                publisher.send(timestampMsg, ZMQ_SNDMORE);
-
-                for (unsigned int i = 0; i < dataRefItems.size(); ++i)
-                {
-                    zmq::message_t tmp(dataRefItems[i]->getSize());
-                    dataRefItems[i]->getNetworkDataRef(tmp.data());
-
-                    // make sure to use the sndmore flag until the last message
-                    if (i < dataRefItems.size() - 1)
-                    {
-                        publisher.send(tmp, ZMQ_SNDMORE);
-                    }
-                    else
-                    {
-                        publisher.send(tmp);
-                    }
-                }
-
-                newData = false;
-                mutex.unlock();
-            }
-            else
+            if (wait.count() > 0 && !busySpin)
             {
-                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                waitForRows(wait);
             }
         }
+
+        // rows logged before stop() still go out, and get a moment to do so before the socket closes
+        flushPending(publisher);
+
+        int flushLinger = THREAD_CLOSE_WAIT_MILLIS;
+        publisher.setsockopt(ZMQ_LINGER, &flushLinger, sizeof(flushLinger));
     }
     catch (const zmq::error_t& e)
     {
@@ -263,11 +729,386 @@ void Tap::publisherThread()
         }
     }
 
+    releaseBatch();
+
     mutex.lock();
     publisherRunning = false;
     mutex.unlock();
 }
 
+/**
+* @brief Publishes the rows waiting in the queue, called in a loop by the publisher thread or a LagerRuntime
+* At most one queue's worth of rows is sent per call so a busy tap can't starve the others sharing a runtime.
+* @param publisher is the connected zmq publisher socket
+* @returns the longest time to wait before calling again, zero when rows may still be waiting
+*/
+std::chrono::microseconds Tap::publishPending(zmq::socket_t& publisher)
+{
+    const std::chrono::microseconds linger(batchLingerMicros);
+
+    for (size_t rows = 0; rows < ringBuffer->getDepth(); ++rows)
+    {
+        uint8_t* slot = ringBuffer->beginRead();
+
+        if (!slot)
+        {
+            break;
+        }
+
+        if (!littleEndianPayload)
+        {
+            // log() leaves the row in host order so the swap happens here, one pass per row
+            rowConverter->toNetwork(slot + TIMESTAMP_SIZE_BYTES, slot + TIMESTAMP_SIZE_BYTES);
+        }
+
+        if (batchMaxRows <= 1)
+        {
+            publishRow(publisher, slot);
+            ringBuffer->commitRead();
+            continue;
+        }
+
+        if (batchRows == 0)
+        {
+            batchStart = std::chrono::steady_clock::now();
+        }
+
+        appendToBatch(slot);
+        ringBuffer->commitRead();
+
+        if (batchRows >= batchMaxRows)
+        {
+            publishBatch(publisher);
+        }
+    }
+
+    if (!ringBuffer->empty())
+    {
+        return std::chrono::microseconds(0);
+    }
+
+    if (batchRows > 0)
+    {
+        // the queue is drained, so send now unless the linger allows waiting for more rows
+        auto waited = std::chrono::duration_cast<std::chrono::microseconds>(
+                          std::chrono::steady_clock::now() - batchStart);
+
+        // a stopped tap doesn't wait for rows that won't come
+        if (waited < linger && running)
+        {
+            return linger - waited;
+        }
+
+        publishBatch(publisher);
+    }
+
+    return idleWait;
+}
+
+/**
+* @brief Publishes every row still queued and the partially filled batch, called once running is cleared so the
+* last rows logged before stop() aren't lost
+* @param publisher is the connected zmq publisher socket
+*/
+void Tap::flushPending(zmq::socket_t& publisher)
+{
+    // log() has stopped queueing, so this ends once the queue is empty and the last batch is sent
+    while (publishPending(publisher).count() == 0)
+    {
+    }
+}
+
+/**
+* @brief Hands the rows waiting in the queue to the runtime's row sinks, called by the runtime's reactor thread in
+* embedded mode.  Each slot already is the timestamp followed by the row, so it is passed as is.
+* @returns the longest time to wait before calling again, zero when rows may still be waiting
+*/
+std::chrono::microseconds Tap::deliverPending()
+{
+    const size_t slotSize = TIMESTAMP_SIZE_BYTES + offsetCount;
+
+    for (size_t rows = 0; rows < ringBuffer->getDepth(); ++rows)
+    {
+        uint8_t* slot = ringBuffer->beginRead();
+
+        if (!slot)
+        {
+            return idleWait;
+        }
+
+        runtime->deliverRow(uuid, slot, slotSize);
+        ringBuffer->commitRead();
+    }
+
+    return ringBuffer->empty() ? idleWait : std::chrono::microseconds(0);
+}
+
+/**
+* @brief Puts the publisher thread to sleep until log() or stop() wakes it or the timeout expires
+* When idle the timeout is TAP_IDLE_WAKE_MILLIS, as a safety net, so an idle tap wakes about once a second
+* instead of polling.
+* @param timeout is the longest time to wait
+*/
+void Tap::waitForRows(std::chrono::microseconds timeout)
+{
+    std::unique_lock<std::mutex> lock(wakeMutex);
+
+    publisherWaiting.store(true, std::memory_order_relaxed);
+
+    // pairs with the fence in log(), see there
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (running && ringBuffer->empty())
+    {
+        wakeCv.wait_for(lock, timeout);
+    }
+
+    publisherWaiting.store(false, std::memory_order_relaxed);
+}
+
+/**
+* @brief Wakes the publisher thread (or the runtime's reactor) if it is waiting for rows
+*/
+void Tap::wakePublisher()
+{
+    if (runtime)
+    {
+        runtime->wake();
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(wakeMutex);
+    wakeCv.notify_one();
+}
+
+/**
+* @brief Sends the uuid, version, flags and timestamp frames that start every data message
+* @param publisher is the connected zmq publisher socket
+* @param wireFlags are the DATA_FLAG_* bits describing the payload, combined with the user flags
+* @param timestamp points to the network order timestamp of the (first) row
+*/
+void Tap::publishHeader(zmq::socket_t& publisher, uint8_t wireFlags, const uint8_t* timestamp)
+{
+    wireFlags |= flags;
+
+    if (littleEndianPayload)
+    {
+        wireFlags |= DATA_FLAG_LITTLE_ENDIAN;
+    }
+
+    zmq::message_t uuidMsg(uuid.size());
+    zmq::message_t versionMsg(version.size());
+    zmq::message_t flagsMsg(sizeof(wireFlags));
+    zmq::message_t timestampMsg(TIMESTAMP_SIZE_BYTES);
+
+    memcpy(uuidMsg.data(), uuid.c_str(), uuid.size());
+    memcpy(versionMsg.data(), version.c_str(), version.size());
+    memcpy(flagsMsg.data(), (void*)&wireFlags, sizeof(wireFlags));
+    memcpy(timestampMsg.data(), timestamp, TIMESTAMP_SIZE_BYTES);
+
+    publisher.send(uuidMsg, ZMQ_SNDMORE);
+    publisher.send(versionMsg, ZMQ_SNDMORE);
+    publisher.send(flagsMsg, ZMQ_SNDMORE);
+    publisher.send(timestampMsg, ZMQ_SNDMORE);
+}
+
+/**
+* @brief Sends one captured queue slot as a multipart data message
+* @param publisher is the connected zmq publisher socket
+* @param slot is a queue slot containing the network order timestamp followed by the network order row
+*/
+void Tap::publishRow(zmq::socket_t& publisher, const uint8_t* slot)
+{
+    const uint8_t* row = slot + TIMESTAMP_SIZE_BYTES;
+
+    if (deltaEncoding)
+    {
+        publishHeader(publisher, DATA_FLAG_DELTA, slot);
+
+        uint8_t* payload = acquirePayload(deltaBuffer.data());
+        sendPayload(publisher, payload, encodeDelta(row, payload));
+        return;
+    }
+
+    publishHeader(publisher, packedPayload ? DATA_FLAG_PACKED_PAYLOAD : 0, slot);
+
+    if (packedPayload)
+    {
+        // the slot is already laid out by the item offsets, so the whole row goes as one frame.  The slot is
+        // reused as soon as this returns, so it's copied into a pooled buffer rather than handed to zmq itself
+        uint8_t* payload = acquirePayload(nullptr);
+
+        if (payload)
+        {
+            memcpy(payload, row, offsetCount);
+            row = payload;
+        }
+
+        sendPayload(publisher, row, offsetCount);
+        return;
+    }
+
+    for (unsigned int i = 0; i < formatItems.size(); ++i)
+    {
+        zmq::message_t tmp(formatItems[i].size);
+        memcpy(tmp.data(), row + formatItems[i].offset, formatItems[i].size);
+
+        // make sure to use the sndmore flag until the last message
+        if (i < formatItems.size() - 1)
+        {
+            publisher.send(tmp, ZMQ_SNDMORE);
+        }
+        else
+        {
+            publisher.send(tmp);
+        }
+    }
+}
+
+/**
+* @brief Appends one captured queue slot to the pending batch as a (timestamp, length, row) record
+* @param slot is a queue slot containing the network order timestamp followed by the network order row
+*/
+void Tap::appendToBatch(const uint8_t* slot)
+{
+    if (batchRows == 0)
+    {
+        batchData = acquirePayload(batchBuffer.data());
+        batchSize = 0;
+    }
+
+    const uint8_t* row = slot + TIMESTAMP_SIZE_BYTES;
+    uint8_t* record = batchData + batchSize;
+    uint8_t* recordRow = record + TIMESTAMP_SIZE_BYTES + BATCH_ROW_LENGTH_SIZE_BYTES;
+    size_t length = offsetCount;
+
+    if (deltaEncoding)
+    {
+        length = encodeDelta(row, recordRow);
+    }
+    else
+    {
+        memcpy(recordRow, row, length);
+    }
+
+    uint32_t networkLength = htonl(static_cast<uint32_t>(length));
+
+    memcpy(record, slot, TIMESTAMP_SIZE_BYTES);
+    memcpy(record + TIMESTAMP_SIZE_BYTES, &networkLength, BATCH_ROW_LENGTH_SIZE_BYTES);
+
+    batchSize += TIMESTAMP_SIZE_BYTES + BATCH_ROW_LENGTH_SIZE_BYTES + length;
+    batchRows++;
+}
+
+/**
+* @brief Encodes a row as a sequence number and a change bitmap followed by only the columns that changed
+* The network order sequence number counts every delta row the tap sends, so a Mug can tell it missed one.  Bit i
+* (byte i / 8, mask 1 << (i % 8)) is set when column i, in offset order, is present.  The first row and every
+* deltaKeyframeInterval rows after it are keyframes with every bit set, so a Mug can resynchronize.
+* @param row is the network order row to encode
+* @param encoded points to room for the sequence number and bitmap plus a full row, where the encoded row is written
+* @returns the size in bytes of the encoded row
+*/
+size_t Tap::encodeDelta(const uint8_t* row, uint8_t* encoded)
+{
+    size_t bitmapSize = (formatItems.size() + 7) / 8;
+    bool keyframe = (rowsSinceKeyframe == 0);
+
+    uint32_t sequence = htonl(deltaSequence++);
+    memcpy(encoded, &sequence, DELTA_SEQUENCE_SIZE_BYTES);
+
+    uint8_t* bitmap = encoded + DELTA_SEQUENCE_SIZE_BYTES;
+    uint8_t* out = bitmap + bitmapSize;
+
+    memset(bitmap, 0, bitmapSize);
+
+    for (size_t i = 0; i < formatItems.size(); ++i)
+    {
+        const uint8_t* column = row + formatItems[i].offset;
+        uint8_t* lastColumn = lastSentRow.data() + formatItems[i].offset;
+
+        if (keyframe || memcmp(column, lastColumn, formatItems[i].size) != 0)
+        {
+            bitmap[i / 8] |= static_cast<uint8_t>(1 << (i % 8));
+            memcpy(out, column, formatItems[i].size);
+            memcpy(lastColumn, column, formatItems[i].size);
+            out += formatItems[i].size;
+        }
+    }
+
+    rowsSinceKeyframe = (rowsSinceKeyframe + 1) % deltaKeyframeInterval;
+
+    return out - encoded;
+}
+
+/**
+* @brief Sends all pending batch records as a single data message, the timestamp frame is the first row's
+* @param publisher is the connected zmq publisher socket
+*/
+void Tap::publishBatch(zmq::socket_t& publisher)
+{
+    publishHeader(publisher, DATA_FLAG_BATCHED | (deltaEncoding ? DATA_FLAG_DELTA : 0), batchData);
+
+    const uint8_t* payload = batchData;
+    size_t size = batchSize;
+
+    // from here on the buffer belongs to the payload message
+    batchData = nullptr;
+    batchSize = 0;
+    batchRows = 0;
+
+    sendPayload(publisher, payload, size);
+}
+
+/**
+* @brief Gets a buffer to serialize the next payload into, from the pool when one is free
+* @param fallback is returned when the pool is disabled or every buffer is still held by zmq
+* @returns a buffer of at least the largest payload size, or fallback
+*/
+uint8_t* Tap::acquirePayload(uint8_t* fallback)
+{
+    uint8_t* buffer = bufferPool ? bufferPool->acquire() : nullptr;
+    return buffer ? buffer : fallback;
+}
+
+/**
+* @brief Sends the last frame of a data message.  Pooled buffers are handed to zmq as is and come back to the pool
+* once they have been written out, anything else is copied into a new message.
+* @param publisher is the connected zmq publisher socket
+* @param payload points to the serialized payload
+* @param size is the size of the payload in bytes
+*/
+void Tap::sendPayload(zmq::socket_t& publisher, const uint8_t* payload, size_t size)
+{
+    if (bufferPool && bufferPool->owns(payload))
+    {
+        // if the send throws, the message still owns the buffer and releases it when destroyed
+        zmq::message_t payloadMsg(const_cast<uint8_t*>(payload), size, BufferPool::release, bufferPool.get());
+        publisher.send(payloadMsg);
+        return;
+    }
+
+    zmq::message_t payloadMsg(size);
+    memcpy(payloadMsg.data(), payload, size);
+    publisher.send(payloadMsg);
+}
+
+/**
+* @brief Drops a partially filled batch, returning its buffer to the pool.  Called when the publisher thread ends,
+* after flushPending() unless the context was shut down first.
+*/
+void Tap::releaseBatch()
+{
+    if (batchData && bufferPool && bufferPool->owns(batchData))
+    {
+        BufferPool::release(batchData, bufferPool.get());
+    }
+
+    batchData = nullptr;
+    batchSize = 0;
+    batchRows = 0;
+}
+
 /**
 * @brief Returns flag
 * @return flags
@@ -279,9 +1120,133 @@ uint8_t Tap::getFlag()
 
 /**
  * @brief Sets flags
+ * The DATA_FLAG_* bits from lager_defines.h are set by the tap itself on the wire based on its configuration
  * @param setFlag is the flag you set
  **/
 void Tap::setFlag(uint8_t setFlag)
 {
     flags = setFlag;
 }
+
+
+/**
+ * @brief Sets the number of rows that may be waiting to be published, takes effect on the next start()
+ * @param depth is the number of rows, rounded up to the next power of two
+ * @throws runtime_error on a zero depth
+ **/
+void Tap::setQueueDepth(size_t depth)
+{
+    if (depth == 0)
+    {
+        throw std::runtime_error("Tap queue depth must be non-zero");
+    }
+
+    queueDepth = depth;
+}
+
+/**
+ * @brief Sets what log() does when the queue is full
+ * @param policy is the TapOverflowPolicy to use
+ **/
+void Tap::setOverflowPolicy(TapOverflowPolicy policy)
+{
+    overflowPolicy = policy;
+}
+
+/**
+ * @brief Selects the data message layout
+ * Packed payloads send the whole row as one frame and set DATA_FLAG_PACKED_PAYLOAD so Mugs can tell the
+ * difference.  The default of one frame per item remains readable by Mugs that predate the flag.
+ * Must be called before start().
+ * @param packed is true to send one payload frame per row
+ **/
+void Tap::setPackedPayload(bool packed)
+{
+    packedPayload = packed;
+}
+
+/**
+ * @brief Keeps the publisher thread spinning on the queue instead of sleeping when it is empty
+ * This trades a fully used core for the lowest possible publish latency.  Must be called before start().
+ * @param spin is true to busy-spin
+ **/
+void Tap::setBusySpin(bool spin)
+{
+    busySpin = spin;
+}
+
+/**
+ * @brief Coalesces several rows into each data message
+ * Rows are sent once maxRows are pending, or once the queue is empty and the oldest pending row has waited
+ * lingerMicros, whichever comes first.  A linger of zero sends whatever is queued as soon as the publisher catches
+ * up, so it only batches under load.  Batched messages set DATA_FLAG_BATCHED.  Must be called before start().
+ * @param maxRows is the most rows per message, 1 disables batching
+ * @param lingerMicros is the longest time in microseconds a row may wait for the batch to fill
+ * @throws runtime_error on zero maxRows
+ **/
+void Tap::setBatching(size_t maxRows, unsigned int lingerMicros)
+{
+    if (maxRows == 0)
+    {
+        throw std::runtime_error("Tap batch size must be non-zero");
+    }
+
+    batchMaxRows = maxRows;
+    batchLingerMicros = lingerMicros;
+}
+
+/**
+ * @brief Sends only the columns that changed since the previous row, plus periodic full keyframes
+ * Delta encoded messages set DATA_FLAG_DELTA and always carry their payload in a single frame.  Mugs rebuild the
+ * full row before writing it, but a Mug that joins late (or a dropped message) only recovers at the next
+ * keyframe.  Must be called before start().
+ * @param enabled is true to delta encode rows
+ * @param keyframeInterval is the number of rows between full keyframes, including the keyframe itself
+ * @throws runtime_error on a zero keyframe interval
+ **/
+void Tap::setDeltaEncoding(bool enabled, unsigned int keyframeInterval)
+{
+    if (keyframeInterval == 0)
+    {
+        throw std::runtime_error("Tap keyframe interval must be non-zero");
+    }
+
+    deltaEncoding = enabled;
+    deltaKeyframeInterval = keyframeInterval;
+}
+
+/**
+ * @brief Sends rows in the host's own byte order instead of network order, skipping the swap entirely
+ * On little endian hosts messages set DATA_FLAG_LITTLE_ENDIAN and the registered format says byteorder="little",
+ * so Kegs record it and readers copy values as is.  Has no effect on big endian hosts.  Must be called before
+ * start().
+ * @param native is true to send rows in native byte order
+ **/
+void Tap::setNativeByteOrder(bool native)
+{
+    nativeByteOrder = native;
+}
+
+/**
+ * @brief Sets the number of pooled payload buffers, takes effect on the next start()
+ * Each buffer holds the largest possible payload (a full batch when batching), and a buffer is held from the time
+ * its message is sent until zmq has written it out.  When all of them are held, payloads are copied into newly
+ * allocated messages instead.
+ * @param count is the number of buffers, 0 always copies
+ **/
+void Tap::setBufferPoolSize(size_t count)
+{
+    bufferPoolSize = count;
+}
+
+/**
+ * @brief Selects how the tap reaches the bartender, must be called before init()
+ * LagerTransport::IPC only reaches a bartender on the same host and LagerTransport::INPROC one in the same process,
+ * which also requires initializing with a LagerRuntime that shares the bartender's context.  The bartender has to
+ * be initialized with the same transport.
+ * @param transport_in is the transport to use, tcp by default
+ **/
+void Tap::setTransport(LagerTransport transport_in)
+{
+    transport = transport_in;
+}
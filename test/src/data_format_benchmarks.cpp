@@ -2,6 +2,7 @@
 
 #include "lager/data_format.h"
 #include "lager/data_format_parser.h"
+#include "lager/data_format_writer.h"
 
 static void parseFromFile(benchmark::State& state)
 {
@@ -104,4 +105,26 @@ static void createFromThousandDataRefs(benchmark::State& state)
 
 BENCHMARK(createFromThousandDataRefs);
 
+// range(0) is the item count, the streaming writer Taps use at start()
+static void writeFromDataItems(benchmark::State& state)
+{
+    std::vector<DataItem> items;
+
+    for (int i = 0; i < state.range(0); ++i)
+    {
+        std::stringstream ss;
+        ss << "data" << i;
+        items.push_back(DataItem(ss.str(), "uint32_t", 4, i * 4));
+    }
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(DataFormatWriter::fromDataItems(items, "test", "test_key"));
+    }
+
+    state.SetComplexityN(state.range(0));
+}
+
+BENCHMARK(writeFromDataItems)->RangeMultiplier(10)->Range(10, 10000)->Complexity(benchmark::oN);
+
 BENCHMARK_MAIN();
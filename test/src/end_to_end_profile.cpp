@@ -9,43 +9,73 @@ void usage(char* progName)
     std::cout << progName << " [options] ARRAY_SIZE" << std::endl <<
               "Options:" << std::endl <<
               "-h | --help        Print this help" << std::endl <<
+              "-t | --transport   tcp (default), ipc or inproc" << std::endl <<
               "ARRAY_SIZE         Size of uint32_t array to add to the tap (defaults to 10)" << std::endl;
 }
 
 int main(int argc, char* argv[])
 {
     int arraySize = 10;
+    LagerTransport transport = LagerTransport::TCP;
 
-    if (argc == 2)
+    for (int arg = 1; arg < argc; ++arg)
     {
-        if (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0)
+        if (strcmp(argv[arg], "-h") == 0 || strcmp(argv[arg], "--help") == 0)
         {
             usage(argv[0]);
             return 0;
         }
-
-        std::istringstream ss(argv[1]);
-
-        if (!(ss >> arraySize))
+        else if ((strcmp(argv[arg], "-t") == 0 || strcmp(argv[arg], "--transport") == 0) && arg + 1 < argc)
         {
-            std::cerr << "Invalid ARRAY_SIZE: " << argv[1] << std::endl;
-            return 1;
+            std::string name(argv[++arg]);
+
+            if (name == "ipc")
+            {
+                transport = LagerTransport::IPC;
+            }
+            else if (name == "inproc")
+            {
+                transport = LagerTransport::INPROC;
+            }
+            else if (name != "tcp")
+            {
+                std::cerr << "Invalid transport: " << name << std::endl;
+                return 1;
+            }
         }
-    }
+        else
+        {
+            std::istringstream ss(argv[arg]);
 
-    if (argc > 2)
-    {
-        usage(argv[0]);
-        return 0;
+            if (!(ss >> arraySize))
+            {
+                std::cerr << "Invalid ARRAY_SIZE: " << argv[arg] << std::endl;
+                return 1;
+            }
+        }
     }
 
     Tap t;
     Mug m;
     Bartender b;
 
-    b.init(12345);
-    t.init("localhost", 12345, 100);
-    m.init("localhost", 12345, 100);
+    b.init(12345, transport);
+    t.setTransport(transport);
+    m.setTransport(transport);
+
+    if (transport == LagerTransport::INPROC)
+    {
+        // inproc only connects sockets of the same context
+        std::shared_ptr<LagerRuntime> runtime(new LagerRuntime(b.getContext()));
+        t.init(runtime, "localhost", 12345, 100);
+        m.init(runtime, "localhost", 12345, 100);
+    }
+    else
+    {
+        t.init("localhost", 12345, 100);
+        m.init("localhost", 12345, 100);
+    }
+
     m.start();
     b.start();
 
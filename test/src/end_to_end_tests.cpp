@@ -1,12 +1,145 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
 #include "lager/bartender.h"
+#include "lager/byte_swap.h"
 #include "lager/mug.h"
 #include "lager/tap.h"
 #include "lager/lager_utils.h"
 
+namespace
+{
+    // a row a mug delivered, with the column offsets of the format it arrived with
+    struct ReceivedRow
+    {
+        std::map<std::string, off_t> offsets;
+        std::vector<uint8_t> payload;
+        bool littleEndian;
+
+        template <typename T>
+        T get(const std::string& name) const
+        {
+            uint8_t bytes[sizeof(T)];
+            memcpy(bytes, payload.data() + offsets.at(name), sizeof(T));
+
+            if (littleEndian != byte_swap::isLittleEndian())
+            {
+                std::reverse(bytes, bytes + sizeof(T));
+            }
+
+            T value;
+            memcpy(&value, bytes, sizeof(T));
+            return value;
+        }
+    };
+
+    // collects the rows a mug writes by key, from whichever thread the mug writes them on
+    class RowCollector
+    {
+    public:
+        std::shared_ptr<MugSink> sink()
+        {
+            return std::make_shared<CallbackSink>([this](const MugRow& row)
+            {
+                // only embedded rows can come before their format, and nothing can be checked without one
+                if (row.format == nullptr)
+                {
+                    return;
+                }
+
+                DataFormat format = *row.format;
+                ReceivedRow received;
+                received.payload.assign(row.payload, row.payload + row.payloadSize);
+                received.littleEndian = format.isLittleEndian();
+
+                std::vector<DataItem> items = format.getItems();
+                for (auto i = items.begin(); i != items.end(); ++i)
+                {
+                    received.offsets[i->name] = i->offset;
+                }
+
+                std::lock_guard<std::mutex> lock(mutex);
+                rows[format.getKey()].push_back(received);
+            });
+        }
+
+        std::vector<ReceivedRow> get(const std::string& key)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            return rows[key];
+        }
+
+        /**
+         * @brief Waits for the newest row of key to have column name equal to value
+         * @returns true if it did before the timeout
+         */
+        template <typename T>
+        bool waitForLast(const std::string& key, const std::string& name, T value)
+        {
+            for (unsigned int i = 0; i < 200; ++i)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    std::vector<ReceivedRow>& received = rows[key];
+
+                    if (!received.empty() && received.back().get<T>(name) == value)
+                    {
+                        return true;
+                    }
+                }
+
+                lager_utils::sleepMillis(10);
+            }
+
+            return false;
+        }
+
+    private:
+        std::mutex mutex;
+        std::map<std::string, std::vector<ReceivedRow>> rows;
+    };
+
+    /**
+     * @brief Logs rows until one of them reaches the mug, rows logged before the mug's subscription has made it to
+     * the tap are dropped by the PUB socket
+     * @returns true if a row arrived before the timeout
+     */
+    bool logUntilReceived(RowCollector& collector, const std::string& key, const std::function<void()>& logRow)
+    {
+        for (unsigned int i = 0; i < 100; ++i)
+        {
+            logRow();
+            lager_utils::sleepMillis(20);
+
+            if (!collector.get(key).empty())
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * @brief Checks that no row was lost or reordered once the first one arrived, item1 counts up by one per row
+     */
+    void expectConsecutive(const std::vector<ReceivedRow>& rows)
+    {
+        for (size_t i = 1; i < rows.size(); ++i)
+        {
+            EXPECT_EQ(rows[i - 1].get<uint32_t>("item1") + 1, rows[i].get<uint32_t>("item1"));
+        }
+    }
+}
+
 class EndToEndTests : public ::testing::Test
 {
 protected:
@@ -61,6 +194,499 @@ TEST_F(EndToEndTests, DoesItWork)
     b.stop();
 }
 
+TEST_F(EndToEndTests, PackedPayload)
+{
+    uint32_t item1 = 0;
+    uint16_t item2 = 0;
+    uint8_t item3 = 0;
+    uint64_t item4 = 0;
+
+    Bartender b;
+    b.init(12345);
+
+    Mug m;
+    m.init("localhost", 12345, 100);
+
+    RowCollector collector;
+    m.addSink(collector.sink());
+
+    Tap t;
+    t.init("localhost", 12345, 100);
+    t.setPackedPayload(true);
+
+    b.start();
+    m.start();
+
+    t.addItem(new DataRefItem<uint32_t>("item1", &item1));
+    t.addItem(new DataRefItem<uint16_t>("item2", &item2));
+    t.addItem(new DataRefItem<uint8_t>("item3", &item3));
+    t.addItem(new DataRefItem<uint64_t>("item4", &item4));
+    t.start("/test");
+
+    auto logRow = [&]()
+    {
+        item1++;
+        item2++;
+        item3++;
+        item4++;
+        t.log();
+    };
+
+    ASSERT_TRUE(logUntilReceived(collector, "/test", logRow));
+
+    for (unsigned int i = 0; i < 5; ++i)
+    {
+        logRow();
+        lager_utils::sleepMillis(100);
+    }
+
+    EXPECT_TRUE(collector.waitForLast("/test", "item1", item1));
+
+    m.stop();
+    t.stop();
+    b.stop();
+
+    std::vector<ReceivedRow> rows = collector.get("/test");
+    ASSERT_GE(rows.size(), 6u);
+    expectConsecutive(rows);
+
+    // a packed row is the whole slot in one frame, columns back to back in the order they were added
+    EXPECT_EQ(7, rows.back().offsets.at("item4"));
+    EXPECT_EQ(15u, rows.back().payload.size());
+
+    for (auto i = rows.begin(); i != rows.end(); ++i)
+    {
+        uint32_t value = i->get<uint32_t>("item1");
+        EXPECT_EQ(static_cast<uint16_t>(value), i->get<uint16_t>("item2"));
+        EXPECT_EQ(static_cast<uint8_t>(value), i->get<uint8_t>("item3"));
+        EXPECT_EQ(value, i->get<uint64_t>("item4"));
+    }
+}
+
+TEST_F(EndToEndTests, NativeByteOrder)
+{
+    uint32_t item1 = 0;
+    double item2 = 0;
+
+    Bartender b;
+    b.init(12345);
+
+    Mug m;
+    m.init("localhost", 12345, 100);
+
+    RowCollector collector;
+    m.addSink(collector.sink());
+
+    Tap t;
+    t.init("localhost", 12345, 100);
+    t.setNativeByteOrder(true);
+    t.setPackedPayload(true);
+
+    b.start();
+    m.start();
+
+    t.addItem(new DataRefItem<uint32_t>("item1", &item1));
+    t.addItem(new DataRefItem<double>("item2", &item2));
+    t.start("/test");
+
+    auto logRow = [&]()
+    {
+        item1++;
+        item2 += 0.5;
+        t.log();
+    };
+
+    ASSERT_TRUE(logUntilReceived(collector, "/test", logRow));
+
+    for (unsigned int i = 0; i < 5; ++i)
+    {
+        logRow();
+        lager_utils::sleepMillis(100);
+    }
+
+    EXPECT_TRUE(collector.waitForLast("/test", "item1", item1));
+
+    m.stop();
+    t.stop();
+    b.stop();
+
+    std::vector<ReceivedRow> rows = collector.get("/test");
+    ASSERT_GE(rows.size(), 6u);
+    expectConsecutive(rows);
+
+    for (auto i = rows.begin(); i != rows.end(); ++i)
+    {
+        // the format says which order the columns are in, on a little endian host that's little endian
+        EXPECT_EQ(byte_swap::isLittleEndian(), i->littleEndian);
+        EXPECT_DOUBLE_EQ(i->get<uint32_t>("item1") * 0.5, i->get<double>("item2"));
+    }
+
+    // native rows carry the host's bytes unchanged
+    const ReceivedRow& last = rows.back();
+    EXPECT_EQ(0, memcmp(last.payload.data() + last.offsets.at("item1"), &item1, sizeof(item1)));
+    EXPECT_EQ(0, memcmp(last.payload.data() + last.offsets.at("item2"), &item2, sizeof(item2)));
+}
+
+TEST_F(EndToEndTests, Batched)
+{
+    uint32_t item1 = 0;
+    double item2 = 0;
+
+    Bartender b;
+    b.init(12345);
+
+    Mug m;
+    m.init("localhost", 12345, 100);
+
+    Tap t;
+    t.init("localhost", 12345, 100);
+    t.setBatching(16, 10000);
+
+    b.start();
+    m.start();
+
+    t.addItem(new DataRefItem<uint32_t>("item1", &item1));
+    t.addItem(new DataRefItem<double>("item2", &item2));
+    t.start("/test");
+
+    for (unsigned int i = 0; i < 100; ++i)
+    {
+        item1++;
+        item2 += 0.5;
+        t.log();
+        lager_utils::sleepMillis(1);
+    }
+
+    lager_utils::sleepMillis(100);
+
+    m.stop();
+    t.stop();
+    b.stop();
+}
+
+TEST_F(EndToEndTests, DeltaEncoded)
+{
+    uint32_t item1 = 0;
+    double item2 = 0;
+    uint64_t item3 = 42;
+
+    Bartender b;
+    b.init(12345);
+
+    Mug m;
+    m.init("localhost", 12345, 100);
+
+    Tap t;
+    t.init("localhost", 12345, 100);
+    t.setDeltaEncoding(true, 10);
+    t.setBatching(8, 5000);
+
+    b.start();
+    m.start();
+
+    t.addItem(new DataRefItem<uint32_t>("item1", &item1));
+    t.addItem(new DataRefItem<double>("item2", &item2));
+    t.addItem(new DataRefItem<uint64_t>("item3", &item3));
+    t.start("/test");
+
+    for (unsigned int i = 0; i < 100; ++i)
+    {
+        item1++;
+
+        if (i % 10 == 0)
+        {
+            item2 += 0.5;
+        }
+
+        t.log();
+        lager_utils::sleepMillis(1);
+    }
+
+    lager_utils::sleepMillis(100);
+
+    m.stop();
+    t.stop();
+    b.stop();
+}
+
+TEST_F(EndToEndTests, SharedRuntime)
+{
+    uint32_t item1 = 0;
+    double item2 = 0;
+
+    Bartender b;
+    b.init(12345);
+
+    std::shared_ptr<LagerRuntime> runtime = LagerRuntime::getDefault();
+
+    Mug m;
+    m.init(runtime, "localhost", 12345, 100);
+
+    RowCollector collector;
+    m.addSink(collector.sink());
+
+    // every tap publishes from the runtime's one reactor thread and registers through one CHP client
+    Tap t1;
+    t1.init(runtime, "localhost", 12345, 100);
+    t1.setPackedPayload(true);
+
+    Tap t2;
+    t2.init(runtime, "localhost", 12345, 100);
+    t2.setBatching(4, 1000);
+
+    b.start();
+    m.start();
+
+    t1.addItem(new DataRefItem<uint32_t>("item1", &item1));
+    t1.start("/shared1");
+
+    t2.addItem(new DataRefItem<double>("item2", &item2));
+    t2.start("/shared2");
+
+    auto logRow1 = [&]()
+    {
+        item1++;
+        t1.log();
+    };
+
+    auto logRow2 = [&]()
+    {
+        item2 += 0.5;
+        t2.log();
+    };
+
+    ASSERT_TRUE(logUntilReceived(collector, "/shared1", logRow1));
+    ASSERT_TRUE(logUntilReceived(collector, "/shared2", logRow2));
+
+    for (unsigned int i = 0; i < 20; ++i)
+    {
+        logRow1();
+        logRow2();
+        lager_utils::sleepMillis(10);
+    }
+
+    EXPECT_TRUE(collector.waitForLast("/shared1", "item1", item1));
+    EXPECT_TRUE(collector.waitForLast("/shared2", "item2", item2));
+
+    m.stop();
+    t1.stop();
+    t2.stop();
+    b.stop();
+
+    std::vector<ReceivedRow> rows1 = collector.get("/shared1");
+    ASSERT_GE(rows1.size(), 21u);
+    expectConsecutive(rows1);
+
+    std::vector<ReceivedRow> rows2 = collector.get("/shared2");
+    ASSERT_GE(rows2.size(), 21u);
+
+    for (size_t i = 1; i < rows2.size(); ++i)
+    {
+        EXPECT_DOUBLE_EQ(rows2[i - 1].get<double>("item2") + 0.5, rows2[i].get<double>("item2"));
+    }
+}
+
+TEST_F(EndToEndTests, IpcTransport)
+{
+    uint32_t item1 = 0;
+    double item2 = 0;
+
+    Bartender b;
+    b.init(12345, LagerTransport::IPC);
+
+    Mug m;
+    m.setTransport(LagerTransport::IPC);
+    m.init("localhost", 12345, 100);
+
+    RowCollector collector;
+    m.addSink(collector.sink());
+
+    Tap t;
+    t.setTransport(LagerTransport::IPC);
+    t.init("localhost", 12345, 100);
+    t.setPackedPayload(true);
+
+    b.start();
+    m.start();
+
+    t.addItem(new DataRefItem<uint32_t>("item1", &item1));
+    t.addItem(new DataRefItem<double>("item2", &item2));
+    t.start("/ipc");
+
+    auto logRow = [&]()
+    {
+        item1++;
+        item2 += 0.5;
+        t.log();
+    };
+
+    ASSERT_TRUE(logUntilReceived(collector, "/ipc", logRow));
+
+    for (unsigned int i = 0; i < 5; ++i)
+    {
+        logRow();
+        lager_utils::sleepMillis(100);
+    }
+
+    EXPECT_TRUE(collector.waitForLast("/ipc", "item1", item1));
+
+    m.stop();
+    t.stop();
+    b.stop();
+
+    std::vector<ReceivedRow> rows = collector.get("/ipc");
+    ASSERT_GE(rows.size(), 6u);
+    expectConsecutive(rows);
+
+    for (auto i = rows.begin(); i != rows.end(); ++i)
+    {
+        EXPECT_DOUBLE_EQ(i->get<uint32_t>("item1") * 0.5, i->get<double>("item2"));
+    }
+}
+
+TEST_F(EndToEndTests, InprocTransport)
+{
+    uint32_t item1 = 0;
+    double item2 = 0;
+
+    Bartender b;
+    b.init(12345, LagerTransport::INPROC);
+
+    RowCollector collector;
+
+    {
+        // inproc endpoints only connect within one context, so everything shares the bartender's
+        std::shared_ptr<LagerRuntime> runtime(new LagerRuntime(b.getContext()));
+
+        Mug m;
+        m.setTransport(LagerTransport::INPROC);
+        m.init(runtime, "localhost", 12345, 100);
+        m.addSink(collector.sink());
+
+        Tap t;
+        t.setTransport(LagerTransport::INPROC);
+        t.init(runtime, "localhost", 12345, 100);
+        t.setPackedPayload(true);
+
+        b.start();
+        m.start();
+
+        t.addItem(new DataRefItem<uint32_t>("item1", &item1));
+        t.addItem(new DataRefItem<double>("item2", &item2));
+        t.start("/inproc");
+
+        auto logRow = [&]()
+        {
+            item1++;
+            item2 += 0.5;
+            t.log();
+        };
+
+        ASSERT_TRUE(logUntilReceived(collector, "/inproc", logRow));
+
+        for (unsigned int i = 0; i < 5; ++i)
+        {
+            logRow();
+            lager_utils::sleepMillis(100);
+        }
+
+        EXPECT_TRUE(collector.waitForLast("/inproc", "item1", item1));
+
+        m.stop();
+        t.stop();
+    }
+
+    b.stop();
+
+    std::vector<ReceivedRow> rows = collector.get("/inproc");
+    ASSERT_GE(rows.size(), 6u);
+    expectConsecutive(rows);
+
+    for (auto i = rows.begin(); i != rows.end(); ++i)
+    {
+        EXPECT_DOUBLE_EQ(i->get<uint32_t>("item1") * 0.5, i->get<double>("item2"));
+    }
+}
+
+TEST_F(EndToEndTests, Embedded)
+{
+    uint32_t item1 = 0;
+    double item2 = 0;
+
+    Bartender b;
+    b.init(12345);
+
+    std::shared_ptr<LagerRuntime> runtime(new LagerRuntime);
+
+    // rows go from the taps' queues straight to the mug's keg, only registration goes through the bartender
+    Mug m;
+    m.setEmbedded(true);
+    m.init(runtime, "localhost", 12345, 100);
+
+    RowCollector collector;
+    m.addSink(collector.sink());
+
+    Tap t1;
+    t1.setEmbedded(true);
+    t1.init(runtime, "localhost", 12345, 100);
+
+    Tap t2;
+    t2.setEmbedded(true);
+    t2.init(runtime, "localhost", 12345, 100);
+
+    b.start();
+    m.start();
+
+    t1.addItem(new DataRefItem<uint32_t>("item1", &item1));
+    t1.start("/embedded1");
+
+    t2.addItem(new DataRefItem<double>("item2", &item2));
+    t2.start("/embedded2");
+
+    auto logRow1 = [&]()
+    {
+        item1++;
+        t1.log();
+    };
+
+    auto logRow2 = [&]()
+    {
+        item2 += 0.5;
+        t2.log();
+    };
+
+    // embedded rows aren't lost to a subscription, but the ones ahead of their format can't be told apart
+    ASSERT_TRUE(logUntilReceived(collector, "/embedded1", logRow1));
+    ASSERT_TRUE(logUntilReceived(collector, "/embedded2", logRow2));
+
+    for (unsigned int i = 0; i < 20; ++i)
+    {
+        logRow1();
+        logRow2();
+        lager_utils::sleepMillis(10);
+    }
+
+    EXPECT_TRUE(collector.waitForLast("/embedded1", "item1", item1));
+    EXPECT_TRUE(collector.waitForLast("/embedded2", "item2", item2));
+
+    t1.stop();
+    t2.stop();
+    m.stop();
+    b.stop();
+
+    std::vector<ReceivedRow> rows1 = collector.get("/embedded1");
+    ASSERT_GE(rows1.size(), 21u);
+    expectConsecutive(rows1);
+
+    std::vector<ReceivedRow> rows2 = collector.get("/embedded2");
+    ASSERT_GE(rows2.size(), 21u);
+
+    for (size_t i = 1; i < rows2.size(); ++i)
+    {
+        EXPECT_DOUBLE_EQ(rows2[i - 1].get<double>("item2") + 0.5, rows2[i].get<double>("item2"));
+    }
+}
+
 int main(int argc, char* argv[])
 {
     ::testing::InitGoogleTest(&argc, argv);
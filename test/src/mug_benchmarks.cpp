@@ -0,0 +1,175 @@
+#include <benchmark/benchmark.h>
+
+#include "lager/data_format_writer.h"
+#include "lager/mug.h"
+#include "lager/lager_utils.h"
+
+namespace
+{
+    const size_t MESSAGES_PER_BATCH = 64;
+}
+
+// feeds the receive path from a socket the benchmark writes to, the keg is never started so nothing hits the disk
+class ReceiveMug : public Mug
+{
+public:
+    ReceiveMug()
+    {
+        keg.reset(new Keg("."));
+        kegSink.reset(new KegSink(keg));
+    }
+
+    void setFormat(const std::string& tapUuid, const std::shared_ptr<DataFormat>& format)
+    {
+        formatMap[tapUuid] = format;
+    }
+
+    void receive(zmq::socket_t& socket)
+    {
+        receiveMessage(socket, *messagePool.front());
+    }
+
+    const std::vector<uint8_t>& row() const
+    {
+        return workers.front()->data;
+    }
+};
+
+// range(0) is the column count, range(1) is 1 to send packed payloads (one frame per row) instead of one frame
+// per column
+static void mugReceiveRow(benchmark::State& state)
+{
+    size_t columns = state.range(0);
+    bool packed = state.range(1) != 0;
+
+    std::string tapUuid = lager_utils::getUuid();
+    std::shared_ptr<DataFormat> format(new DataFormat("BEERR01", "/bench"));
+
+    for (size_t i = 0; i < columns; ++i)
+    {
+        format->addItem(DataItem("value" + std::to_string(i), "double", sizeof(double), i * sizeof(double)));
+    }
+
+    ReceiveMug m;
+    m.setFormat(tapUuid, format);
+
+    zmq::context_t context(1);
+    zmq::socket_t sender(context, ZMQ_PAIR);
+    zmq::socket_t receiver(context, ZMQ_PAIR);
+    receiver.bind("inproc://mug_benchmarks");
+    sender.connect("inproc://mug_benchmarks");
+
+    uint8_t flags = packed ? DATA_FLAG_PACKED_PAYLOAD : 0;
+    uint64_t timestamp = lager_utils::htonll(lager_utils::getCurrentTime());
+    std::vector<double> row(columns, 1.0);
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+
+        for (size_t n = 0; n < MESSAGES_PER_BATCH; ++n)
+        {
+            sender.send(tapUuid.data(), tapUuid.size(), ZMQ_SNDMORE);
+            sender.send("BEERR01", 7, ZMQ_SNDMORE);
+            sender.send(&flags, sizeof(flags), ZMQ_SNDMORE);
+            sender.send(&timestamp, sizeof(timestamp), ZMQ_SNDMORE);
+
+            if (packed)
+            {
+                sender.send(row.data(), row.size() * sizeof(double));
+            }
+            else
+            {
+                for (size_t i = 0; i < columns; ++i)
+                {
+                    sender.send(&row[i], sizeof(double), i + 1 < columns ? ZMQ_SNDMORE : 0);
+                }
+            }
+        }
+
+        state.ResumeTiming();
+
+        for (size_t n = 0; n < MESSAGES_PER_BATCH; ++n)
+        {
+            m.receive(receiver);
+        }
+
+        benchmark::DoNotOptimize(m.row().data());
+    }
+
+    state.counters["dropped"] = static_cast<double>(m.getDroppedCount());
+    state.SetItemsProcessed(state.iterations() * MESSAGES_PER_BATCH);
+    state.SetBytesProcessed(state.iterations() * MESSAGES_PER_BATCH * columns * sizeof(double));
+}
+
+BENCHMARK(mugReceiveRow)->ArgsProduct({{10, 100, 1000}, {0, 1}});
+
+// applies CHP maps the way hashMapUpdated() does, without a bartender
+class FormatMug : public Mug
+{
+public:
+    FormatMug()
+    {
+        keg.reset(new Keg("."));
+        formatParser.reset(new DataFormatParser);
+    }
+
+    void update(const std::map<std::string, std::string>& newHashMap,
+                const std::map<std::string, std::string>& newUuidMap)
+    {
+        updateFormats(newHashMap, newUuidMap);
+    }
+};
+
+// range(0) is the number of taps already registered, times the update a registration storm makes for each new one
+static void mugFormatUpdate(benchmark::State& state)
+{
+    std::map<std::string, std::string> hashMap; // <topic name, xml format>
+    std::map<std::string, std::string> uuidMap; // <uuid, topic name>
+
+    std::vector<DataItem> items;
+
+    for (size_t i = 0; i < 10; ++i)
+    {
+        items.push_back(DataItem("value" + std::to_string(i), "double", sizeof(double), i * sizeof(double)));
+    }
+
+    for (int64_t i = 0; i <= state.range(0); ++i)
+    {
+        std::string key = "/tap" + std::to_string(i);
+        hashMap[key] = DataFormatWriter::fromDataItems(items, "BEERR01", key);
+        uuidMap[lager_utils::getUuid()] = key;
+    }
+
+    // everything but the newest tap is known
+    std::map<std::string, std::string> knownHashMap(hashMap);
+    std::map<std::string, std::string> knownUuidMap(uuidMap);
+    knownHashMap.erase("/tap" + std::to_string(state.range(0)));
+
+    for (auto i = knownUuidMap.begin(); i != knownUuidMap.end(); ++i)
+    {
+        if (!knownHashMap.count(i->second))
+        {
+            knownUuidMap.erase(i);
+            break;
+        }
+    }
+
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        std::unique_ptr<FormatMug> m(new FormatMug());
+        m->update(knownHashMap, knownUuidMap);
+        state.ResumeTiming();
+
+        m->update(hashMap, uuidMap);
+
+        state.PauseTiming();
+        m.reset();
+        state.ResumeTiming();
+    }
+}
+
+BENCHMARK(mugFormatUpdate)->RangeMultiplier(10)->Range(10, 1000)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
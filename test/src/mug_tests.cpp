@@ -1,4 +1,7 @@
+#include <cstring>
+#include <map>
 #include <memory>
+#include <set>
 
 #include <gtest/gtest.h>
 
@@ -12,6 +15,785 @@ TEST(MugTests, BadPortNumber)
     EXPECT_FALSE(m.init("localhost", 65535, 100));
 }
 
+namespace
+{
+    // drives the receive path directly, the keg isn't started so rows go nowhere
+    class ReceiveMug : public Mug
+    {
+    public:
+        ReceiveMug()
+        {
+            keg.reset(new Keg("."));
+            kegSink.reset(new KegSink(keg));
+        }
+
+        void setFormat(const std::string& tapUuid, const std::shared_ptr<DataFormat>& format)
+        {
+            formatMap[tapUuid] = format;
+        }
+
+        void setTopic(const std::string& tapUuid, const std::string& key)
+        {
+            uuidMap[tapUuid] = key;
+        }
+
+        void receive(zmq::socket_t& socket)
+        {
+            receiveMessage(socket, *messagePool.front());
+        }
+
+        const std::vector<uint8_t>& row() const
+        {
+            return workers.front()->data;
+        }
+
+        size_t parked() const
+        {
+            return workers.front()->parkedCount;
+        }
+
+        void flush()
+        {
+            flushParked(*workers.front());
+        }
+    };
+
+    // runs the decode and writer threads, with the test standing in for the subscriber thread
+    class PipelineMug : public ReceiveMug
+    {
+    public:
+        void begin()
+        {
+            startPipeline();
+            message = messagePool.front().get();
+        }
+
+        void dispatch(zmq::socket_t& socket)
+        {
+            receiveFrames(socket, *message);
+            dispatchMessage(message);
+        }
+
+        void end()
+        {
+            stopPipeline();
+        }
+
+    private:
+        MugMessage* message;
+    };
+
+    void sendRow(zmq::socket_t& socket, const std::string& tapUuid, size_t columns, uint32_t value = 1)
+    {
+        uint8_t flags = 0;
+        uint64_t timestamp = 0;
+
+        socket.send(tapUuid.data(), tapUuid.size(), ZMQ_SNDMORE);
+        socket.send("BEERR01", 7, ZMQ_SNDMORE);
+        socket.send(&flags, sizeof(flags), ZMQ_SNDMORE);
+        socket.send(&timestamp, sizeof(timestamp), ZMQ_SNDMORE);
+
+        for (size_t i = 0; i < columns; ++i)
+        {
+            socket.send(&value, sizeof(value), i + 1 < columns ? ZMQ_SNDMORE : 0);
+        }
+    }
+
+    // sends a message whose payload is a single frame, as batched, delta and packed rows are
+    void sendPayload(zmq::socket_t& socket, const std::string& tapUuid, uint8_t flags, uint64_t timestamp,
+                     const std::vector<uint8_t>& payload)
+    {
+        timestamp = lager_utils::htonll(timestamp);
+
+        socket.send(tapUuid.data(), tapUuid.size(), ZMQ_SNDMORE);
+        socket.send("BEERR01", 7, ZMQ_SNDMORE);
+        socket.send(&flags, sizeof(flags), ZMQ_SNDMORE);
+        socket.send(&timestamp, sizeof(timestamp), ZMQ_SNDMORE);
+        socket.send(payload.data(), payload.size());
+    }
+
+    // encodes a delta row of uint32_t columns, changed holds the host order values of the columns set in bitmap
+    std::vector<uint8_t> deltaRow(uint32_t sequence, uint8_t bitmap, const std::vector<uint32_t>& changed)
+    {
+        std::vector<uint8_t> row(DELTA_SEQUENCE_SIZE_BYTES + 1 + changed.size() * sizeof(uint32_t));
+
+        sequence = htonl(sequence);
+        memcpy(row.data(), &sequence, sizeof(sequence));
+        row[DELTA_SEQUENCE_SIZE_BYTES] = bitmap;
+
+        for (size_t i = 0; i < changed.size(); ++i)
+        {
+            uint32_t value = htonl(changed[i]);
+            memcpy(row.data() + DELTA_SEQUENCE_SIZE_BYTES + 1 + i * sizeof(value), &value, sizeof(value));
+        }
+
+        return row;
+    }
+
+    // a network order row of uint32_t columns
+    std::vector<uint8_t> packedRow(const std::vector<uint32_t>& values)
+    {
+        std::vector<uint8_t> row(values.size() * sizeof(uint32_t));
+
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            uint32_t value = htonl(values[i]);
+            memcpy(row.data() + i * sizeof(value), &value, sizeof(value));
+        }
+
+        return row;
+    }
+
+    // appends a (timestamp, length, row) record to a batch payload
+    void appendRecord(std::vector<uint8_t>& batch, uint64_t timestamp, const std::vector<uint8_t>& row)
+    {
+        timestamp = lager_utils::htonll(timestamp);
+        uint32_t length = htonl(static_cast<uint32_t>(row.size()));
+
+        batch.insert(batch.end(), reinterpret_cast<uint8_t*>(&timestamp),
+                     reinterpret_cast<uint8_t*>(&timestamp) + sizeof(timestamp));
+        batch.insert(batch.end(), reinterpret_cast<uint8_t*>(&length),
+                     reinterpret_cast<uint8_t*>(&length) + sizeof(length));
+        batch.insert(batch.end(), row.begin(), row.end());
+    }
+
+    // collects the rows a mug writes as host order uint32_t columns
+    std::shared_ptr<CallbackSink> collectRows(std::vector<std::vector<uint32_t>>& rows,
+                                              std::vector<uint64_t>& timestamps)
+    {
+        return std::make_shared<CallbackSink>([&rows, &timestamps](const MugRow & row)
+        {
+            std::vector<uint32_t> values(row.payloadSize / sizeof(uint32_t));
+
+            for (size_t i = 0; i < values.size(); ++i)
+            {
+                memcpy(&values[i], row.payload + i * sizeof(uint32_t), sizeof(uint32_t));
+                values[i] = ntohl(values[i]);
+            }
+
+            rows.push_back(values);
+            timestamps.push_back(row.timestamp);
+        });
+    }
+}
+
+TEST(MugTests, ReceiveChecksRowsAgainstFormat)
+{
+    std::string known = lager_utils::getUuid();
+    std::string unknown = lager_utils::getUuid();
+
+    std::shared_ptr<DataFormat> format(new DataFormat("BEERR01", "/receive"));
+    format->addItem(DataItem("a", "uint32_t", 4, 0));
+    format->addItem(DataItem("b", "uint32_t", 4, 4));
+
+    ReceiveMug m;
+    m.setFormat(known, format);
+
+    zmq::context_t context(1);
+    zmq::socket_t sender(context, ZMQ_PAIR);
+    zmq::socket_t receiver(context, ZMQ_PAIR);
+    receiver.bind("inproc://mug_tests");
+    sender.connect("inproc://mug_tests");
+
+
+    sendRow(sender, known, 2);
+    m.receive(receiver);
+    EXPECT_EQ(m.row().size(), UUID_SIZE_BYTES + TIMESTAMP_SIZE_BYTES + 8);
+    EXPECT_EQ(m.getDroppedCount(), 0);
+
+    // one column too many for the registered format
+    sendRow(sender, known, 3);
+    m.receive(receiver);
+    EXPECT_EQ(m.getDroppedCount(), 1);
+
+    // rows from a tap whose format hasn't arrived wait for it
+    sendRow(sender, unknown, 2);
+    m.receive(receiver);
+    sendRow(sender, unknown, 1);
+    m.receive(receiver);
+    EXPECT_EQ(m.parked(), 2);
+    EXPECT_EQ(m.getDroppedCount(), 1);
+
+    // once it has, the parked row that matches is kept and the other dropped
+    m.setFormat(unknown, format);
+    sendRow(sender, unknown, 2);
+    m.receive(receiver);
+    EXPECT_EQ(m.parked(), 0);
+    EXPECT_EQ(m.getDroppedCount(), 2);
+
+    // a malformed message is dropped too, rather than ending the thread that received it
+    sender.send(known.data(), known.size());
+    EXPECT_NO_THROW(m.receive(receiver));
+    EXPECT_EQ(m.getDroppedCount(), 3);
+}
+
+TEST(MugTests, ParkedRowsAreBounded)
+{
+    std::string noisy = lager_utils::getUuid();
+    std::string quiet = lager_utils::getUuid();
+    std::string unsubscribed = lager_utils::getUuid();
+
+    ReceiveMug m;
+    m.setTopic(unsubscribed, "/unsubscribed");
+
+    zmq::context_t context(1);
+    zmq::socket_t sender(context, ZMQ_PAIR);
+    zmq::socket_t receiver(context, ZMQ_PAIR);
+    receiver.bind("inproc://mug_parked_tests");
+    sender.connect("inproc://mug_parked_tests");
+
+
+    // one tap can't use up the budget of the others
+    for (unsigned int i = 0; i < MUG_PARKED_ROWS_PER_TAP_MAX + 10; ++i)
+    {
+        sendRow(sender, noisy, 1);
+        m.receive(receiver);
+    }
+
+    EXPECT_EQ(m.parked(), MUG_PARKED_ROWS_PER_TAP_MAX);
+    EXPECT_EQ(m.getDroppedCount(), 10);
+
+    sendRow(sender, quiet, 1);
+    m.receive(receiver);
+    EXPECT_EQ(m.parked(), MUG_PARKED_ROWS_PER_TAP_MAX + 1);
+
+    // a tap that is known but has no format never gets one, so its rows aren't kept
+    sendRow(sender, unsubscribed, 1);
+    m.receive(receiver);
+    EXPECT_EQ(m.parked(), MUG_PARKED_ROWS_PER_TAP_MAX + 1);
+    EXPECT_EQ(m.getDroppedCount(), 11);
+
+    // nor are the ones parked before it became known
+    m.setTopic(quiet, "/quiet");
+    m.flush();
+    EXPECT_EQ(m.parked(), MUG_PARKED_ROWS_PER_TAP_MAX);
+    EXPECT_EQ(m.getDroppedCount(), 12);
+}
+
+TEST(MugTests, BatchedRows)
+{
+    std::string tapUuid = lager_utils::getUuid();
+
+    std::shared_ptr<DataFormat> format(new DataFormat("BEERR01", "/batched"));
+    format->addItem(DataItem("a", "uint32_t", 4, 0));
+    format->addItem(DataItem("b", "uint32_t", 4, 4));
+
+    std::vector<std::vector<uint32_t>> rows;
+    std::vector<uint64_t> timestamps;
+
+    ReceiveMug m;
+    m.setFormat(tapUuid, format);
+    m.addSink(collectRows(rows, timestamps));
+
+    zmq::context_t context(1);
+    zmq::socket_t sender(context, ZMQ_PAIR);
+    zmq::socket_t receiver(context, ZMQ_PAIR);
+    receiver.bind("inproc://mug_batched_tests");
+    sender.connect("inproc://mug_batched_tests");
+
+
+    std::vector<uint8_t> batch;
+    appendRecord(batch, 10, packedRow({1, 2}));
+    appendRecord(batch, 11, packedRow({3, 4}));
+    appendRecord(batch, 12, packedRow({5, 6}));
+
+    // the timestamp frame is the first record's, each row gets its own
+    sendPayload(sender, tapUuid, DATA_FLAG_BATCHED, 10, batch);
+    m.receive(receiver);
+
+    ASSERT_EQ(rows.size(), 3);
+    EXPECT_EQ(rows[0], std::vector<uint32_t>({1, 2}));
+    EXPECT_EQ(rows[1], std::vector<uint32_t>({3, 4}));
+    EXPECT_EQ(rows[2], std::vector<uint32_t>({5, 6}));
+    EXPECT_EQ(timestamps, std::vector<uint64_t>({10, 11, 12}));
+    EXPECT_EQ(m.getDroppedCount(), 0);
+
+    // a record of the wrong size is dropped on its own, a truncated one takes the rest of the batch with it
+    batch.clear();
+    appendRecord(batch, 13, packedRow({7}));
+    appendRecord(batch, 14, packedRow({8, 9}));
+    appendRecord(batch, 15, packedRow({10, 11}));
+    batch.resize(batch.size() - 1);
+
+    sendPayload(sender, tapUuid, DATA_FLAG_BATCHED, 13, batch);
+    m.receive(receiver);
+
+    ASSERT_EQ(rows.size(), 4);
+    EXPECT_EQ(rows[3], std::vector<uint32_t>({8, 9}));
+    EXPECT_EQ(timestamps[3], 14);
+    EXPECT_EQ(m.getDroppedCount(), 2);
+}
+
+TEST(MugTests, BatchedDeltaRows)
+{
+    std::string tapUuid = lager_utils::getUuid();
+
+    std::shared_ptr<DataFormat> format(new DataFormat("BEERR01", "/batcheddelta"));
+    format->addItem(DataItem("a", "uint32_t", 4, 0));
+    format->addItem(DataItem("b", "uint32_t", 4, 4));
+
+    std::vector<std::vector<uint32_t>> rows;
+    std::vector<uint64_t> timestamps;
+
+    ReceiveMug m;
+    m.setFormat(tapUuid, format);
+    m.addSink(collectRows(rows, timestamps));
+
+    zmq::context_t context(1);
+    zmq::socket_t sender(context, ZMQ_PAIR);
+    zmq::socket_t receiver(context, ZMQ_PAIR);
+    receiver.bind("inproc://mug_batched_delta_tests");
+    sender.connect("inproc://mug_batched_delta_tests");
+
+
+    // joining mid stream, the rows before the first keyframe can't be rebuilt
+    std::vector<uint8_t> batch;
+    appendRecord(batch, 20, deltaRow(7, 0x01, {1}));
+    appendRecord(batch, 21, deltaRow(8, 0x03, {2, 3}));
+    appendRecord(batch, 22, deltaRow(9, 0x02, {4}));
+    appendRecord(batch, 23, deltaRow(10, 0x00, {}));
+
+    sendPayload(sender, tapUuid, DATA_FLAG_BATCHED | DATA_FLAG_DELTA, 20, batch);
+    m.receive(receiver);
+
+    ASSERT_EQ(rows.size(), 3);
+    EXPECT_EQ(rows[0], std::vector<uint32_t>({2, 3}));
+    EXPECT_EQ(rows[1], std::vector<uint32_t>({2, 4}));
+    EXPECT_EQ(rows[2], std::vector<uint32_t>({2, 4}));
+    EXPECT_EQ(timestamps, std::vector<uint64_t>({21, 22, 23}));
+
+    // the next batch carries on from the last row of this one
+    batch.clear();
+    appendRecord(batch, 24, deltaRow(11, 0x01, {5}));
+
+    sendPayload(sender, tapUuid, DATA_FLAG_BATCHED | DATA_FLAG_DELTA, 24, batch);
+    m.receive(receiver);
+
+    ASSERT_EQ(rows.size(), 4);
+    EXPECT_EQ(rows[3], std::vector<uint32_t>({5, 4}));
+    EXPECT_EQ(timestamps[3], 24);
+    EXPECT_EQ(m.getDroppedCount(), 0);
+}
+
+TEST(MugTests, DeltaSequenceGap)
+{
+    std::string tapUuid = lager_utils::getUuid();
+
+    std::shared_ptr<DataFormat> format(new DataFormat("BEERR01", "/gap"));
+    format->addItem(DataItem("a", "uint32_t", 4, 0));
+    format->addItem(DataItem("b", "uint32_t", 4, 4));
+
+    std::vector<std::vector<uint32_t>> rows;
+    std::vector<uint64_t> timestamps;
+
+    ReceiveMug m;
+    m.setFormat(tapUuid, format);
+    m.addSink(collectRows(rows, timestamps));
+
+    zmq::context_t context(1);
+    zmq::socket_t sender(context, ZMQ_PAIR);
+    zmq::socket_t receiver(context, ZMQ_PAIR);
+    receiver.bind("inproc://mug_gap_tests");
+    sender.connect("inproc://mug_gap_tests");
+
+
+    sendPayload(sender, tapUuid, DATA_FLAG_DELTA, 1, deltaRow(0, 0x03, {1, 2}));
+    m.receive(receiver);
+    sendPayload(sender, tapUuid, DATA_FLAG_DELTA, 2, deltaRow(1, 0x01, {3}));
+    m.receive(receiver);
+
+    // sequence 2 never arrives, so this row can't be trusted to apply to the last one
+    sendPayload(sender, tapUuid, DATA_FLAG_DELTA, 4, deltaRow(3, 0x02, {5}));
+    m.receive(receiver);
+
+    // until the next keyframe
+    sendPayload(sender, tapUuid, DATA_FLAG_DELTA, 5, deltaRow(4, 0x03, {6, 7}));
+    m.receive(receiver);
+
+    ASSERT_EQ(rows.size(), 3);
+    EXPECT_EQ(rows[0], std::vector<uint32_t>({1, 2}));
+    EXPECT_EQ(rows[1], std::vector<uint32_t>({3, 2}));
+    EXPECT_EQ(rows[2], std::vector<uint32_t>({6, 7}));
+    EXPECT_EQ(timestamps, std::vector<uint64_t>({1, 2, 5}));
+
+    // a malformed message of the tap loses its place too
+    sendPayload(sender, tapUuid, DATA_FLAG_DELTA, 6, std::vector<uint8_t>(2));
+    m.receive(receiver);
+    sendPayload(sender, tapUuid, DATA_FLAG_DELTA, 7, deltaRow(6, 0x01, {8}));
+    m.receive(receiver);
+
+    EXPECT_EQ(rows.size(), 3);
+    EXPECT_EQ(m.getDroppedCount(), 1);
+}
+
+TEST(MugTests, SinksShareRow)
+{
+    std::string tapUuid = lager_utils::getUuid();
+
+    std::shared_ptr<DataFormat> format(new DataFormat("BEERR01", "/sinks"));
+    format->addItem(DataItem("a", "uint32_t", 4, 0));
+    format->addItem(DataItem("b", "uint32_t", 4, 4));
+
+    std::vector<const uint8_t*> payloads;
+    size_t rows = 0;
+
+    std::shared_ptr<FanOutSink> fanOut(new FanOutSink());
+
+    for (int i = 0; i < 2; ++i)
+    {
+        fanOut->add(std::make_shared<CallbackSink>([&](const MugRow & row)
+        {
+            EXPECT_EQ(memcmp(row.uuid, tapUuid.data(), UUID_SIZE_BYTES), 0);
+            EXPECT_EQ(row.timestamp, 0);
+            EXPECT_EQ(row.payloadSize, 8);
+            EXPECT_EQ(row.format, format.get());
+            EXPECT_EQ(row.record() + TIMESTAMP_SIZE_BYTES, row.payload);
+            payloads.push_back(row.payload);
+        }));
+    }
+
+    ReceiveMug m;
+    m.setFormat(tapUuid, format);
+    m.addSink(fanOut);
+    m.addSink(std::make_shared<CallbackSink>([&](const MugRow&)
+    {
+        rows++;
+    }));
+
+    EXPECT_ANY_THROW(m.addSink(std::shared_ptr<MugSink>()));
+
+    zmq::context_t context(1);
+    zmq::socket_t sender(context, ZMQ_PAIR);
+    zmq::socket_t receiver(context, ZMQ_PAIR);
+    receiver.bind("inproc://mug_sink_tests");
+    sender.connect("inproc://mug_sink_tests");
+
+
+    sendRow(sender, tapUuid, 2);
+    m.receive(receiver);
+
+    // every sink saw the mug's own buffer
+    ASSERT_EQ(payloads.size(), 2);
+    EXPECT_EQ(payloads[0], payloads[1]);
+    EXPECT_EQ(payloads[0], m.row().data() + UUID_SIZE_BYTES + TIMESTAMP_SIZE_BYTES);
+    EXPECT_EQ(rows, 1);
+}
+
+TEST(MugTests, PipelineKeepsTapOrder)
+{
+    const size_t tapCount = 3;
+    const uint32_t rowsPerTap = 200;
+
+    std::shared_ptr<DataFormat> format(new DataFormat("BEERR01", "/pipeline"));
+    format->addItem(DataItem("sequence", "uint32_t", 4, 0));
+
+    std::vector<std::string> tapUuids;
+    std::map<std::string, std::vector<uint32_t>> received; // only touched by the writer thread
+
+    PipelineMug m;
+    m.setPipeline(2, 1024);
+
+    for (size_t i = 0; i < tapCount; ++i)
+    {
+        tapUuids.push_back(lager_utils::getUuid());
+        m.setFormat(tapUuids.back(), format);
+    }
+
+    m.addSink(std::make_shared<CallbackSink>([&](const MugRow & row)
+    {
+        uint32_t sequence;
+        memcpy(&sequence, row.payload, sizeof(sequence));
+        received[std::string(reinterpret_cast<const char*>(row.uuid), UUID_SIZE_BYTES)].push_back(sequence);
+    }));
+
+    zmq::context_t context(1);
+    zmq::socket_t sender(context, ZMQ_PAIR);
+    zmq::socket_t receiver(context, ZMQ_PAIR);
+    receiver.bind("inproc://mug_pipeline_tests");
+    sender.connect("inproc://mug_pipeline_tests");
+
+    m.begin();
+
+    EXPECT_EQ(m.getQueueDepths().decode.size(), 2);
+    EXPECT_EQ(m.getQueueDepths().write.size(), 2);
+
+    for (uint32_t sequence = 0; sequence < rowsPerTap; ++sequence)
+    {
+        for (size_t i = 0; i < tapCount; ++i)
+        {
+            sendRow(sender, tapUuids[i], 1, sequence);
+            m.dispatch(receiver);
+        }
+    }
+
+    // whatever is queued is still written
+    m.end();
+
+    EXPECT_EQ(m.getDroppedCount(), 0);
+    EXPECT_TRUE(m.getQueueDepths().decode.empty());
+    ASSERT_EQ(received.size(), tapCount);
+
+    for (auto i = received.begin(); i != received.end(); ++i)
+    {
+        ASSERT_EQ(i->second.size(), rowsPerTap);
+
+        for (uint32_t sequence = 0; sequence < rowsPerTap; ++sequence)
+        {
+            EXPECT_EQ(i->second[sequence], sequence);
+        }
+    }
+}
+
+TEST(MugTests, PipelineDropsMalformedMessages)
+{
+    std::string tapUuid = lager_utils::getUuid();
+
+    std::shared_ptr<DataFormat> format(new DataFormat("BEERR01", "/malformed"));
+    format->addItem(DataItem("sequence", "uint32_t", 4, 0));
+
+    std::vector<uint32_t> received; // only touched by the writer thread
+
+    PipelineMug m;
+    m.setPipeline(1, 2);
+    m.setFormat(tapUuid, format);
+
+    m.addSink(std::make_shared<CallbackSink>([&](const MugRow & row)
+    {
+        uint32_t sequence;
+        memcpy(&sequence, row.payload, sizeof(sequence));
+        received.push_back(sequence);
+    }));
+
+    zmq::context_t context(1);
+    zmq::socket_t sender(context, ZMQ_PAIR);
+    zmq::socket_t receiver(context, ZMQ_PAIR);
+    receiver.bind("inproc://mug_malformed_tests");
+    sender.connect("inproc://mug_malformed_tests");
+
+    m.begin();
+
+    // just the uuid frame
+    sender.send(tapUuid.data(), tapUuid.size());
+    m.dispatch(receiver);
+
+    // the decode thread survives it, and with only two messages the last row needs the malformed one handed back
+    for (uint32_t sequence = 0; sequence < 2; ++sequence)
+    {
+        for (int retries = 0; retries < 100 && m.getQueueDepths().decode[0] > 0; ++retries)
+        {
+            lager_utils::sleepMillis(10);
+        }
+
+        sendRow(sender, tapUuid, 1, sequence);
+        m.dispatch(receiver);
+    }
+
+    m.end();
+
+    EXPECT_EQ(m.getDroppedCount(), 1);
+    ASSERT_EQ(received.size(), 2);
+    EXPECT_EQ(received[0], 0);
+    EXPECT_EQ(received[1], 1);
+}
+
+namespace
+{
+    // exposes the filter bookkeeping without a bartender
+    class FilterMug : public Mug
+    {
+    public:
+        void setTap(const std::string& tapUuid, const std::string& key)
+        {
+            uuidMap[tapUuid] = key;
+            updateFilters();
+        }
+
+        void removeTap(const std::string& tapUuid)
+        {
+            uuidMap.erase(tapUuid);
+            updateFilters();
+        }
+
+        std::set<std::string> filters()
+        {
+            filtersChanged = false;
+            return subscriberFilters;
+        }
+
+        bool changed() const
+        {
+            return filtersChanged;
+        }
+    };
+}
+
+TEST(MugTests, SubscriptionFilters)
+{
+    std::string armA = lager_utils::getUuid();
+    std::string legA = lager_utils::getUuid();
+    std::string armB = lager_utils::getUuid();
+
+    FilterMug m;
+    m.setTap(armA, "/RobotA/arm");
+    m.setTap(armB, "/RobotB/arm");
+
+    // everything until something is subscribed
+    EXPECT_EQ(m.filters(), std::set<std::string>({""}));
+
+    m.subscribe("/RobotA/*");
+    m.setTap(legA, "/RobotA/leg");
+    EXPECT_TRUE(m.changed());
+    EXPECT_EQ(m.filters(), std::set<std::string>({armA, legA}));
+
+    // an unrelated tap coming and going leaves the filters alone
+    std::string other = lager_utils::getUuid();
+    m.setTap(other, "/RobotC/arm");
+    m.removeTap(other);
+    EXPECT_FALSE(m.changed());
+
+    m.removeTap(legA);
+    EXPECT_TRUE(m.changed());
+    EXPECT_EQ(m.filters(), std::set<std::string>({armA}));
+
+    m.subscribe("/Robot?/arm");
+    m.setTap(armB, "/RobotB/arm");
+    EXPECT_EQ(m.filters(), std::set<std::string>({armA, armB}));
+}
+
+namespace
+{
+    // applies CHP maps without a bartender
+    class FormatMug : public Mug
+    {
+    public:
+        FormatMug()
+        {
+            keg.reset(new Keg("."));
+            formatParser.reset(new DataFormatParser);
+        }
+
+        void update(const std::map<std::string, std::string>& newHashMap,
+                    const std::map<std::string, std::string>& newUuidMap)
+        {
+            updateFormats(newHashMap, newUuidMap);
+        }
+
+        std::shared_ptr<DataFormat> format(const std::string& tapUuid)
+        {
+            return getFormat(tapUuid);
+        }
+
+        size_t formatCount() const
+        {
+            return formatMap.size();
+        }
+
+        size_t cacheSize() const
+        {
+            return formatCache.size();
+        }
+    };
+
+    std::string formatXml(const std::string& key, const std::string& column)
+    {
+        return "<?xml version=\"1.0\" encoding=\"UTF-8\"?><format version=\"BEERR01\" key=\"" + key + "\">"
+               "<item name=\"" + column + "\" type=\"uint32_t\" size=\"4\" offset=\"0\"/></format>";
+    }
+}
+
+TEST(MugTests, IncrementalFormatUpdates)
+{
+    std::string a = lager_utils::getUuid();
+    std::string b = lager_utils::getUuid();
+    std::string restartedA = lager_utils::getUuid();
+
+    std::map<std::string, std::string> hashMap; // <topic name, xml format>
+    std::map<std::string, std::string> uuidMap; // <uuid, topic name>
+
+    hashMap["/a"] = formatXml("/a", "x");
+    uuidMap[a] = "/a";
+
+    FormatMug m;
+    m.update(hashMap, uuidMap);
+
+    std::shared_ptr<DataFormat> formatA = m.format(a);
+    ASSERT_TRUE(formatA != nullptr);
+
+    // a new tap leaves the formats already parsed alone
+    hashMap["/b"] = formatXml("/b", "y");
+    uuidMap[b] = "/b";
+    m.update(hashMap, uuidMap);
+
+    EXPECT_EQ(m.format(a), formatA);
+    ASSERT_TRUE(m.format(b) != nullptr);
+    EXPECT_EQ(m.format(b)->getKey(), "/b");
+
+    // the same format under a new uuid comes from the cache
+    uuidMap[restartedA] = "/a";
+    m.update(hashMap, uuidMap);
+
+    EXPECT_EQ(m.format(restartedA), formatA);
+
+    // taps that aren't subscribed aren't parsed, and are once they are
+    std::string c = lager_utils::getUuid();
+    hashMap["/c"] = formatXml("/c", "z");
+    uuidMap[c] = "/c";
+    m.subscribe("/a");
+    m.update(hashMap, uuidMap);
+
+    EXPECT_TRUE(m.format(c) == nullptr);
+
+    m.subscribe("/c");
+    m.update(hashMap, uuidMap);
+
+    EXPECT_TRUE(m.format(c) != nullptr);
+}
+
+TEST(MugTests, FormatUpdatesForgetUnusedFormats)
+{
+    std::string a = lager_utils::getUuid();
+    std::string b = lager_utils::getUuid();
+
+    std::map<std::string, std::string> hashMap; // <topic name, xml format>
+    std::map<std::string, std::string> uuidMap; // <uuid, topic name>
+
+    hashMap["/a"] = formatXml("/a", "x");
+    hashMap["/b"] = "<format";
+    uuidMap[a] = "/a";
+    uuidMap[b] = "/b";
+
+    FormatMug m;
+    EXPECT_NO_THROW(m.update(hashMap, uuidMap));
+
+    // a format that doesn't parse leaves the tap without one, but stays cached so it isn't parsed again
+    EXPECT_TRUE(m.format(a) != nullptr);
+    EXPECT_TRUE(m.format(b) == nullptr);
+    EXPECT_EQ(m.formatCount(), 1);
+    EXPECT_EQ(m.cacheSize(), 2);
+
+    // once a tap changes to a format that does parse, the broken one is no longer cached
+    hashMap["/b"] = formatXml("/b", "y");
+    m.update(hashMap, uuidMap);
+
+    EXPECT_TRUE(m.format(b) != nullptr);
+    EXPECT_EQ(m.formatCount(), 2);
+    EXPECT_EQ(m.cacheSize(), 2);
+
+    // taps that are gone or unsubscribed are forgotten along with their formats
+    uuidMap.erase(a);
+    m.update(hashMap, uuidMap);
+
+    EXPECT_TRUE(m.format(a) == nullptr);
+    EXPECT_EQ(m.formatCount(), 1);
+    EXPECT_EQ(m.cacheSize(), 1);
+
+    m.subscribe("/a");
+    m.update(hashMap, uuidMap);
+
+    EXPECT_EQ(m.formatCount(), 0);
+    EXPECT_EQ(m.cacheSize(), 0);
+}
+
 int main(int argc, char* argv[])
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,154 @@
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "lager/data_ref_item.h"
+#include "lager/row_converter.h"
+
+// a mixed row of doubles, uint32s and uint16s, range(0) of each
+struct BenchRow
+{
+    std::vector<double> doubles;
+    std::vector<uint32_t> uints;
+    std::vector<uint16_t> ushorts;
+    std::vector<AbstractDataRefItem*> items;
+    std::vector<DataItem> format;
+    size_t rowSize;
+
+    explicit BenchRow(size_t count): doubles(count, 1.5), uints(count, 0x01020304), ushorts(count, 0x0102), rowSize(0)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            add(new DataRefItem<double>("double", &doubles[i]));
+            add(new DataRefItem<uint32_t>("uint", &uints[i]));
+            add(new DataRefItem<uint16_t>("ushort", &ushorts[i]));
+        }
+    }
+
+    ~BenchRow()
+    {
+        for (auto i = items.begin(); i != items.end(); ++i)
+        {
+            delete *i;
+        }
+    }
+
+    void add(AbstractDataRefItem* item)
+    {
+        item->setOffset(rowSize);
+        rowSize += item->getSize();
+        items.push_back(item);
+        format.push_back(DataItem(item->getName(), item->getType(), item->getSize(), item->getOffset()));
+    }
+};
+
+static void rowPerItemSwap(benchmark::State& state)
+{
+    BenchRow r(state.range(0));
+    std::vector<uint8_t> row(r.rowSize);
+
+    for (auto _ : state)
+    {
+        for (auto i = r.items.begin(); i != r.items.end(); ++i)
+        {
+            (*i)->getNetworkDataRef(row.data() + (*i)->getOffset());
+        }
+
+        benchmark::DoNotOptimize(row.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * r.rowSize);
+}
+
+BENCHMARK(rowPerItemSwap)->Arg(10)->Arg(100)->Arg(1000);
+
+// what Tap::log() does now, the swap moves to the publisher thread
+static void rowHostCopy(benchmark::State& state)
+{
+    BenchRow r(state.range(0));
+    std::vector<uint8_t> row(r.rowSize);
+
+    for (auto _ : state)
+    {
+        for (auto i = r.items.begin(); i != r.items.end(); ++i)
+        {
+            (*i)->getHostDataRef(row.data() + (*i)->getOffset());
+        }
+
+        benchmark::DoNotOptimize(row.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * r.rowSize);
+}
+
+BENCHMARK(rowHostCopy)->Arg(10)->Arg(100)->Arg(1000);
+
+// what the publisher thread does with each captured row
+static void rowConverterSwap(benchmark::State& state)
+{
+    BenchRow r(state.range(0));
+    RowConverter converter(r.format);
+    std::vector<uint8_t> row(r.rowSize);
+
+    for (auto i = r.items.begin(); i != r.items.end(); ++i)
+    {
+        (*i)->getHostDataRef(row.data() + (*i)->getOffset());
+    }
+
+    for (auto _ : state)
+    {
+        converter.toNetwork(row.data(), row.data());
+        benchmark::DoNotOptimize(row.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * r.rowSize);
+    state.SetLabel(RowConverter::getKernelName());
+}
+
+BENCHMARK(rowConverterSwap)->Arg(10)->Arg(100)->Arg(1000);
+
+// arrays are where the plan pays off the most, a single run per column
+static void arrayPerElementSwap(benchmark::State& state)
+{
+    std::vector<double> values(state.range(0), 1.5);
+    std::vector<uint8_t> row(values.size() * sizeof(double));
+
+    for (auto _ : state)
+    {
+        for (size_t i = 0; i < values.size(); ++i)
+        {
+            uint64_t tmp;
+            memcpy(&tmp, &values[i], sizeof(tmp));
+            tmp = lager_utils::htonll(tmp);
+            memcpy(row.data() + i * sizeof(double), &tmp, sizeof(tmp));
+        }
+
+        benchmark::DoNotOptimize(row.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * row.size());
+}
+
+BENCHMARK(arrayPerElementSwap)->Arg(16)->Arg(1024)->Arg(65536);
+
+static void arrayConverterSwap(benchmark::State& state)
+{
+    std::vector<double> values(state.range(0), 1.5);
+    std::vector<uint8_t> row(values.size() * sizeof(double));
+    std::vector<DataItem> format;
+    format.push_back(DataItem("values", "float64", row.size(), 0, values.size()));
+    RowConverter converter(format);
+
+    for (auto _ : state)
+    {
+        converter.toNetwork(reinterpret_cast<const uint8_t*>(values.data()), row.data());
+        benchmark::DoNotOptimize(row.data());
+    }
+
+    state.SetBytesProcessed(state.iterations() * row.size());
+    state.SetLabel(RowConverter::getKernelName());
+}
+
+BENCHMARK(arrayConverterSwap)->Arg(16)->Arg(1024)->Arg(65536);
+
+BENCHMARK_MAIN();
@@ -2,53 +2,140 @@
 
 #include "lager/tap.h"
 #include "lager/lager_utils.h"
+#include "lager/seq_lock.h"
 
-static void tapInitHundredUints(benchmark::State& state)
+// range(0) is the column count, range(1) is 1 to register them with one addItems() call instead of addItem() each.
+// The values are allocated up front so the item pointers stay valid, and each iteration gets a fresh tap, otherwise
+// every name after the first pass is a duplicate.
+static void tapAddItems(benchmark::State& state)
 {
-    int arraySize = 100;
-    std::stringstream ss;
+    size_t columns = state.range(0);
+    std::vector<uint32_t> values(columns, 0);
 
-    Tap t;
-    t.init("localhost", 12345, 1000);
+    std::vector<std::string> names;
+    names.reserve(columns);
 
-    std::vector<uint32_t> array;
+    for (size_t i = 0; i < columns; ++i)
+    {
+        names.push_back("array" + std::to_string(i));
+    }
 
     for (auto _ : state)
     {
-        for (unsigned int i = 0; i < arraySize; ++i)
+        state.PauseTiming();
+        std::unique_ptr<Tap> t(new Tap());
+
+        std::vector<AbstractDataRefItem*> items;
+        items.reserve(columns);
+
+        for (size_t i = 0; i < columns; ++i)
         {
-            ss.clear();
-            ss << "array" << i;
-            array.push_back(uint32_t(0));
-            t.addItem(new DataRefItem<uint32_t>(ss.str(), &array[i]));
+            items.push_back(new DataRefItem<uint32_t>(names[i], &values[i]));
         }
+        state.ResumeTiming();
+
+        if (state.range(1))
+        {
+            t->addItems(items);
+        }
+        else
+        {
+            for (auto i = items.begin(); i != items.end(); ++i)
+            {
+                t->addItem(*i);
+            }
+        }
+
+        state.PauseTiming();
+        t.reset();
+        state.ResumeTiming();
     }
+
+    state.SetItemsProcessed(state.iterations() * columns);
 }
 
-BENCHMARK(tapInitHundredUints);
+BENCHMARK(tapAddItems)->ArgsProduct({{100, 1000, 10000, 100000}, {0, 1}})->Unit(benchmark::kMicrosecond);
 
-static void tapInitThousandUints(benchmark::State& state)
+// exposes the row capture so it can be timed without starting the tap
+class CaptureTap : public Tap
 {
-    int arraySize = 1000;
-    std::stringstream ss;
+public:
+    void plan()
+    {
+        buildCapturePlan();
+    }
 
-    Tap t;
-    t.init("localhost", 12345, 1000);
+    void snapshot(uint8_t* row)
+    {
+        captureSnapshot(row);
+    }
 
-    std::vector<uint32_t> array;
+    size_t runs() const
+    {
+        return capturePlan.size();
+    }
+};
+
+// range(0) is the column count, range(1) is 1 to lay the values out contiguously (one copy per row) or 2 to leave
+// a gap after each (one copy per column), range(2) is 1 to capture under a SeqLock
+static void tapCaptureRow(benchmark::State& state)
+{
+    size_t columns = state.range(0);
+    size_t stride = state.range(1);
+    SeqLock lock;
+
+    std::vector<double> values(columns * stride, 1.0);
+    std::vector<uint8_t> row(columns * sizeof(double));
+
+    CaptureTap t;
+
+    for (size_t i = 0; i < columns; ++i)
+    {
+        std::stringstream ss;
+        ss << "value" << i;
+        t.addItem(new DataRefItem<double>(ss.str(), &values[i * stride]));
+    }
+
+    if (state.range(2))
+    {
+        t.setSnapshotLock(&lock);
+    }
+
+    t.plan();
 
     for (auto _ : state)
     {
-        for (unsigned int i = 0; i < arraySize; ++i)
-        {
-            ss.clear();
-            ss << "array" << i;
-            array.push_back(uint32_t(0));
-            t.addItem(new DataRefItem<uint32_t>(ss.str(), &array[i]));
-        }
+        t.snapshot(row.data());
+        benchmark::DoNotOptimize(row.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.counters["copies/row"] = static_cast<double>(t.runs());
+    state.SetBytesProcessed(state.iterations() * row.size());
+}
+
+BENCHMARK(tapCaptureRow)->ArgsProduct({{10, 100, 1000}, {1, 2}, {0, 1}});
+
+// range(0) is the LagerClockSource, what log() pays per row for its timestamp
+static void tapClockNow(benchmark::State& state)
+{
+    LagerClockSource source = static_cast<LagerClockSource>(state.range(0));
+
+    if (!LagerClock::isSupported(source))
+    {
+        state.SkipWithError("clock source not supported");
+        return;
+    }
+
+    LagerClock clock(source);
+
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(clock.now());
     }
 }
 
-BENCHMARK(tapInitThousandUints);
+BENCHMARK(tapClockNow)->DenseRange(static_cast<int>(LagerClockSource::REALTIME),
+                                   static_cast<int>(LagerClockSource::TSC));
 
 BENCHMARK_MAIN();
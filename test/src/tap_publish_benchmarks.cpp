@@ -0,0 +1,148 @@
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <csignal>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lager/tap.h"
+#include "lager/lager_utils.h"
+
+// Counts every heap allocation in the process, including the ones libzmq makes with malloc from its io thread.
+// The subscriber runs in a child process so only the publishing side is counted.
+namespace
+{
+    std::atomic<uint64_t> allocationCount(0);
+    std::atomic<uint64_t> allocationBytes(0);
+
+    const int BASE_PORT = 12345;
+    const size_t COLUMNS = 100;
+
+    void countAllocation(size_t size)
+    {
+        allocationCount.fetch_add(1, std::memory_order_relaxed);
+        allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+#ifdef __GLIBC__
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+
+    void* malloc(size_t size)
+    {
+        countAllocation(size);
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        countAllocation(count * size);
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, size_t size)
+    {
+        countAllocation(size);
+        return __libc_realloc(ptr, size);
+    }
+}
+#endif
+
+// exposes the queue so each row can be waited on until the publisher has sent it
+class PublishTap : public Tap
+{
+public:
+    bool drained() const
+    {
+        return ringBuffer->empty();
+    }
+};
+
+// range(0) is the buffer pool size (0 copies every payload), range(1) the rows per message
+static void tapPublishAllocations(benchmark::State& state)
+{
+    std::vector<double> values(COLUMNS, 1.0);
+
+    PublishTap t;
+    t.init("localhost", BASE_PORT, 1000);
+
+    for (size_t i = 0; i < COLUMNS; ++i)
+    {
+        std::stringstream ss;
+        ss << "value" << i;
+        t.addItem(new DataRefItem<double>(ss.str(), &values[i]));
+    }
+
+    t.setPackedPayload(true);
+    t.setBufferPoolSize(state.range(0));
+    t.setBatching(state.range(1), 0);
+    t.start("/publish");
+
+    // lets the connection to the subscriber and zmq's pipes settle before counting
+    for (int i = 0; i < 1000; ++i)
+    {
+        t.log();
+
+        while (!t.drained())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    lager_utils::sleepMillis(100);
+
+    uint64_t startCount = allocationCount.load();
+    uint64_t startBytes = allocationBytes.load();
+
+    for (auto _ : state)
+    {
+        values[0] += 1.0;
+        t.log();
+
+        while (!t.drained())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    double rows = static_cast<double>(state.iterations());
+    state.counters["allocs/row"] = (allocationCount.load() - startCount) / rows;
+    state.counters["bytes/row"] = (allocationBytes.load() - startBytes) / rows;
+
+    t.stop();
+}
+
+BENCHMARK(tapPublishAllocations)->Args({0, 1})->Args({64, 1})->Args({0, 16})->Args({64, 16})->UseRealTime();
+
+int main(int argc, char** argv)
+{
+    pid_t subscriber = fork();
+
+    if (subscriber == 0)
+    {
+        zmq::context_t context(1);
+        zmq::socket_t socket(context, ZMQ_SUB);
+        socket.setsockopt(ZMQ_SUBSCRIBE, "", 0);
+        socket.bind(lager_utils::getLocalUri(BASE_PORT + FORWARDER_FRONTEND_OFFSET).c_str());
+
+        zmq::message_t msg;
+
+        while (true)
+        {
+            socket.recv(&msg);
+        }
+    }
+
+    benchmark::Initialize(&argc, argv);
+    benchmark::RunSpecifiedBenchmarks();
+
+    kill(subscriber, SIGKILL);
+    waitpid(subscriber, nullptr, 0);
+
+    return 0;
+}
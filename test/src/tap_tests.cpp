@@ -1,10 +1,76 @@
+#include <atomic>
+#include <cstdlib>
 #include <memory>
+#include <mutex>
+#include <new>
+#include <set>
+#include <sstream>
 
 #include <gtest/gtest.h>
 
 #include "lager/tap.h"
+#include "lager/buffer_pool.h"
+#include "lager/data_format_parser.h"
+#include "lager/lager_clock.h"
 #include "lager/lager_utils.h"
 #include "lager/data_ref_item.h"
+#include "lager/row_ring_buffer.h"
+#include "lager/row_sampler.h"
+#include "lager/seq_lock.h"
+#include "lager/typed_tap.h"
+
+// counts the allocations made by each thread, so a test can check a code path doesn't allocate.  With glibc every
+// malloc, calloc and realloc is counted, which covers operator new as well as C allocations.
+namespace
+{
+    thread_local uint64_t threadAllocations = 0;
+}
+
+#ifdef __GLIBC__
+extern "C"
+{
+    void* __libc_malloc(size_t size);
+    void* __libc_calloc(size_t count, size_t size);
+    void* __libc_realloc(void* ptr, size_t size);
+
+    void* malloc(size_t size)
+    {
+        threadAllocations++;
+        return __libc_malloc(size);
+    }
+
+    void* calloc(size_t count, size_t size)
+    {
+        threadAllocations++;
+        return __libc_calloc(count, size);
+    }
+
+    void* realloc(void* ptr, size_t size)
+    {
+        threadAllocations++;
+        return __libc_realloc(ptr, size);
+    }
+}
+#else
+void* operator new(size_t size)
+{
+    threadAllocations++;
+
+    void* p = malloc(size);
+
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+#endif
 
 TEST(TapTests, BadPortNumber)
 {
@@ -70,32 +136,1506 @@ TEST(TapTests, StartWithNoDataItems)
     EXPECT_ANY_THROW(t.start("/thisshouldfail"));
 }
 
-namespace tap_tests
+TEST(TapTests, ZeroQueueDepth)
 {
+    Tap t;
+    EXPECT_ANY_THROW(t.setQueueDepth(0));
+}
 
-    class LagerTester
+TEST(TapTests, LogBeforeStart)
+{
+    Tap t;
+    uint32_t uint1 = 0;
+
+    t.init("localhost", 12345, 1000);
+    t.addItem(new DataRefItem<uint32_t>("num1", &uint1));
+
+    EXPECT_NO_THROW(t.log());
+    EXPECT_EQ(t.getDroppedCount(), 0);
+}
+
+namespace tap_tests
+{
+    // exposes the queue so a test can tell when the publisher has taken every row
+    class PublishTap : public Tap
     {
     public:
-        LagerTester() {}
-        ~LagerTester()
+        bool drained() const
         {
-            tap.stop();
+            return ringBuffer->empty();
         }
+    };
+}
 
-        void initTap(const std::string& hostName, int port, int timeout)
+TEST(TapTests, BusySpin)
+{
+    tap_tests::PublishTap t;
+    uint32_t uint1 = 0;
+
+    t.init("localhost", 12345, 1000);
+    t.setBusySpin(true);
+    t.addItem(new DataRefItem<uint32_t>("num1", &uint1));
+    t.start("/busyspin");
+
+    for (unsigned int i = 0; i < 100; ++i)
+    {
+        uint1++;
+        t.log();
+    }
+
+    // a spinning publisher never sleeps, so the queue empties without anything waking it
+    for (int retries = 0; retries < 100 && !t.drained(); ++retries)
+    {
+        lager_utils::sleepMillis(10);
+    }
+
+    EXPECT_TRUE(t.drained());
+    EXPECT_EQ(t.getDroppedCount(), 0);
+
+    t.stop();
+}
+
+TEST(TapTests, StopPublishesQueuedRows)
+{
+    // stands in for the forwarder's frontend
+    zmq::context_t context(1);
+    zmq::socket_t subscriber(context, ZMQ_SUB);
+    int timeoutMillis = 1000;
+    subscriber.setsockopt(ZMQ_RCVTIMEO, &timeoutMillis, sizeof(timeoutMillis));
+    subscriber.setsockopt(ZMQ_SUBSCRIBE, "", 0);
+    subscriber.bind(lager_utils::getLocalUri(12345 + FORWARDER_FRONTEND_OFFSET).c_str());
+
+    Tap t;
+    uint32_t uint1 = 0;
+
+    t.init("localhost", 12345, 1000);
+    t.setBatching(100, 10000000);
+    t.addItem(new DataRefItem<uint32_t>("num1", &uint1));
+    t.start("/stopflush");
+
+    // gives the subscription time to reach the tap's socket
+    lager_utils::sleepMillis(200);
+
+    const uint32_t rowCount = 3;
+
+    for (uint32_t i = 0; i < rowCount; ++i)
+    {
+        uint1 = i;
+        t.log();
+    }
+
+    // the batch is neither full nor past its linger, stopping has to send it anyway
+    t.stop();
+
+    std::vector<zmq::message_t> frames;
+    int more = 1;
+    size_t moreSize = sizeof(more);
+
+    while (more)
+    {
+        frames.push_back(zmq::message_t());
+        ASSERT_TRUE(subscriber.recv(&frames.back()));
+        subscriber.getsockopt(ZMQ_RCVMORE, &more, &moreSize);
+    }
+
+    // uuid, version, flags, timestamp and the batch
+    ASSERT_EQ(frames.size(), 5);
+    EXPECT_EQ(*static_cast<const uint8_t*>(frames[2].data()) & DATA_FLAG_BATCHED, DATA_FLAG_BATCHED);
+
+    const size_t recordSize = TIMESTAMP_SIZE_BYTES + BATCH_ROW_LENGTH_SIZE_BYTES + sizeof(uint32_t);
+    ASSERT_EQ(frames[4].size(), rowCount * recordSize);
+
+    for (uint32_t i = 0; i < rowCount; ++i)
+    {
+        uint32_t logged;
+        memcpy(&logged, static_cast<const uint8_t*>(frames[4].data()) + i * recordSize + recordSize - sizeof(logged),
+               sizeof(logged));
+        EXPECT_EQ(ntohl(logged), i);
+    }
+}
+
+TEST(TapTests, AddItems)
+{
+    const size_t columns = 1000;
+    std::vector<double> values(columns, 0);
+    uint32_t extra = 0;
+
+    std::vector<AbstractDataRefItem*> items;
+
+    for (size_t i = 0; i < columns; ++i)
+    {
+        items.push_back(new DataRefItem<double>("value" + std::to_string(i), &values[i]));
+    }
+
+    // a duplicate within the batch and one of an item added before it are both dropped
+    items.push_back(new DataRefItem<double>("value7", &values[7]));
+    items.push_back(new DataRefItem<uint32_t>("extra", &extra));
+
+    Tap t;
+    t.addItem(new DataRefItem<uint32_t>("value0", &extra));
+    t.addItems(items);
+
+    const std::vector<AbstractDataRefItem*>& added = t.getItems();
+    ASSERT_EQ(added.size(), columns + 1);
+    EXPECT_EQ(added[0]->getType(), "uint32_t");
+    EXPECT_EQ(added[1]->getName(), "value1");
+    EXPECT_EQ(added[1]->getOffset(), sizeof(uint32_t));
+    EXPECT_EQ(added[columns - 1]->getOffset(), sizeof(uint32_t) + (columns - 2) * sizeof(double));
+    EXPECT_EQ(added[columns]->getName(), "extra");
+    EXPECT_EQ(added[columns]->getOffset(), sizeof(uint32_t) + (columns - 1) * sizeof(double));
+}
+
+TEST(TapTests, ArrayItem)
+{
+    uint32_t values[5] = {1, 0x01020304, 3, 0xdeadbeef, 5};
+    std::array<int16_t, 3> shorts = {{-1, 2, -3}};
+
+    Tap t;
+    t.addItem(new ArrayDataRefItem<uint32_t>("values", values, 5));
+    t.addItem(new DataRefItem<std::array<int16_t, 3>>("shorts", &shorts));
+
+    std::vector<DataItem> items = t.getFormatItems();
+    ASSERT_EQ(items.size(), 2);
+    EXPECT_EQ(items[0].type, "uint32_t");
+    EXPECT_EQ(items[0].size, sizeof(values));
+    EXPECT_EQ(items[0].count, 5);
+    EXPECT_EQ(items[1].type, "int16_t");
+    EXPECT_EQ(items[1].offset, sizeof(values));
+    EXPECT_EQ(items[1].count, 3);
+
+    std::vector<uint8_t> row(sizeof(values) + sizeof(shorts));
+    std::vector<AbstractDataRefItem*> refs = t.getItems();
+
+    for (auto i = refs.begin(); i != refs.end(); ++i)
+    {
+        (*i)->getNetworkDataRef(row.data() + (*i)->getOffset());
+    }
+
+    for (size_t i = 0; i < 5; ++i)
+    {
+        uint32_t tmp;
+        memcpy(&tmp, row.data() + i * sizeof(uint32_t), sizeof(tmp));
+        EXPECT_EQ(tmp, htonl(values[i]));
+    }
+
+    for (size_t i = 0; i < shorts.size(); ++i)
+    {
+        uint16_t tmp;
+        memcpy(&tmp, row.data() + sizeof(values) + i * sizeof(uint16_t), sizeof(tmp));
+        EXPECT_EQ(tmp, htons(static_cast<uint16_t>(shorts[i])));
+    }
+
+    EXPECT_ANY_THROW(ArrayDataRefItem<double>("empty", nullptr, 0));
+}
+
+TEST(RowRingBufferTests, DepthRoundsUpToPowerOfTwo)
+{
+    RowRingBuffer r(3, 5);
+    EXPECT_EQ(r.getDepth(), 8);
+    EXPECT_EQ(r.getSlotSize(), 8);
+}
+
+TEST(RowRingBufferTests, FullAndEmpty)
+{
+    RowRingBuffer r(sizeof(uint32_t), 4);
+
+    EXPECT_TRUE(r.empty());
+    EXPECT_EQ(r.beginRead(), nullptr);
+
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        uint8_t* slot = r.beginWrite();
+        ASSERT_NE(slot, nullptr);
+        memcpy(slot, &i, sizeof(i));
+        r.commitWrite();
+    }
+
+    EXPECT_EQ(r.size(), 4);
+    EXPECT_EQ(r.beginWrite(), nullptr);
+
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        const uint8_t* slot = r.beginRead();
+        ASSERT_NE(slot, nullptr);
+        EXPECT_EQ(*reinterpret_cast<const uint32_t*>(slot), i);
+        r.commitRead();
+    }
+
+    EXPECT_TRUE(r.empty());
+}
+
+TEST(RowRingBufferTests, ProducerConsumerKeepsOrder)
+{
+    const uint32_t count = 10000;
+    RowRingBuffer r(sizeof(uint32_t), 16);
+    std::atomic<bool> stopped(false); // set by the consumer on a failure so the producer doesn't wait forever
+
+    std::thread producer([&r, &stopped, count]()
+    {
+        for (uint32_t i = 0; i < count; ++i)
         {
-            tap.init(hostName, port, timeout);
-            tap.addItem(new DataRefItem<double>("val1", &val1));
-            tap.addItem(new DataRefItem<double>("val2", &val2));
-            tap.start("/lagerTester");
+            uint8_t* slot;
+
+            while (!(slot = r.beginWrite()))
+            {
+                if (stopped)
+                {
+                    return;
+                }
+
+                std::this_thread::yield();
+            }
+
+            memcpy(slot, &i, sizeof(i));
+            r.commitWrite();
         }
+    });
 
-        Tap tap;
-    private:
-        double val1;
-        double val2;
-    };
+    uint32_t expected = 0;
+
+    while (expected < count)
+    {
+        const uint8_t* slot = r.beginRead();
+
+        if (slot)
+        {
+            uint32_t value = *reinterpret_cast<const uint32_t*>(slot);
+            EXPECT_EQ(value, expected);
+
+            if (value != expected)
+            {
+                stopped = true;
+                break;
+            }
+
+            r.commitRead();
+            expected++;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    producer.join();
+
+    ASSERT_EQ(expected, count);
+}
+
+TEST(RowRingBufferTests, MultiProducerFullAndEmpty)
+{
+    RowRingBuffer r(sizeof(uint32_t), 4, true);
+    EXPECT_TRUE(r.isMultiProducer());
+
+    for (uint32_t lap = 0; lap < 3; ++lap)
+    {
+        EXPECT_TRUE(r.empty());
+        EXPECT_EQ(r.beginRead(), nullptr);
+
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            uint8_t* slot = r.beginWrite();
+            ASSERT_NE(slot, nullptr);
+            memcpy(slot, &i, sizeof(i));
+            r.commitWrite(slot);
+        }
+
+        EXPECT_EQ(r.size(), 4);
+        EXPECT_EQ(r.beginWrite(), nullptr);
+
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            const uint8_t* slot = r.beginRead();
+            ASSERT_NE(slot, nullptr);
+            EXPECT_EQ(*reinterpret_cast<const uint32_t*>(slot), i);
+            r.commitRead();
+        }
+    }
+
+    // a claimed slot isn't readable until it is committed, and doesn't hold up the claims after it
+    uint8_t* first = r.beginWrite();
+    uint8_t* second = r.beginWrite();
+    ASSERT_NE(first, nullptr);
+    ASSERT_NE(second, nullptr);
+    EXPECT_NE(first, second);
+
+    r.commitWrite(second);
+    EXPECT_EQ(r.beginRead(), nullptr);
+
+    r.commitWrite(first);
+    EXPECT_EQ(r.beginRead(), first);
+}
+
+TEST(RowRingBufferTests, MultiProducerKeepsPerProducerOrder)
+{
+    const uint32_t producerCount = 4;
+    const uint32_t count = 10000;
+    RowRingBuffer r(2 * sizeof(uint32_t), 16, true);
+
+    std::vector<std::thread> producers;
+
+    for (uint32_t p = 0; p < producerCount; ++p)
+    {
+        producers.push_back(std::thread([&r, p, count]()
+        {
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                uint8_t* slot;
+
+                while (!(slot = r.beginWrite()))
+                {
+                    std::this_thread::yield();
+                }
+
+                memcpy(slot, &p, sizeof(p));
+                memcpy(slot + sizeof(p), &i, sizeof(i));
+                r.commitWrite(slot);
+            }
+        }));
+    }
+
+    std::vector<uint32_t> expected(producerCount, 0);
+    uint32_t received = 0;
+
+    while (received < producerCount * count)
+    {
+        const uint8_t* slot = r.beginRead();
+
+        if (slot)
+        {
+            uint32_t p;
+            uint32_t i;
+            memcpy(&p, slot, sizeof(p));
+            memcpy(&i, slot + sizeof(p), sizeof(i));
+
+            ASSERT_LT(p, producerCount);
+            ASSERT_EQ(i, expected[p]);
+            expected[p]++;
+
+            r.commitRead();
+            received++;
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    for (auto i = producers.begin(); i != producers.end(); ++i)
+    {
+        i->join();
+    }
+
+    EXPECT_TRUE(r.empty());
+}
+
+TEST(BufferPoolTests, AcquireUntilEmpty)
+{
+    std::unique_ptr<BufferPool, BufferPool::Retirer> pool(new BufferPool(10, 3));
+
+    EXPECT_EQ(pool->getBufferSize(), 64);
+
+    std::set<uint8_t*> buffers;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        uint8_t* buffer = pool->acquire();
+        ASSERT_NE(buffer, nullptr);
+        EXPECT_TRUE(pool->owns(buffer));
+        buffers.insert(buffer);
+    }
+
+    EXPECT_EQ(buffers.size(), 3);
+    EXPECT_EQ(pool->getOutstanding(), 3);
+    EXPECT_EQ(pool->acquire(), nullptr);
+
+    uint8_t* returned = *buffers.begin();
+    BufferPool::release(returned, pool.get());
+
+    EXPECT_EQ(pool->getOutstanding(), 2);
+    EXPECT_EQ(pool->acquire(), returned);
+
+    for (auto i = buffers.begin(); i != buffers.end(); ++i)
+    {
+        BufferPool::release(*i, pool.get());
+    }
+
+    EXPECT_EQ(pool->getOutstanding(), 0);
+
+    uint8_t other;
+    EXPECT_FALSE(pool->owns(&other));
+    EXPECT_ANY_THROW(new BufferPool(0, 1));
+    EXPECT_ANY_THROW(new BufferPool(1, 0));
+}
+
+TEST(BufferPoolTests, OutlivesOwner)
+{
+    BufferPool* pool = new BufferPool(8, 2);
+    uint8_t* buffer = pool->acquire();
+    ASSERT_NE(buffer, nullptr);
+
+    // as when the tap is restarted while zmq still holds a message, the last release deletes the pool
+    pool->retire();
+    BufferPool::release(buffer, pool);
+}
+
+TEST(BufferPoolTests, ConcurrentRelease)
+{
+    const int count = 100000;
+    std::unique_ptr<BufferPool, BufferPool::Retirer> pool(new BufferPool(sizeof(int), 8));
+    RowRingBuffer handoff(sizeof(uint8_t*), 4);
+
+    // stands in for the zmq io thread, handing buffers back while the owner keeps acquiring
+    std::thread releaser([&pool, &handoff, count]()
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            uint8_t* slot;
+
+            while (!(slot = handoff.beginRead()))
+            {
+                std::this_thread::yield();
+            }
+
+            uint8_t* buffer;
+            memcpy(&buffer, slot, sizeof(buffer));
+            handoff.commitRead();
+
+            int value;
+            memcpy(&value, buffer, sizeof(value));
+            EXPECT_EQ(value, i);
+
+            BufferPool::release(buffer, pool.get());
+        }
+    });
+
+    for (int i = 0; i < count; ++i)
+    {
+        uint8_t* buffer;
+
+        while (!(buffer = pool->acquire()))
+        {
+            std::this_thread::yield();
+        }
+
+        memcpy(buffer, &i, sizeof(i));
+
+        uint8_t* slot;
+
+        while (!(slot = handoff.beginWrite()))
+        {
+            std::this_thread::yield();
+        }
+
+        memcpy(slot, &buffer, sizeof(buffer));
+        handoff.commitWrite();
+    }
+
+    releaser.join();
+
+    EXPECT_EQ(pool->getOutstanding(), 0);
+}
+
+TEST(RowSamplerTests, MinInterval)
+{
+    std::vector<DataItem> items;
+    items.push_back(DataItem("value", "uint32_t", 4, 0));
+
+    uint8_t row[4] = {0};
+
+    RowSampler sampler(items, 100, false, std::map<std::string, Deadband>());
+    EXPECT_FALSE(sampler.isChangeGated());
+
+    EXPECT_TRUE(sampler.isDue(1000));
+    sampler.logged(1000, row);
+
+    EXPECT_FALSE(sampler.isDue(1050));
+    EXPECT_TRUE(sampler.isDue(1100));
+
+    // a clock stepping back doesn't silence the tap
+    EXPECT_TRUE(sampler.isDue(10));
+}
+
+TEST(RowSamplerTests, OnChangeAndDeadband)
+{
+    std::vector<DataItem> items;
+    items.push_back(DataItem("count", "uint32_t", 4, 0));
+    items.push_back(DataItem("flags", "uint8_t", 1, 4));
+    items.push_back(DataItem("level", "float64", 8, 5));
+    items.push_back(DataItem("temps", "float32", 8, 13, 2));
 
+    std::map<std::string, Deadband> deadbands;
+    deadbands["level"] = Deadband(0.5, 0);
+    deadbands["temps"] = Deadband(0, 0.1);
+
+    RowSampler sampler(items, 0, false, deadbands);
+    EXPECT_TRUE(sampler.isChangeGated());
+
+    // count and flags are merged into one byte for byte range
+    ASSERT_EQ(sampler.getPlan().size(), 3);
+    EXPECT_EQ(sampler.getPlan()[0].size, 5);
+    EXPECT_EQ(sampler.getPlan()[0].elementSize, 0);
+
+    uint8_t row[21] = {0};
+    double level = 10.0;
+    float temps[2] = {100.0f, -50.0f};
+    memcpy(row + 5, &level, sizeof(level));
+    memcpy(row + 13, temps, sizeof(temps));
+
+    EXPECT_TRUE(sampler.hasChanged(row));
+    sampler.logged(0, row);
+    EXPECT_FALSE(sampler.hasChanged(row));
+
+    level = 10.4;
+    memcpy(row + 5, &level, sizeof(level));
+    EXPECT_FALSE(sampler.hasChanged(row));
+
+    level = 10.6;
+    memcpy(row + 5, &level, sizeof(level));
+    EXPECT_TRUE(sampler.hasChanged(row));
+
+    level = 10.0;
+    memcpy(row + 5, &level, sizeof(level));
+    temps[1] = -54.0f;
+    memcpy(row + 13, temps, sizeof(temps));
+    EXPECT_FALSE(sampler.hasChanged(row));
+
+    temps[1] = -56.0f;
+    memcpy(row + 13, temps, sizeof(temps));
+    EXPECT_TRUE(sampler.hasChanged(row));
+
+    temps[1] = -50.0f;
+    memcpy(row + 13, temps, sizeof(temps));
+    row[4] = 1;
+    EXPECT_TRUE(sampler.hasChanged(row));
+}
+
+TEST(RowSamplerTests, BadDeadband)
+{
+    std::vector<DataItem> items;
+    items.push_back(DataItem("count", "uint32_t", 4, 0));
+
+    std::map<std::string, Deadband> deadbands;
+    deadbands["count"] = Deadband(1, 0);
+    EXPECT_ANY_THROW(RowSampler(items, 0, false, deadbands));
+
+    deadbands.clear();
+    deadbands["missing"] = Deadband(1, 0);
+    EXPECT_ANY_THROW(RowSampler(items, 0, false, deadbands));
+}
+
+namespace tap_tests
+{
+    // exposes the row capture so the serialized bytes can be checked
+    class TestTypedTap : public TypedTap<double, uint32_t, uint8_t, int16_t>
+    {
+    public:
+        TestTypedTap(double* d, uint32_t* u, uint8_t* b, int16_t* s):
+            TypedTap<double, uint32_t, uint8_t, int16_t>({{"double1", "uint1", "ubyte1", "short1"}}, d, u, b, s) {}
+
+        void capture(uint8_t* row)
+        {
+            captureRow(row);
+        }
+    };
+}
+
+namespace tap_tests
+{
+    // exposes the capture plan and snapshot without starting the tap
+    class CaptureTap : public Tap
+    {
+    public:
+        const std::vector<CaptureRun>& plan()
+        {
+            buildCapturePlan();
+            return capturePlan;
+        }
+
+        void snapshot(uint8_t* row)
+        {
+            captureSnapshot(row);
+        }
+    };
+}
+
+namespace tap_tests
+{
+    // serializes rows the way the publisher does, without starting the tap
+    class PayloadTap : public Tap
+    {
+    public:
+        void prepare()
+        {
+            formatItems = getFormatItems();
+            buildPayloadBuffers();
+        }
+
+        std::vector<uint8_t> delta(const std::vector<uint8_t>& row)
+        {
+            std::vector<uint8_t> encoded(deltaBuffer.size());
+            encoded.resize(encodeDelta(row.data(), encoded.data()));
+            return encoded;
+        }
+
+        void append(const std::vector<uint8_t>& slot)
+        {
+            appendToBatch(slot.data());
+        }
+
+        std::vector<uint8_t> batch()
+        {
+            std::vector<uint8_t> records(batchData, batchData + batchSize);
+            releaseBatch();
+            return records;
+        }
+    };
+
+    // appends a value in network order
+    template <typename T>
+    void appendNetwork(std::vector<uint8_t>& bytes, T value)
+    {
+        uint8_t swapped[sizeof(T)];
+        byte_swap::toNetwork(&value, swapped, sizeof(T), 1);
+        bytes.insert(bytes.end(), swapped, swapped + sizeof(T));
+    }
+
+    // a network order (a, b) row
+    std::vector<uint8_t> networkRow(uint32_t a, uint16_t b)
+    {
+        std::vector<uint8_t> row;
+        appendNetwork(row, a);
+        appendNetwork(row, b);
+        return row;
+    }
+}
+
+TEST(TapTests, EncodeDeltaBytes)
+{
+    uint32_t a = 0;
+    uint16_t b = 0;
+
+    tap_tests::PayloadTap t;
+    t.setDeltaEncoding(true, 3);
+    t.addItem(new DataRefItem<uint32_t>("a", &a));
+    t.addItem(new DataRefItem<uint16_t>("b", &b));
+    t.prepare();
+
+    // sequence number, bitmap and then only the columns whose bit is set
+    std::vector<uint8_t> expected;
+    tap_tests::appendNetwork<uint32_t>(expected, 0);
+    expected.push_back(0x03);
+    tap_tests::appendNetwork<uint32_t>(expected, 1);
+    tap_tests::appendNetwork<uint16_t>(expected, 2);
+    EXPECT_EQ(t.delta(tap_tests::networkRow(1, 2)), expected);
+
+    expected.clear();
+    tap_tests::appendNetwork<uint32_t>(expected, 1);
+    expected.push_back(0x02);
+    tap_tests::appendNetwork<uint16_t>(expected, 3);
+    EXPECT_EQ(t.delta(tap_tests::networkRow(1, 3)), expected);
+
+    expected.clear();
+    tap_tests::appendNetwork<uint32_t>(expected, 2);
+    expected.push_back(0x00);
+    EXPECT_EQ(t.delta(tap_tests::networkRow(1, 3)), expected);
+
+    // every third row is a keyframe again, changed or not
+    expected.clear();
+    tap_tests::appendNetwork<uint32_t>(expected, 3);
+    expected.push_back(0x03);
+    tap_tests::appendNetwork<uint32_t>(expected, 1);
+    tap_tests::appendNetwork<uint16_t>(expected, 3);
+    EXPECT_EQ(t.delta(tap_tests::networkRow(1, 3)), expected);
+}
+
+TEST(TapTests, AppendToBatchBytes)
+{
+    uint32_t a = 0;
+    uint16_t b = 0;
+
+    for (int delta = 0; delta < 2; ++delta)
+    {
+        tap_tests::PayloadTap t;
+        t.setBatching(4, 0);
+        t.setDeltaEncoding(delta != 0);
+        t.addItem(new DataRefItem<uint32_t>("a", &a));
+        t.addItem(new DataRefItem<uint16_t>("b", &b));
+        t.prepare();
+
+        std::vector<uint8_t> expected;
+
+        for (uint32_t i = 0; i < 2; ++i)
+        {
+            // a queue slot is the network order timestamp followed by the row
+            std::vector<uint8_t> slot;
+            tap_tests::appendNetwork<uint64_t>(slot, 100 + i);
+            std::vector<uint8_t> row = tap_tests::networkRow(5, static_cast<uint16_t>(i));
+            slot.insert(slot.end(), row.begin(), row.end());
+            t.append(slot);
+
+            // each record is the timestamp, the network order length and the row, here the first is a keyframe
+            std::vector<uint8_t> recordRow;
+
+            if (delta)
+            {
+                tap_tests::appendNetwork<uint32_t>(recordRow, i);
+                recordRow.push_back(i == 0 ? 0x03 : 0x02);
+
+                if (i == 0)
+                {
+                    tap_tests::appendNetwork<uint32_t>(recordRow, 5);
+                }
+
+                tap_tests::appendNetwork<uint16_t>(recordRow, static_cast<uint16_t>(i));
+            }
+            else
+            {
+                recordRow = row;
+            }
+
+            tap_tests::appendNetwork<uint64_t>(expected, 100 + i);
+            tap_tests::appendNetwork<uint32_t>(expected, static_cast<uint32_t>(recordRow.size()));
+            expected.insert(expected.end(), recordRow.begin(), recordRow.end());
+        }
+
+        EXPECT_EQ(t.batch(), expected);
+    }
+}
+
+TEST(TapTests, CapturePlanMergesContiguousColumns)
+{
+    struct
+    {
+        uint32_t a;
+        uint32_t b;
+        double c;
+    } values = {1, 2, 3.0};
+
+    // the gap keeps the two columns apart in memory
+    struct
+    {
+        uint16_t separate;
+        uint16_t gap;
+        std::array<int16_t, 3> array;
+    } others = {4, 0, {{5, 6, 7}}};
+
+    uint16_t& separate = others.separate;
+    std::array<int16_t, 3>& array = others.array;
+
+    tap_tests::CaptureTap t;
+    t.addItem(new DataRefItem<uint32_t>("a", &values.a));
+    t.addItem(new DataRefItem<uint32_t>("b", &values.b));
+    t.addItem(new DataRefItem<double>("c", &values.c));
+    t.addItem(new DataRefItem<uint16_t>("separate", &separate));
+    t.addItem(new DataRefItem<std::array<int16_t, 3>>("array", &array));
+
+    const std::vector<CaptureRun>& plan = t.plan();
+
+    // the struct is one copy, the other two aren't next to it or each other
+    ASSERT_EQ(plan.size(), 3);
+    EXPECT_EQ(plan[0].size, sizeof(values));
+    EXPECT_EQ(plan[1].size, sizeof(separate));
+    EXPECT_EQ(plan[2].size, sizeof(array));
+
+    std::vector<uint8_t> row(sizeof(values) + sizeof(separate) + sizeof(array));
+    t.snapshot(row.data());
+
+    EXPECT_EQ(memcmp(row.data(), &values, sizeof(values)), 0);
+    EXPECT_EQ(memcmp(row.data() + sizeof(values), &separate, sizeof(separate)), 0);
+    EXPECT_EQ(memcmp(row.data() + sizeof(values) + sizeof(separate), array.data(), sizeof(array)), 0);
+}
+
+TEST(TapTests, SnapshotIsConsistent)
+{
+    // the writer keeps both values equal, but only ever one at a time
+    std::atomic<bool> writing(true);
+    uint64_t first = 0;
+    uint64_t second = 0;
+    SeqLock lock;
+
+    tap_tests::CaptureTap t;
+    t.addItem(new DataRefItem<uint64_t>("first", &first));
+    t.addItem(new DataRefItem<uint64_t>("second", &second));
+    t.setSnapshotLock(&lock);
+    t.plan();
+
+    std::thread writer([&]()
+    {
+        while (writing)
+        {
+            SeqLock::WriteGuard guard(lock);
+            first++;
+            second++;
+        }
+    });
+
+    uint8_t row[2 * sizeof(uint64_t)];
+    unsigned int consistent = 0;
+    const unsigned int reads = 10000;
+
+    for (unsigned int i = 0; i < reads; ++i)
+    {
+        t.snapshot(row);
+
+        uint64_t a;
+        uint64_t b;
+        memcpy(&a, row, sizeof(a));
+        memcpy(&b, row + sizeof(a), sizeof(b));
+
+        if (a == b)
+        {
+            consistent++;
+        }
+    }
+
+    writing = false;
+    writer.join();
+
+    // a row is only allowed to be torn when the retries ran out, and then it is counted
+    EXPECT_LE(reads - consistent, t.getTornCount());
+}
+
+TEST(TypedTapTests, Layout)
+{
+    typedef TypedTap<double, uint32_t, uint8_t, int16_t> T;
+
+    static_assert(T::rowSize == 15, "row size");
+    static_assert(T::offsetOf<0>() == 0, "offset 0");
+    static_assert(T::offsetOf<1>() == 8, "offset 1");
+    static_assert(T::offsetOf<2>() == 12, "offset 2");
+    static_assert(T::offsetOf<3>() == 13, "offset 3");
+
+    EXPECT_EQ(T::fieldCount, 4);
+}
+
+TEST(TypedTapTests, MatchesDataRefItems)
+{
+    double double1 = 1.5;
+    uint32_t uint1 = 0x01020304;
+    uint8_t ubyte1 = 7;
+    int16_t short1 = -1000;
+
+    Tap t;
+    t.addItem(new DataRefItem<double>("double1", &double1));
+    t.addItem(new DataRefItem<uint32_t>("uint1", &uint1));
+    t.addItem(new DataRefItem<uint8_t>("ubyte1", &ubyte1));
+    t.addItem(new DataRefItem<int16_t>("short1", &short1));
+
+    tap_tests::TestTypedTap typed(&double1, &uint1, &ubyte1, &short1);
+
+    std::vector<DataItem> expected = t.getFormatItems();
+    std::vector<DataItem> actual = typed.getFormatItems();
+
+    ASSERT_EQ(expected.size(), actual.size());
+
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        EXPECT_EQ(expected[i].name, actual[i].name);
+        EXPECT_EQ(expected[i].type, actual[i].type);
+        EXPECT_EQ(expected[i].size, actual[i].size);
+        EXPECT_EQ(expected[i].offset, actual[i].offset);
+    }
+
+    DataFormatParser p;
+    ASSERT_TRUE(p.createFromDataRefItems(t.getItems(), "BEERR01", "/typed"));
+    std::string expectedXml = p.getXmlStr();
+    ASSERT_TRUE(p.createFromDataItems(actual, "BEERR01", "/typed"));
+    EXPECT_EQ(expectedXml, p.getXmlStr());
+
+    // the captured rows must match byte for byte too, and so must the rows the publisher converts
+    std::vector<uint8_t> expectedRow(tap_tests::TestTypedTap::rowSize);
+    std::vector<uint8_t> networkRow(tap_tests::TestTypedTap::rowSize);
+    std::vector<uint8_t> actualRow(tap_tests::TestTypedTap::rowSize);
+    std::vector<AbstractDataRefItem*> items = t.getItems();
+
+    for (auto i = items.begin(); i != items.end(); ++i)
+    {
+        (*i)->getHostDataRef(expectedRow.data() + (*i)->getOffset());
+        (*i)->getNetworkDataRef(networkRow.data() + (*i)->getOffset());
+    }
+
+    typed.capture(actualRow.data());
+    EXPECT_EQ(expectedRow, actualRow);
+
+    RowConverter converter(actual);
+    converter.toNetwork(actualRow.data(), actualRow.data());
+    EXPECT_EQ(networkRow, actualRow);
+}
+
+TEST(TypedTapTests, StartLogStop)
+{
+    double double1 = 0;
+    uint32_t uint1 = 0;
+
+    TypedTap<double, uint32_t> t({{"double1", "uint1"}}, &double1, &uint1);
+    t.init("localhost", 12345, 1000);
+    t.start("/typed");
+
+    for (unsigned int i = 0; i < 10; ++i)
+    {
+        double1 += 0.5;
+        uint1++;
+        t.log();
+    }
+
+    t.stop();
+}
+
+TEST(TypedTapTests, AddItemThroughBaseThrows)
+{
+    double double1 = 0;
+    uint32_t uint1 = 0;
+    uint32_t extra = 0;
+
+    TypedTap<double, uint32_t> typed({{"double1", "uint1"}}, &double1, &uint1);
+    Tap& t = typed;
+
+    EXPECT_THROW(t.addItem(new DataRefItem<uint32_t>("extra", &extra)), std::runtime_error);
+    EXPECT_THROW(t.addItems({new DataRefItem<uint32_t>("extra", &extra)}), std::runtime_error);
+    EXPECT_TRUE(t.getItems().empty());
+    EXPECT_EQ(t.getFormatItems().size(), 2);
+}
+
+namespace tap_tests
+{
+
+    class LagerTester
+    {
+    public:
+        LagerTester() {}
+        ~LagerTester()
+        {
+            tap.stop();
+        }
+
+        void initTap(const std::string& hostName, int port, int timeout)
+        {
+            tap.init(hostName, port, timeout);
+            tap.addItem(new DataRefItem<double>("val1", &val1));
+            tap.addItem(new DataRefItem<double>("val2", &val2));
+            tap.start("/lagerTester");
+        }
+
+        Tap tap;
+    private:
+        double val1;
+        double val2;
+    };
+
+}
+
+TEST(LagerRuntimeTests, SharedByTaps)
+{
+    std::shared_ptr<LagerRuntime> runtime = LagerRuntime::getDefault();
+    EXPECT_EQ(runtime, LagerRuntime::getDefault());
+
+    std::shared_ptr<ClusteredHashmapClient> client = runtime->getChpClient("localhost", 12345, 1000);
+    EXPECT_EQ(client, runtime->getChpClient("localhost", 12345, 1000));
+    EXPECT_NE(client, runtime->getChpClient("localhost", 12346, 1000));
+
+    const unsigned int tapCount = 20;
+    std::vector<uint32_t> values(tapCount, 0);
+    std::vector<std::unique_ptr<Tap>> taps;
+
+    for (unsigned int i = 0; i < tapCount; ++i)
+    {
+        std::stringstream ss;
+        ss << "/shared" << i;
+
+        taps.push_back(std::unique_ptr<Tap>(new Tap));
+        EXPECT_TRUE(taps.back()->init(runtime, "localhost", 12345, 1000));
+        taps.back()->addItem(new DataRefItem<uint32_t>("value", &values[i]));
+        taps.back()->start(ss.str());
+    }
+
+    EXPECT_EQ(runtime->getPublisherCount(), tapCount);
+
+    for (unsigned int n = 0; n < 10; ++n)
+    {
+        for (unsigned int i = 0; i < tapCount; ++i)
+        {
+            values[i]++;
+            taps[i]->log();
+        }
+    }
+
+    for (unsigned int i = 0; i < tapCount; ++i)
+    {
+        taps[i]->stop();
+    }
+
+    EXPECT_EQ(runtime->getPublisherCount(), 0);
+
+    // a tap destroyed without stop() must unregister itself too
+    Tap unstopped;
+    EXPECT_TRUE(unstopped.init(runtime, "localhost", 12345, 1000));
+    EXPECT_FALSE(unstopped.init(std::shared_ptr<LagerRuntime>(), "localhost", 12345, 1000));
+}
+
+TEST(LagerRuntimeTests, EmbeddedRowSink)
+{
+    std::shared_ptr<LagerRuntime> runtime(new LagerRuntime);
+
+    std::mutex rowsMutex;
+    std::vector<std::vector<uint8_t>> rows;
+    std::string rowUuid;
+
+    unsigned int sinkId = runtime->addRowSink([&](const std::string & uuid, const uint8_t* row, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(rowsMutex);
+        rowUuid = uuid;
+        rows.push_back(std::vector<uint8_t>(row, row + size));
+    });
+
+    uint32_t value = 0;
+
+    Tap t;
+    t.setEmbedded(true);
+    EXPECT_TRUE(t.init(runtime, "localhost", 12345, 1000));
+    t.addItem(new DataRefItem<uint32_t>("value", &value));
+    t.start("/embedded");
+
+    const uint32_t rowCount = 10;
+
+    for (uint32_t i = 0; i < rowCount; ++i)
+    {
+        value = i;
+        t.log();
+    }
+
+    for (int retries = 0; retries < 100; ++retries)
+    {
+        std::lock_guard<std::mutex> lock(rowsMutex);
+
+        if (rows.size() == rowCount)
+        {
+            break;
+        }
+
+        lager_utils::sleepMillis(10);
+    }
+
+    t.stop();
+    runtime->removeRowSink(sinkId);
+
+    // each row is the timestamp followed by the row exactly as captured
+    ASSERT_EQ(rows.size(), rowCount);
+    EXPECT_EQ(rowUuid.size(), UUID_SIZE_BYTES);
+
+    for (uint32_t i = 0; i < rowCount; ++i)
+    {
+        ASSERT_EQ(rows[i].size(), TIMESTAMP_SIZE_BYTES + sizeof(uint32_t));
+
+        uint32_t logged;
+        memcpy(&logged, rows[i].data() + TIMESTAMP_SIZE_BYTES, sizeof(logged));
+        EXPECT_EQ(logged, i);
+    }
+}
+
+TEST(LagerRuntimeTests, StopDeliversQueuedRows)
+{
+    std::shared_ptr<LagerRuntime> runtime(new LagerRuntime);
+    std::vector<uint32_t> values; // only touched by the sink, which removeRowSink() waits out
+
+    unsigned int sinkId = runtime->addRowSink([&](const std::string&, const uint8_t* row, size_t size)
+    {
+        uint32_t logged;
+        memcpy(&logged, row + TIMESTAMP_SIZE_BYTES, sizeof(logged));
+        values.push_back(logged);
+    });
+
+    uint32_t value = 0;
+
+    Tap t;
+    t.setEmbedded(true);
+    EXPECT_TRUE(t.init(runtime, "localhost", 12345, 1000));
+    t.addItem(new DataRefItem<uint32_t>("value", &value));
+    t.start("/stopdeliver");
+
+    const uint32_t rowCount = 100;
+
+    for (uint32_t i = 0; i < rowCount; ++i)
+    {
+        value = i;
+        t.log();
+    }
+
+    // without waiting for the reactor, whatever it hasn't taken yet is handed over by stop()
+    t.stop();
+    runtime->removeRowSink(sinkId);
+
+    ASSERT_EQ(values.size(), rowCount);
+
+    for (uint32_t i = 0; i < rowCount; ++i)
+    {
+        EXPECT_EQ(values[i], i);
+    }
+}
+
+TEST(LagerRuntimeTests, SlowRowSinkDoesNotBlockPublishers)
+{
+    std::shared_ptr<LagerRuntime> runtime(new LagerRuntime);
+
+    std::atomic<bool> inSink(false);
+    std::atomic<bool> release(false);
+
+    unsigned int sinkId = runtime->addRowSink([&](const std::string&, const uint8_t*, size_t)
+    {
+        inSink = true;
+
+        for (unsigned int i = 0; i < 200 && !release; ++i)
+        {
+            lager_utils::sleepMillis(10);
+        }
+    });
+
+    uint32_t value = 0;
+
+    Tap t;
+    t.setEmbedded(true);
+    EXPECT_TRUE(t.init(runtime, "localhost", 12345, 1000));
+    t.addItem(new DataRefItem<uint32_t>("value", &value));
+    t.start("/slowsink");
+    t.log();
+
+    for (unsigned int i = 0; i < 100 && !inSink; ++i)
+    {
+        lager_utils::sleepMillis(10);
+    }
+
+    ASSERT_TRUE(inSink);
+
+    // the reactor is inside the sink, registering or counting publishers must not wait for it
+    auto before = std::chrono::steady_clock::now();
+    EXPECT_EQ(runtime->getPublisherCount(), 1u);
+    EXPECT_LT(std::chrono::steady_clock::now() - before, std::chrono::milliseconds(500));
+
+    release = true;
+
+    t.stop();
+    runtime->removeRowSink(sinkId);
+}
+
+TEST(LagerRuntimeTests, RestartsAfterContextTerminated)
+{
+    std::shared_ptr<zmq::context_t> context(new zmq::context_t(1));
+    std::shared_ptr<LagerRuntime> runtime(new LagerRuntime(context));
+
+    std::atomic<bool> published(false);
+    std::atomic<bool> terminated(false);
+
+    unsigned int publisherId = runtime->addPublisher("inproc://restart", [&](zmq::socket_t& socket)
+    {
+        published = true;
+        zmq::message_t message(1);
+
+        try
+        {
+            socket.send(message, ZMQ_DONTWAIT);
+        }
+        catch (const zmq::error_t& e)
+        {
+            terminated = e.num() == ETERM;
+            throw;
+        }
+
+        return std::chrono::microseconds(1000);
+    }, []()
+    {
+        return false;
+    });
+
+    // the reactor's socket has to exist before the context goes, or the publisher is never called
+    for (unsigned int i = 0; i < 100 && !published; ++i)
+    {
+        lager_utils::sleepMillis(10);
+    }
+
+    ASSERT_TRUE(published);
+    zmq_ctx_shutdown((void*)*context.get());
+
+    for (unsigned int i = 0; i < 100 && !terminated; ++i)
+    {
+        lager_utils::sleepMillis(10);
+    }
+
+    ASSERT_TRUE(terminated);
+
+    // give the reactor time to exit, then check that a publisher added afterwards is still served
+    lager_utils::sleepMillis(100);
+
+    std::atomic<unsigned int> delivered(0);
+
+    unsigned int embeddedId = runtime->addEmbeddedPublisher([&]()
+    {
+        delivered++;
+        return std::chrono::microseconds(1000);
+    }, []()
+    {
+        return false;
+    });
+
+    for (unsigned int i = 0; i < 100 && delivered == 0; ++i)
+    {
+        lager_utils::sleepMillis(10);
+    }
+
+    EXPECT_GT(delivered, 0u);
+
+    // the terminated publisher has no socket anymore, so this only forgets it
+    runtime->removePublisher(publisherId);
+    runtime->removePublisher(embeddedId);
+    EXPECT_EQ(runtime->getPublisherCount(), 0u);
+}
+
+TEST(TapTests, LogOnChange)
+{
+    std::shared_ptr<LagerRuntime> runtime(new LagerRuntime);
+
+    uint32_t value = 0;
+    double level = 0;
+
+    Tap t;
+    t.setEmbedded(true);
+    t.setLogOnChange(true);
+    t.setDeadband("level", 1.0);
+    EXPECT_TRUE(t.init(runtime, "localhost", 12345, 1000));
+    t.addItem(new DataRefItem<uint32_t>("value", &value));
+    t.addItem(new DataRefItem<double>("level", &level));
+    t.start("/onchange");
+
+    t.log();
+    t.log();
+    level = 0.5;
+    t.log();
+    value = 1;
+    t.log();
+
+    EXPECT_EQ(t.getFilteredCount(), 2);
+
+    t.stop();
+}
+
+TEST(TapTests, MultiProducer)
+{
+    std::shared_ptr<LagerRuntime> runtime(new LagerRuntime);
+    std::atomic<uint64_t> delivered(0);
+
+    unsigned int sinkId = runtime->addRowSink([&delivered](const std::string&, const uint8_t*, size_t)
+    {
+        delivered++;
+    });
+
+    const unsigned int threadCount = 4;
+    const unsigned int rowsPerThread = 1000;
+    uint32_t value = 0;
+
+    Tap t;
+    t.setEmbedded(true);
+    t.setMultiProducer(true);
+    t.setOverflowPolicy(TapOverflowPolicy::BLOCK);
+    EXPECT_TRUE(t.init(runtime, "localhost", 12345, 1000));
+    t.addItem(new DataRefItem<uint32_t>("value", &value));
+    t.start("/multiproducer");
+
+    std::vector<std::thread> threads;
+
+    for (unsigned int i = 0; i < threadCount; ++i)
+    {
+        threads.push_back(std::thread([&t, rowsPerThread]()
+        {
+            for (unsigned int n = 0; n < rowsPerThread; ++n)
+            {
+                t.log();
+            }
+        }));
+    }
+
+    for (auto i = threads.begin(); i != threads.end(); ++i)
+    {
+        i->join();
+    }
+
+    for (int retries = 0; retries < 100 && delivered < threadCount * rowsPerThread; ++retries)
+    {
+        lager_utils::sleepMillis(10);
+    }
+
+    t.stop();
+    runtime->removeRowSink(sinkId);
+
+    EXPECT_EQ(delivered, threadCount * rowsPerThread);
+    EXPECT_EQ(t.getDroppedCount(), 0);
+
+    // sampling compares each row against the previous one, so it needs a single producer
+    Tap sampled;
+    sampled.setMultiProducer(true);
+    sampled.setLogOnChange(true);
+    EXPECT_TRUE(sampled.init(runtime, "localhost", 12345, 1000));
+    sampled.addItem(new DataRefItem<uint32_t>("value", &value));
+    EXPECT_ANY_THROW(sampled.start("/multiproducer"));
+}
+
+TEST(TapTests, RealtimeLogDoesNotAllocate)
+{
+    std::shared_ptr<LagerRuntime> runtime(new LagerRuntime);
+
+    uint32_t count = 0;
+    double level = 0;
+    std::array<float, 4> temps = {{0, 0, 0, 0}};
+    SeqLock lock;
+
+    // every optional step of the log path: sampling, snapshots and the multi producer queue
+    Tap sampled;
+    sampled.setEmbedded(true);
+    sampled.setRealtime(true);
+    sampled.setSnapshotLock(&lock);
+    sampled.setDeadband("level", 0.5);
+    EXPECT_TRUE(sampled.init(runtime, "localhost", 12345, 1000));
+    sampled.addItem(new DataRefItem<uint32_t>("count", &count));
+    sampled.addItem(new DataRefItem<double>("level", &level));
+    sampled.addItem(new DataRefItem<std::array<float, 4>>("temps", &temps));
+    sampled.start("/realtime1");
+
+    Tap shared;
+    shared.setEmbedded(true);
+    shared.setRealtime(true);
+    shared.setMultiProducer(true);
+    EXPECT_TRUE(shared.init(runtime, "localhost", 12345, 1000));
+    shared.addItem(new DataRefItem<uint32_t>("count", &count));
+    shared.start("/realtime2");
+
+    uint64_t before = threadAllocations;
+
+    for (unsigned int i = 0; i < 10000; ++i)
+    {
+        {
+            SeqLock::WriteGuard guard(lock);
+            count++;
+            level += 0.1;
+            temps[i % temps.size()] += 1.0f;
+        }
+
+        sampled.log();
+        shared.log();
+    }
+
+    EXPECT_EQ(threadAllocations - before, 0);
+
+    sampled.stop();
+    shared.stop();
+
+    // blocking on a full queue would make log() wait on the publisher
+    Tap blocking;
+    blocking.setRealtime(true);
+    blocking.setOverflowPolicy(TapOverflowPolicy::BLOCK);
+    EXPECT_TRUE(blocking.init(runtime, "localhost", 12345, 1000));
+    blocking.addItem(new DataRefItem<uint32_t>("count", &count));
+    EXPECT_ANY_THROW(blocking.start("/realtime3"));
+}
+
+TEST(LagerClockTests, Sources)
+{
+    const uint64_t wallClock = lager_utils::getCurrentTime();
+    const uint64_t tolerance = 100000000; // coarse clocks may lag by a few ticks
+
+    LagerClock realtime;
+    EXPECT_EQ(realtime.getSource(), LagerClockSource::REALTIME);
+    EXPECT_NEAR(static_cast<double>(realtime.now()), static_cast<double>(wallClock), tolerance);
+
+    LagerClock coarse(LagerClockSource::REALTIME_COARSE);
+    EXPECT_NEAR(static_cast<double>(coarse.now()), static_cast<double>(wallClock), tolerance);
+
+    LagerClock raw(LagerClockSource::MONOTONIC_RAW);
+    uint64_t previous = raw.now();
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        uint64_t current = raw.now();
+        EXPECT_GE(current, previous);
+        previous = current;
+    }
+
+    if (LagerClock::isSupported(LagerClockSource::TSC))
+    {
+        LagerClock tsc(LagerClockSource::TSC);
+        EXPECT_NEAR(static_cast<double>(tsc.now()), static_cast<double>(realtime.now()), tolerance);
+
+        previous = tsc.now();
+
+        for (int i = 0; i < 1000; ++i)
+        {
+            uint64_t current = tsc.now();
+            EXPECT_GE(current, previous);
+            previous = current;
+        }
+    }
+    else
+    {
+        EXPECT_ANY_THROW(LagerClock(LagerClockSource::TSC));
+    }
+}
+
+TEST(TapTests, UserTimestamp)
+{
+    std::shared_ptr<LagerRuntime> runtime(new LagerRuntime);
+
+    std::mutex rowsMutex;
+    std::vector<uint64_t> timestamps;
+
+    unsigned int sinkId = runtime->addRowSink([&](const std::string&, const uint8_t* row, size_t)
+    {
+        uint64_t timestamp;
+        memcpy(&timestamp, row, sizeof(timestamp));
+
+        std::lock_guard<std::mutex> lock(rowsMutex);
+        timestamps.push_back(lager_utils::ntohll(timestamp));
+    });
+
+    uint32_t value = 0;
+
+    Tap t;
+    t.setEmbedded(true);
+    t.setClock(LagerClockSource::REALTIME_COARSE);
+    EXPECT_TRUE(t.init(runtime, "localhost", 12345, 1000));
+    t.addItem(new DataRefItem<uint32_t>("value", &value));
+    t.start("/timestamps");
+
+    t.log(42);
+    t.log(43);
+    t.log();
+
+    for (int retries = 0; retries < 100; ++retries)
+    {
+        std::lock_guard<std::mutex> lock(rowsMutex);
+
+        if (timestamps.size() == 3)
+        {
+            break;
+        }
+
+        lager_utils::sleepMillis(10);
+    }
+
+    t.stop();
+    runtime->removeRowSink(sinkId);
+
+    ASSERT_EQ(timestamps.size(), 3);
+    EXPECT_EQ(timestamps[0], 42);
+    EXPECT_EQ(timestamps[1], 43);
+    EXPECT_GT(timestamps[2], 43);
+}
+
+TEST(TapTests, EmbeddedRequiresRuntime)
+{
+    uint32_t value = 0;
+
+    Tap t;
+    t.setEmbedded(true);
+    EXPECT_TRUE(t.init("localhost", 12345, 1000));
+    t.addItem(new DataRefItem<uint32_t>("value", &value));
+    EXPECT_ANY_THROW(t.start("/embedded"));
 }
 
 TEST(TapOwnedByClass, test)
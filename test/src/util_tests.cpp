@@ -1,5 +1,8 @@
+#include <vector>
+
 #include <gtest/gtest.h>
 
+#include "lager/byte_swap.h"
 #include "lager/lager_defines.h"
 #include "lager/lager_utils.h"
 
@@ -29,12 +32,74 @@ TEST_F(LagerUtilTests, RemoteUri)
     ASSERT_STREQ(lager_utils::getRemoteUri("test", 12345).c_str(), "tcp://test:12345");
 }
 
+TEST_F(LagerUtilTests, TransportUris)
+{
+    EXPECT_EQ(lager_utils::getLocalUri(12345, LagerTransport::TCP), "tcp://*:12345");
+    EXPECT_EQ(lager_utils::getLocalUri(12345, LagerTransport::IPC), "ipc:///tmp/lager-12345");
+    EXPECT_EQ(lager_utils::getLocalUri(12345, LagerTransport::INPROC), "inproc://lager-12345");
+
+    // both ends of an ipc or inproc connection must agree, the host doesn't matter
+    EXPECT_EQ(lager_utils::getRemoteUri("test", 12345, LagerTransport::IPC),
+              lager_utils::getLocalUri(12345, LagerTransport::IPC));
+    EXPECT_EQ(lager_utils::getRemoteUri("test", 12345, LagerTransport::INPROC),
+              lager_utils::getLocalUri(12345, LagerTransport::INPROC));
+}
+
 TEST_F(LagerUtilTests, GetTime)
 {
     std::string gmtTime = lager_utils::getCurrentTimeFormatted("%Y%m%d", false);
     std::string localTime = lager_utils::getCurrentTimeFormatted("%Y%m%d");
 }
 
+TEST_F(LagerUtilTests, BulkByteSwapMatchesScalar)
+{
+    // odd lengths exercise the vector loops and the scalar tail
+    std::vector<uint16_t> shorts(37);
+    std::vector<uint32_t> ints(37);
+    std::vector<uint64_t> longs(37);
+
+    for (size_t i = 0; i < shorts.size(); ++i)
+    {
+        shorts[i] = static_cast<uint16_t>(i * 0x0102 + 1);
+        ints[i] = static_cast<uint32_t>(i * 0x01020304 + 1);
+        longs[i] = i * 0x0102030405060708ULL + 1;
+    }
+
+    std::vector<uint16_t> shortsOut(shorts.size());
+    std::vector<uint32_t> intsOut(ints.size());
+    std::vector<uint64_t> longsOut(longs.size());
+
+    byte_swap::toNetwork(shorts.data(), shortsOut.data(), sizeof(uint16_t), shorts.size());
+    byte_swap::toNetwork(ints.data(), intsOut.data(), sizeof(uint32_t), ints.size());
+    byte_swap::toNetwork(longs.data(), longsOut.data(), sizeof(uint64_t), longs.size());
+
+    for (size_t i = 0; i < shorts.size(); ++i)
+    {
+        EXPECT_EQ(shortsOut[i], htons(shorts[i]));
+        EXPECT_EQ(intsOut[i], htonl(ints[i]));
+        EXPECT_EQ(longsOut[i], lager_utils::htonll(longs[i]));
+    }
+
+    // in place and back again
+    byte_swap::toHost(intsOut.data(), intsOut.data(), sizeof(uint32_t), intsOut.size());
+    EXPECT_EQ(ints, intsOut);
+}
+
+TEST_F(LagerUtilTests, MatchesGlob)
+{
+    EXPECT_TRUE(lager_utils::matchesGlob("/RobotA/*", "/RobotA/joints"));
+    EXPECT_TRUE(lager_utils::matchesGlob("/RobotA/*", "/RobotA/arm/joints"));
+    EXPECT_TRUE(lager_utils::matchesGlob("/RobotA/*", "/RobotA/"));
+    EXPECT_FALSE(lager_utils::matchesGlob("/RobotA/*", "/RobotB/joints"));
+    EXPECT_FALSE(lager_utils::matchesGlob("/RobotA/*", "/RobotA"));
+    EXPECT_TRUE(lager_utils::matchesGlob("/Robot?/*/temp", "/RobotC/arm/temp"));
+    EXPECT_FALSE(lager_utils::matchesGlob("/Robot?/*/temp", "/RobotC/arm/temps"));
+    EXPECT_TRUE(lager_utils::matchesGlob("*", ""));
+    EXPECT_TRUE(lager_utils::matchesGlob("/exact", "/exact"));
+    EXPECT_FALSE(lager_utils::matchesGlob("/exact", "/exactly"));
+    EXPECT_TRUE(lager_utils::matchesGlob("*a*b", "xxaxxab"));
+}
+
 int main(int argc, char* argv[])
 {
     ::testing::InitGoogleTest(&argc, argv);